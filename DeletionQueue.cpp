@@ -0,0 +1,93 @@
+#include "DeletionQueue.hpp"
+
+// C++ includes
+#include <limits>
+
+DeletionQueue::DeletionQueue()
+{
+}
+
+DeletionQueue::~DeletionQueue()
+{
+}
+
+void DeletionQueue::init(VkDevice newDevice, MemoryAllocator * newAllocator)
+{
+    device = newDevice;
+    allocator = newAllocator;
+}
+
+void DeletionQueue::destroy()
+{
+    retire(std::numeric_limits<uint64_t>::max());
+}
+
+void DeletionQueue::deleteBuffer(uint64_t retireValue, VkBuffer buffer, const MemoryAllocation & memory)
+{
+    // Memory is captured by value : the caller's allocation is usually replaced right after
+    MemoryAllocation bufferMemory = memory;
+    push(retireValue, [this, buffer, bufferMemory]() mutable {
+        vkDestroyBuffer(device, buffer, nullptr);
+        allocator->free(bufferMemory);
+    });
+}
+
+void DeletionQueue::deleteImage(uint64_t retireValue, VkImage image, const MemoryAllocation & memory)
+{
+    MemoryAllocation imageMemory = memory;
+    push(retireValue, [this, image, imageMemory]() mutable {
+        vkDestroyImage(device, image, nullptr);
+        allocator->free(imageMemory);
+    });
+}
+
+void DeletionQueue::deleteImageView(uint64_t retireValue, VkImageView imageView)
+{
+    push(retireValue, [this, imageView]() {
+        vkDestroyImageView(device, imageView, nullptr);
+    });
+}
+
+void DeletionQueue::deleteFramebuffer(uint64_t retireValue, VkFramebuffer framebuffer)
+{
+    push(retireValue, [this, framebuffer]() {
+        vkDestroyFramebuffer(device, framebuffer, nullptr);
+    });
+}
+
+void DeletionQueue::deletePipeline(uint64_t retireValue, VkPipeline pipeline)
+{
+    push(retireValue, [this, pipeline]() {
+        vkDestroyPipeline(device, pipeline, nullptr);
+    });
+}
+
+void DeletionQueue::deleteSwapchain(uint64_t retireValue, VkSwapchainKHR swapchain)
+{
+    push(retireValue, [this, swapchain]() {
+        vkDestroySwapchainKHR(device, swapchain, nullptr);
+    });
+}
+
+void DeletionQueue::push(uint64_t retireValue, std::function<void()> deleter)
+{
+    pendingDeletions.push_back({ retireValue, std::move(deleter) });
+}
+
+size_t DeletionQueue::retire(uint64_t completedValue)
+{
+    // Oldest first : stop at the first resource the GPU may still use
+    size_t released = 0;
+    while (!pendingDeletions.empty() && pendingDeletions.front().retireValue <= completedValue)
+    {
+        pendingDeletions.front().deleter();
+        pendingDeletions.pop_front();
+        ++released;
+    }
+    return released;
+}
+
+size_t DeletionQueue::getPendingCount()
+{
+    return pendingDeletions.size();
+}
@@ -0,0 +1,53 @@
+#pragma once
+
+// Project includes
+#include "MemoryAllocator.hpp"
+
+// GLFW includes
+#define GLFW_INCLUDE_VULKAN
+#include <GLFW/glfw3.h>
+
+// C++ includes
+#include <deque>
+#include <functional>
+
+// Deferred resource destruction.
+// A resource the GPU may still use is not destroyed right away (which would need a wait for the GPU first) :
+// it's queued with the timeline value of the last submission that can use it, and released by retire() once
+// the timeline reached that value. Everything retired by one call is released together, in queue order.
+class DeletionQueue
+{
+public:
+    DeletionQueue();
+    ~DeletionQueue();
+
+    void init(VkDevice newDevice, MemoryAllocator * newAllocator);
+    // Releases everything still queued, the GPU must be idle
+    void destroy();
+
+    // - Queue Functions
+    // Each resource is kept alive until retire() is called with a value >= retireValue
+    void deleteBuffer(uint64_t retireValue, VkBuffer buffer, const MemoryAllocation & memory);
+    void deleteImage(uint64_t retireValue, VkImage image, const MemoryAllocation & memory);
+    void deleteImageView(uint64_t retireValue, VkImageView imageView);
+    void deleteFramebuffer(uint64_t retireValue, VkFramebuffer framebuffer);
+    void deletePipeline(uint64_t retireValue, VkPipeline pipeline);
+    void deleteSwapchain(uint64_t retireValue, VkSwapchainKHR swapchain);
+    // Anything else (pools, layouts, whole objects...)
+    void push(uint64_t retireValue, std::function<void()> deleter);
+
+    // Releases every resource queued with a value <= completedValue, returns how many were released
+    size_t retire(uint64_t completedValue);
+    size_t getPendingCount();
+
+private:
+    struct PendingDeletion {
+        uint64_t retireValue;
+        std::function<void()> deleter;
+    };
+
+    VkDevice device;
+    MemoryAllocator * allocator;
+
+    std::deque<PendingDeletion> pendingDeletions;   // In retire value order (values of a timeline only grow)
+};
@@ -0,0 +1,92 @@
+#include "FrameArena.hpp"
+
+// Project includes
+#include "Utilities.hpp"
+
+// C++ includes
+#include <stdexcept>
+#include <algorithm>
+
+FrameArena::FrameArena()
+{
+}
+
+FrameArena::~FrameArena()
+{
+}
+
+void FrameArena::init(VkDevice newDevice, MemoryAllocator * newAllocator, VkBufferUsageFlags usage, int newFrameCount,
+                      VkDeviceSize newFrameSize)
+{
+    device = newDevice;
+    allocator = newAllocator;
+    frameCount = newFrameCount;
+
+    // Keep every slice start aligned for any descriptor offset (minUniform/StorageBufferOffsetAlignment are at most 256)
+    frameSize = (newFrameSize + 255) & ~VkDeviceSize(255);
+
+    // HOST_COHERENT isn't required, non coherent memory is flushed explicitly
+    createBuffer(device, allocator, frameSize * frameCount, usage, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT,
+                 &buffer, &bufferMemory);
+    mappedData = static_cast<char *>(allocator->map(bufferMemory));
+}
+
+void FrameArena::destroy()
+{
+    allocator->unmap(bufferMemory);
+    vkDestroyBuffer(device, buffer, nullptr);
+    allocator->free(bufferMemory);
+}
+
+void FrameArena::beginFrame(int frameIndex)
+{
+    frameStart = frameSize * (frameIndex % frameCount);
+    frameHead = frameStart;
+    flushedHead = frameStart;
+}
+
+FrameAllocation FrameArena::allocate(VkDeviceSize size, VkDeviceSize alignment)
+{
+    // Alignment is always a power of two
+    alignment = std::max<VkDeviceSize>(alignment, 1);
+    VkDeviceSize offset = (frameHead + alignment - 1) & ~(alignment - 1);
+
+    if (offset + size > frameStart + frameSize)
+    {
+        throw std::runtime_error("Frame arena is full !");
+    }
+    frameHead = offset + size;
+
+    FrameAllocation allocation = {};
+    allocation.buffer = buffer;
+    allocation.offset = offset;
+    allocation.data = mappedData + offset;
+    return allocation;
+}
+
+void FrameArena::flush()
+{
+    // Only what was written since the last flush of this frame
+    MemoryRange range = {};
+    range.allocation = bufferMemory;
+    range.offset = flushedHead;
+    range.size = frameHead - flushedHead;
+    allocator->flush({ range });
+
+    flushedHead = frameHead;
+}
+
+VkBuffer FrameArena::getBuffer()
+{
+    return buffer;
+}
+
+VkDeviceSize FrameArena::getFrameSize()
+{
+    return frameSize;
+}
+
+VkDeviceSize FrameArena::getFrameUsed()
+{
+    return frameHead - frameStart;
+}
@@ -0,0 +1,60 @@
+#pragma once
+
+// Project includes
+#include "MemoryAllocator.hpp"
+
+// GLFW includes
+#define GLFW_INCLUDE_VULKAN
+#include <GLFW/glfw3.h>
+
+// C++ includes
+#include <vector>
+
+// Size of the arena slice each frame in flight can write to
+const VkDeviceSize DEFAULT_FRAME_ARENA_SIZE = 4 * 1024 * 1024;
+
+// Piece of the arena handed out for the current frame
+struct FrameAllocation {
+    VkBuffer buffer = VK_NULL_HANDLE;   // Arena buffer (same for every allocation)
+    VkDeviceSize offset = 0;            // Offset in the buffer, use it as descriptor (dynamic) offset
+    void * data = nullptr;              // Host pointer to write the data to
+};
+
+// Per-frame upload arena.
+// One host visible buffer, mapped once at creation and split into one slice per frame in flight (a ring
+// of slices). Every frame the slice of the frame is reset and carved linearly into aligned allocations,
+// which are only written by the host and read by the GPU during that frame. Once everything is written,
+// flush() makes the frame's writes visible in a single call when the memory isn't HOST_COHERENT.
+class FrameArena
+{
+public:
+    FrameArena();
+    ~FrameArena();
+
+    void init(VkDevice newDevice, MemoryAllocator * newAllocator, VkBufferUsageFlags usage, int newFrameCount,
+              VkDeviceSize newFrameSize = DEFAULT_FRAME_ARENA_SIZE);
+    void destroy();
+
+    // Starts writing in the slice of the given frame, the GPU must be done with that frame (its timeline value waited)
+    void beginFrame(int frameIndex);
+    FrameAllocation allocate(VkDeviceSize size, VkDeviceSize alignment);
+    void flush();
+
+    VkBuffer getBuffer();
+    VkDeviceSize getFrameSize();
+    VkDeviceSize getFrameUsed();
+
+private:
+    VkDevice device;
+    MemoryAllocator * allocator;
+
+    VkBuffer buffer;
+    MemoryAllocation bufferMemory;
+    char * mappedData;              // Persistently mapped pointer to the whole buffer
+
+    int frameCount;
+    VkDeviceSize frameSize;         // Size of one slice
+    VkDeviceSize frameStart = 0;    // Start of the current slice in the buffer
+    VkDeviceSize frameHead = 0;     // Next free byte, relative to the buffer
+    VkDeviceSize flushedHead = 0;   // Everything before this has already been flushed this frame
+};
@@ -0,0 +1,208 @@
+#include "FrustumCuller.hpp"
+
+// Project includes
+#include "Utilities.hpp"
+
+// C++ includes
+#include <algorithm>
+#include <cfloat>
+#include <cstring>
+
+// SIMD width is picked at compile time, there is no runtime dispatch : AVX only when the compiler targets it
+// (-mavx, /arch:AVX, make bench AVX=1), the default builds use SSE (any x86-64)
+#if defined(__AVX__)
+    #include <immintrin.h>
+    #define FRUSTUM_CULLER_AVX
+#elif defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+    #include <xmmintrin.h>
+    #define FRUSTUM_CULLER_SSE
+#endif
+
+// Bounds arrays are aligned for (and padded to) a full AVX register
+static const size_t BOUNDS_BLOCK = 8;
+
+FrustumCuller::FrustumCuller()
+{
+}
+
+FrustumCuller::~FrustumCuller()
+{
+    destroy();
+}
+
+void FrustumCuller::destroy()
+{
+    if (capacity == 0) return;
+
+    alignedFree(centerX);
+    alignedFree(centerY);
+    alignedFree(centerZ);
+    alignedFree(radius);
+    centerX = centerY = centerZ = radius = nullptr;
+    count = 0;
+    capacity = 0;
+}
+
+void FrustumCuller::resize(size_t newCount)
+{
+    if (newCount > capacity)
+        reserve(std::max(newCount, capacity * 2));
+
+    // Spheres with a -FLT_MAX radius fail every plane test
+    for (size_t i = count; i < newCount; ++i)
+    {
+        centerX[i] = centerY[i] = centerZ[i] = 0.0f;
+        radius[i] = -FLT_MAX;
+    }
+    count = newCount;
+}
+
+size_t FrustumCuller::size()
+{
+    return count;
+}
+
+void FrustumCuller::setBounds(size_t index, glm::vec3 center, float newRadius)
+{
+    centerX[index] = center.x;
+    centerY[index] = center.y;
+    centerZ[index] = center.z;
+    radius[index] = newRadius;
+}
+
+void FrustumCuller::setFrustum(const glm::mat4 & viewProjection)
+{
+    // Planes are sums of the matrix rows (Gribb / Hartmann), glm matrices are column major : row k = m[0..3][k]
+    glm::vec4 rows[4];
+    for (int k = 0; k < 4; ++k)
+    {
+        rows[k] = glm::vec4(viewProjection[0][k], viewProjection[1][k], viewProjection[2][k], viewProjection[3][k]);
+    }
+
+    planes[0] = rows[3] + rows[0];  // Left   : -w <= x
+    planes[1] = rows[3] - rows[0];  // Right  : x <= w
+    planes[2] = rows[3] + rows[1];  // Bottom : -w <= y
+    planes[3] = rows[3] - rows[1];  // Top    : y <= w
+    planes[4] = rows[2];            // Near   : 0 <= z (Vulkan depth range)
+    planes[5] = rows[3] - rows[2];  // Far    : z <= w
+
+    // Normalized, so plane distances compare with sphere radii
+    for (auto & plane : planes)
+    {
+        plane /= glm::length(glm::vec3(plane));
+    }
+}
+
+size_t FrustumCuller::cull(uint8_t * visible)
+{
+    size_t visibleCount = 0;
+    size_t i = 0;
+
+    // Writes the visibility of the objects of a block from its lane mask (the last block may be partial)
+    auto storeMask = [&](int mask, size_t lanes) {
+        size_t blockEnd = std::min(count, i + lanes);
+        for (size_t object = i; object < blockEnd; ++object)
+        {
+            uint8_t objectVisible = static_cast<uint8_t>((mask >> (object - i)) & 1);
+            visible[object] = objectVisible;
+            visibleCount += objectVisible;
+        }
+    };
+
+#if defined(FRUSTUM_CULLER_AVX)
+    // 8 spheres per iteration : distance to each plane for the whole block, and-ed into one inside mask
+    __m256 planeX[6], planeY[6], planeZ[6], planeW[6];
+    for (int p = 0; p < 6; ++p)
+    {
+        planeX[p] = _mm256_set1_ps(planes[p].x);
+        planeY[p] = _mm256_set1_ps(planes[p].y);
+        planeZ[p] = _mm256_set1_ps(planes[p].z);
+        planeW[p] = _mm256_set1_ps(planes[p].w);
+    }
+    const __m256 zero = _mm256_setzero_ps();
+
+    for (; i < count; i += 8)
+    {
+        __m256 x = _mm256_load_ps(centerX + i);
+        __m256 y = _mm256_load_ps(centerY + i);
+        __m256 z = _mm256_load_ps(centerZ + i);
+        __m256 negativeRadius = _mm256_sub_ps(zero, _mm256_load_ps(radius + i));
+
+        __m256 inside = _mm256_cmp_ps(zero, zero, _CMP_EQ_OQ);     // All lanes set
+        for (int p = 0; p < 6; ++p)
+        {
+            __m256 distance = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(planeX[p], x), _mm256_mul_ps(planeY[p], y)),
+                                            _mm256_add_ps(_mm256_mul_ps(planeZ[p], z), planeW[p]));
+            inside = _mm256_and_ps(inside, _mm256_cmp_ps(distance, negativeRadius, _CMP_GE_OQ));
+        }
+        storeMask(_mm256_movemask_ps(inside), 8);
+    }
+#elif defined(FRUSTUM_CULLER_SSE)
+    // 4 spheres per iteration, same as above
+    __m128 planeX[6], planeY[6], planeZ[6], planeW[6];
+    for (int p = 0; p < 6; ++p)
+    {
+        planeX[p] = _mm_set1_ps(planes[p].x);
+        planeY[p] = _mm_set1_ps(planes[p].y);
+        planeZ[p] = _mm_set1_ps(planes[p].z);
+        planeW[p] = _mm_set1_ps(planes[p].w);
+    }
+    const __m128 zero = _mm_setzero_ps();
+
+    for (; i < count; i += 4)
+    {
+        __m128 x = _mm_load_ps(centerX + i);
+        __m128 y = _mm_load_ps(centerY + i);
+        __m128 z = _mm_load_ps(centerZ + i);
+        __m128 negativeRadius = _mm_sub_ps(zero, _mm_load_ps(radius + i));
+
+        __m128 inside = _mm_cmpeq_ps(zero, zero);     // All lanes set
+        for (int p = 0; p < 6; ++p)
+        {
+            __m128 distance = _mm_add_ps(_mm_add_ps(_mm_mul_ps(planeX[p], x), _mm_mul_ps(planeY[p], y)),
+                                         _mm_add_ps(_mm_mul_ps(planeZ[p], z), planeW[p]));
+            inside = _mm_and_ps(inside, _mm_cmpge_ps(distance, negativeRadius));
+        }
+        storeMask(_mm_movemask_ps(inside), 4);
+    }
+#else
+    // No SIMD : one sphere at a time
+    for (; i < count; ++i)
+    {
+        int inside = 1;
+        for (int p = 0; p < 6 && inside; ++p)
+        {
+            float distance = planes[p].x * centerX[i] + planes[p].y * centerY[i] + planes[p].z * centerZ[i] + planes[p].w;
+            inside = distance >= -radius[i];
+        }
+        storeMask(inside, 1);
+    }
+#endif
+
+    return visibleCount;
+}
+
+void FrustumCuller::reserve(size_t newCapacity)
+{
+    // Whole blocks only : SIMD loads of the last block stay in the arrays
+    newCapacity = (newCapacity + BOUNDS_BLOCK - 1) / BOUNDS_BLOCK * BOUNDS_BLOCK;
+    size_t arraySize = sizeof(float) * newCapacity;
+
+    float * newArrays[4];
+    float * oldArrays[4] = { centerX, centerY, centerZ, radius };
+    for (int a = 0; a < 4; ++a)
+    {
+        newArrays[a] = static_cast<float *>(alignedAlloc(arraySize, sizeof(float) * BOUNDS_BLOCK));
+        memset(newArrays[a], 0, arraySize);
+        if (count > 0)
+            memcpy(newArrays[a], oldArrays[a], sizeof(float) * count);
+        if (capacity > 0)
+            alignedFree(oldArrays[a]);
+    }
+
+    centerX = newArrays[0];
+    centerY = newArrays[1];
+    centerZ = newArrays[2];
+    radius = newArrays[3];
+    capacity = newCapacity;
+}
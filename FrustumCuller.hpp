@@ -0,0 +1,48 @@
+#pragma once
+
+// GLM includes
+#include <glm/glm.hpp>
+
+// C++ includes
+#include <cstdint>
+#include <cstddef>
+
+// Frustum culling of bounding spheres.
+// Bounds are stored as a structure of arrays (x, y, z, radius each in its own aligned array) so the sphere/plane
+// tests run on 4 (SSE) objects per iteration, 8 (AVX) in builds targeting AVX, with a scalar fallback on other CPUs.
+class FrustumCuller
+{
+public:
+    FrustumCuller();
+    ~FrustumCuller();
+
+    void destroy();
+
+    // Number of bounding spheres, new ones are invisible until set
+    void resize(size_t newCount);
+    size_t size();
+
+    // World space bounding sphere of an object
+    void setBounds(size_t index, glm::vec3 center, float radius);
+
+    // Extracts the 6 planes from a view projection matrix (Vulkan clip space : 0 <= z <= w)
+    void setFrustum(const glm::mat4 & viewProjection);
+
+    // visible[i] = 1 if sphere i intersects the frustum, 0 otherwise. Returns the visible count.
+    size_t cull(uint8_t * visible);
+
+private:
+    // Planes as (normal, distance) : a point p is inside when dot(normal, p) + distance >= 0
+    glm::vec4 planes[6];
+
+    // Bounds table, capacity is a multiple of 8 so SIMD loops read whole blocks. Padding past count is zeroed and
+    // may test as visible : cull() only stores the results of the first count lanes.
+    float * centerX = nullptr;
+    float * centerY = nullptr;
+    float * centerZ = nullptr;
+    float * radius = nullptr;
+    size_t count = 0;
+    size_t capacity = 0;
+
+    void reserve(size_t newCapacity);
+};
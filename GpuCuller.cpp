@@ -0,0 +1,469 @@
+#include "GpuCuller.hpp"
+
+// C++ includes
+#include <array>
+#include <algorithm>
+#include <cstring>
+
+GpuCuller::GpuCuller()
+{
+}
+
+GpuCuller::~GpuCuller()
+{
+}
+
+void GpuCuller::init(VkDevice newDevice, MemoryAllocator * newAllocator, StagingUploader * newUploader, uint32_t newImageCount,
+                     VkDeviceSize newStorageAlignment, bool newCompactDraws, VkPipelineCache pipelineCache)
+{
+    device = newDevice;
+    allocator = newAllocator;
+    uploader = newUploader;
+    imageCount = newImageCount;
+    storageAlignment = newStorageAlignment;
+    compactDraws = newCompactDraws;
+
+    createDescriptorSetLayout();
+    createPipeline(pipelineCache);
+    createDescriptorSets();
+}
+
+void GpuCuller::destroy()
+{
+    destroyBuffers();
+
+    vkDestroyDescriptorPool(device, descriptorPool, nullptr);
+    vkDestroyPipeline(device, pipeline, nullptr);
+    vkDestroyPipelineLayout(device, pipelineLayout, nullptr);
+    vkDestroyDescriptorSetLayout(device, descriptorSetLayout, nullptr);
+}
+
+void GpuCuller::retire(DeletionQueue * deletionQueue, uint64_t retireValue)
+{
+    retireBufferObjects(deletionQueue, retireValue);
+
+    // Handles are captured by value : init() replaces them right after
+    VkDevice retiredDevice = device;
+    VkDescriptorPool retiredPool = descriptorPool;
+    VkPipelineLayout retiredPipelineLayout = pipelineLayout;
+    VkDescriptorSetLayout retiredSetLayout = descriptorSetLayout;
+    deletionQueue->push(retireValue, [retiredDevice, retiredPool]() {
+        vkDestroyDescriptorPool(retiredDevice, retiredPool, nullptr);
+    });
+    deletionQueue->deletePipeline(retireValue, pipeline);
+    deletionQueue->push(retireValue, [retiredDevice, retiredPipelineLayout, retiredSetLayout]() {
+        vkDestroyPipelineLayout(retiredDevice, retiredPipelineLayout, nullptr);
+        vkDestroyDescriptorSetLayout(retiredDevice, retiredSetLayout, nullptr);
+    });
+}
+
+void GpuCuller::createBuffers(size_t objectCapacity, VkBuffer newArenaBuffer, VkDeviceSize newVpRange, VkDeviceSize newObjectDataRange,
+                              VkBuffer drawCommandBuffer)
+{
+    capacity = objectCapacity;
+    arenaBuffer = newArenaBuffer;
+    vpRange = newVpRange;
+    objectDataRange = newObjectDataRange;
+
+    // Bounds and mesh infos only change when meshes are added : DEVICE_LOCAL, filled with transfers
+    createBuffer(device, allocator, sizeof(CullObject) * capacity, VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+                 VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &objectBuffer, &objectBufferMemory);
+    createBuffer(device, allocator, sizeof(CullMesh) * capacity, VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+                 VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &meshBuffer, &meshBufferMemory);
+
+    // Every region can hold one entry per object (there are never more meshes or chunks than objects),
+    // aligned so each region can be bound as its own storage buffer
+    instanceCountOffset = alignOffset(sizeof(uint32_t) * capacity);
+    drawCommandOffset = alignOffset(instanceCountOffset + sizeof(uint32_t) * capacity);
+    drawCountOffset = alignOffset(drawCommandOffset + sizeof(VkDrawIndexedIndirectCommand) * capacity);
+    imageBufferSize = drawCountOffset + sizeof(uint32_t) * capacity;
+
+    // Results are per swapchain image, like the command buffers the cull is recorded in
+    imageBuffers.resize(imageCount);
+    for (auto & image : imageBuffers)
+    {
+        createBuffer(device, allocator, imageBufferSize,
+                     VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT,
+                     VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &image.buffer, &image.bufferMemory);
+
+        createBuffer(device, allocator, sizeof(uint32_t), VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+                     VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+                     &image.statsBuffer, &image.statsBufferMemory);
+        image.stats = static_cast<uint32_t *>(allocator->map(image.statsBufferMemory));
+        *image.stats = 0;
+    }
+
+    writeDescriptorSets(drawCommandBuffer);
+
+    // Everything has to be uploaded (again)
+    uploadedObjects = 0;
+    uploadedMeshes = 0;
+}
+
+void GpuCuller::destroyBuffers()
+{
+    if (capacity == 0) return;
+
+    for (auto & image : imageBuffers)
+    {
+        vkDestroyBuffer(device, image.buffer, nullptr);
+        allocator->free(image.bufferMemory);
+        allocator->unmap(image.statsBufferMemory);
+        vkDestroyBuffer(device, image.statsBuffer, nullptr);
+        allocator->free(image.statsBufferMemory);
+    }
+    imageBuffers.clear();
+
+    vkDestroyBuffer(device, meshBuffer, nullptr);
+    allocator->free(meshBufferMemory);
+    vkDestroyBuffer(device, objectBuffer, nullptr);
+    allocator->free(objectBufferMemory);
+    capacity = 0;
+}
+
+void GpuCuller::retireBuffers(DeletionQueue * deletionQueue, uint64_t retireValue)
+{
+    retireBufferObjects(deletionQueue, retireValue);
+    retireDescriptorSets(deletionQueue, retireValue);
+}
+
+void GpuCuller::replaceMeshBuffer(DeletionQueue * deletionQueue, uint64_t retireValue, VkBuffer drawCommandBuffer)
+{
+    deletionQueue->deleteBuffer(retireValue, meshBuffer, meshBufferMemory);
+    retireDescriptorSets(deletionQueue, retireValue);
+
+    createBuffer(device, allocator, sizeof(CullMesh) * capacity, VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+                 VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &meshBuffer, &meshBufferMemory);
+    writeDescriptorSets(drawCommandBuffer);
+
+    // Every mesh info goes to the new buffer
+    uploadedMeshes = 0;
+}
+
+void GpuCuller::retireDescriptorSets(DeletionQueue * deletionQueue, uint64_t retireValue)
+{
+    // Sets in use can't be rewritten : the whole pool goes with the buffers, new sets come from a new pool
+    VkDevice retiredDevice = device;
+    VkDescriptorPool retiredPool = descriptorPool;
+    deletionQueue->push(retireValue, [retiredDevice, retiredPool]() {
+        vkDestroyDescriptorPool(retiredDevice, retiredPool, nullptr);
+    });
+    createDescriptorSets();
+}
+
+void GpuCuller::retireBufferObjects(DeletionQueue * deletionQueue, uint64_t retireValue)
+{
+    if (capacity == 0) return;
+
+    MemoryAllocator * retiredAllocator = allocator;
+    for (auto & image : imageBuffers)
+    {
+        deletionQueue->deleteBuffer(retireValue, image.buffer, image.bufferMemory);
+
+        // Stats buffer stays mapped until it's released
+        VkDevice retiredDevice = device;
+        VkBuffer statsBuffer = image.statsBuffer;
+        MemoryAllocation statsBufferMemory = image.statsBufferMemory;
+        deletionQueue->push(retireValue, [retiredDevice, retiredAllocator, statsBuffer, statsBufferMemory]() mutable {
+            retiredAllocator->unmap(statsBufferMemory);
+            vkDestroyBuffer(retiredDevice, statsBuffer, nullptr);
+            retiredAllocator->free(statsBufferMemory);
+        });
+    }
+    imageBuffers.clear();
+
+    deletionQueue->deleteBuffer(retireValue, meshBuffer, meshBufferMemory);
+    deletionQueue->deleteBuffer(retireValue, objectBuffer, objectBufferMemory);
+    capacity = 0;
+}
+
+void GpuCuller::addMesh(glm::vec3 boundsCenter, float boundsRadius, uint32_t firstObject, uint32_t instanceCount,
+                        uint32_t chunk, uint32_t chunkFirstDraw, uint32_t drawSlot)
+{
+    CullMesh mesh = {};
+    mesh.chunk = chunk;
+    mesh.chunkFirstDraw = chunkFirstDraw;
+    mesh.drawSlot = drawSlot;
+    meshes.push_back(mesh);
+
+    // Instances of the mesh share its bounds, their models move them
+    CullObject object = {};
+    object.sphere = glm::vec4(boundsCenter, boundsRadius);
+    object.mesh = static_cast<uint32_t>(meshes.size()) - 1;
+    objects.resize(firstObject);
+    objects.insert(objects.end(), instanceCount, object);
+}
+
+void GpuCuller::setMeshDraw(uint32_t mesh, uint32_t chunk, uint32_t chunkFirstDraw, uint32_t drawSlot)
+{
+    meshes[mesh].chunk = chunk;
+    meshes[mesh].chunkFirstDraw = chunkFirstDraw;
+    meshes[mesh].drawSlot = drawSlot;
+
+    // Uploaded again from the first changed mesh
+    uploadedMeshes = std::min<size_t>(uploadedMeshes, mesh);
+}
+
+void GpuCuller::upload()
+{
+    // Only what was added since the last upload, through the staging ring
+    if (uploadedObjects < objects.size())
+    {
+        uploader->uploadBuffer(&objects[uploadedObjects], sizeof(CullObject) * (objects.size() - uploadedObjects),
+                               objectBuffer, sizeof(CullObject) * uploadedObjects);
+        uploadedObjects = objects.size();
+    }
+    if (uploadedMeshes < meshes.size())
+    {
+        uploader->uploadBuffer(&meshes[uploadedMeshes], sizeof(CullMesh) * (meshes.size() - uploadedMeshes),
+                               meshBuffer, sizeof(CullMesh) * uploadedMeshes);
+        uploadedMeshes = meshes.size();
+    }
+}
+
+void GpuCuller::recordCull(VkCommandBuffer commandBuffer, uint32_t image, uint32_t vpUniformOffset, uint32_t modelDataOffset,
+                           uint32_t chunkCount)
+{
+    ImageBuffers & buffers = imageBuffers[image];
+
+    // Counters start from 0 every frame (the image's previous frame is done : its timeline value was waited before recording/submitting)
+    if (!meshes.empty())
+        vkCmdFillBuffer(commandBuffer, buffers.buffer, instanceCountOffset, sizeof(uint32_t) * meshes.size(), 0);
+    if (chunkCount > 0)
+        vkCmdFillBuffer(commandBuffer, buffers.buffer, drawCountOffset, sizeof(uint32_t) * chunkCount, 0);
+    vkCmdFillBuffer(commandBuffer, buffers.statsBuffer, 0, sizeof(uint32_t), 0);
+
+    VkMemoryBarrier clearBarrier = {};
+    clearBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    clearBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    clearBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0,
+        1, &clearBarrier, 0, nullptr, 0, nullptr);
+
+    vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipeline);
+    std::array<uint32_t, 2> dynamicOffsets = { vpUniformOffset, modelDataOffset };
+    vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipelineLayout, 0, 1, &descriptorSets[image],
+        static_cast<uint32_t>(dynamicOffsets.size()), dynamicOffsets.data());
+
+    CullPushConstants pushConstants = {};
+    pushConstants.objectCount = static_cast<uint32_t>(objects.size());
+    pushConstants.meshCount = static_cast<uint32_t>(meshes.size());
+    pushConstants.compactDraws = compactDraws ? 1 : 0;
+
+    // Pass 0 : one thread per object, visible ones get a slot in their mesh's range of visible objects
+    pushConstants.pass = 0;
+    vkCmdPushConstants(commandBuffer, pipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(CullPushConstants), &pushConstants);
+    vkCmdDispatch(commandBuffer, (pushConstants.objectCount + CULL_WORKGROUP_SIZE - 1) / CULL_WORKGROUP_SIZE, 1, 1);
+
+    // Pass 1 needs every instance count
+    VkMemoryBarrier cullBarrier = {};
+    cullBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    cullBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+    cullBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0,
+        1, &cullBarrier, 0, nullptr, 0, nullptr);
+
+    // Pass 1 : one thread per mesh, writes its draw command (if it has visible instances when compacting)
+    pushConstants.pass = 1;
+    vkCmdPushConstants(commandBuffer, pipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(CullPushConstants), &pushConstants);
+    vkCmdDispatch(commandBuffer, (pushConstants.meshCount + CULL_WORKGROUP_SIZE - 1) / CULL_WORKGROUP_SIZE, 1, 1);
+
+    // Results are read as draw parameters, by the vertex shaders, and by the host (visible count) once the frame is done
+    VkMemoryBarrier drawBarrier = {};
+    drawBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    drawBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+    drawBarrier.dstAccessMask = VK_ACCESS_INDIRECT_COMMAND_READ_BIT | VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_HOST_READ_BIT;
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+        VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_VERTEX_SHADER_BIT | VK_PIPELINE_STAGE_HOST_BIT, 0,
+        1, &drawBarrier, 0, nullptr, 0, nullptr);
+}
+
+VkBuffer GpuCuller::getBuffer(uint32_t image)
+{
+    return imageBuffers[image].buffer;
+}
+
+VkDeviceSize GpuCuller::getDrawCommandOffset()
+{
+    return drawCommandOffset;
+}
+
+VkDeviceSize GpuCuller::getDrawCountOffset()
+{
+    return drawCountOffset;
+}
+
+VkDescriptorBufferInfo GpuCuller::getVisibleObjectsInfo(uint32_t image)
+{
+    VkDescriptorBufferInfo bufferInfo = {};
+    bufferInfo.buffer = imageBuffers[image].buffer;
+    bufferInfo.offset = 0;
+    bufferInfo.range = sizeof(uint32_t) * capacity;
+    return bufferInfo;
+}
+
+uint32_t GpuCuller::getVisibleCount(uint32_t image)
+{
+    return *imageBuffers[image].stats;
+}
+
+void GpuCuller::createDescriptorSetLayout()
+{
+    // 0 : view projection (arena, dynamic)   1 : object data (arena, dynamic)
+    // 2 : object bounds   3 : mesh infos   4 : draw command of every mesh
+    // 5 : visible objects   6 : instance counts   7 : culled draw commands   8 : draw counts   9 : visible count
+    std::array<VkDescriptorSetLayoutBinding, 10> layoutBindings = {};
+    for (uint32_t i = 0; i < layoutBindings.size(); ++i)
+    {
+        layoutBindings[i].binding = i;
+        layoutBindings[i].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+        layoutBindings[i].descriptorCount = 1;
+        layoutBindings[i].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+        layoutBindings[i].pImmutableSamplers = nullptr;
+    }
+    layoutBindings[0].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
+    layoutBindings[1].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC;
+
+    VkDescriptorSetLayoutCreateInfo layoutCreateInfo = {};
+    layoutCreateInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+    layoutCreateInfo.bindingCount = static_cast<uint32_t>(layoutBindings.size());
+    layoutCreateInfo.pBindings = layoutBindings.data();
+
+    VkResult result = vkCreateDescriptorSetLayout(device, &layoutCreateInfo, nullptr, &descriptorSetLayout);
+    if (result != VK_SUCCESS)
+    {
+        throw std::runtime_error("Failed to create the cull descriptor set layout !");
+    }
+}
+
+void GpuCuller::createPipeline(VkPipelineCache pipelineCache)
+{
+    // Object and mesh counts, pass and compaction are push constants : they only change when the scene is re-recorded
+    VkPushConstantRange pushConstantRange = {};
+    pushConstantRange.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+    pushConstantRange.offset = 0;
+    pushConstantRange.size = sizeof(CullPushConstants);
+
+    VkPipelineLayoutCreateInfo pipelineLayoutCreateInfo = {};
+    pipelineLayoutCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+    pipelineLayoutCreateInfo.setLayoutCount = 1;
+    pipelineLayoutCreateInfo.pSetLayouts = &descriptorSetLayout;
+    pipelineLayoutCreateInfo.pushConstantRangeCount = 1;
+    pipelineLayoutCreateInfo.pPushConstantRanges = &pushConstantRange;
+
+    VkResult result = vkCreatePipelineLayout(device, &pipelineLayoutCreateInfo, nullptr, &pipelineLayout);
+    if (result != VK_SUCCESS)
+    {
+        throw std::runtime_error("Failed to create the cull pipeline layout !");
+    }
+
+    auto shaderCode = readFile("Shaders/cull_comp.spv");
+
+    VkShaderModuleCreateInfo shaderModuleCreateInfo = {};
+    shaderModuleCreateInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
+    shaderModuleCreateInfo.codeSize = shaderCode.size();
+    shaderModuleCreateInfo.pCode = reinterpret_cast<const uint32_t *>(shaderCode.data());
+
+    VkShaderModule shaderModule;
+    result = vkCreateShaderModule(device, &shaderModuleCreateInfo, nullptr, &shaderModule);
+    if (result != VK_SUCCESS)
+    {
+        throw std::runtime_error("Failed to create a shader module !");
+    }
+
+    VkComputePipelineCreateInfo pipelineCreateInfo = {};
+    pipelineCreateInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+    pipelineCreateInfo.stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+    pipelineCreateInfo.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+    pipelineCreateInfo.stage.module = shaderModule;
+    pipelineCreateInfo.stage.pName = "main";
+    pipelineCreateInfo.layout = pipelineLayout;
+
+    result = vkCreateComputePipelines(device, pipelineCache, 1, &pipelineCreateInfo, nullptr, &pipeline);
+
+    // Module is only needed to create the pipeline
+    vkDestroyShaderModule(device, shaderModule, nullptr);
+
+    if (result != VK_SUCCESS)
+    {
+        throw std::runtime_error("Failed to create the cull pipeline !");
+    }
+}
+
+void GpuCuller::createDescriptorSets()
+{
+    std::array<VkDescriptorPoolSize, 3> poolSizes = {};
+    poolSizes[0].type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
+    poolSizes[0].descriptorCount = imageCount;
+    poolSizes[1].type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC;
+    poolSizes[1].descriptorCount = imageCount;
+    poolSizes[2].type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    poolSizes[2].descriptorCount = 8 * imageCount;
+
+    VkDescriptorPoolCreateInfo poolCreateInfo = {};
+    poolCreateInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+    poolCreateInfo.maxSets = imageCount;
+    poolCreateInfo.poolSizeCount = static_cast<uint32_t>(poolSizes.size());
+    poolCreateInfo.pPoolSizes = poolSizes.data();
+
+    VkResult result = vkCreateDescriptorPool(device, &poolCreateInfo, nullptr, &descriptorPool);
+    if (result != VK_SUCCESS)
+    {
+        throw std::runtime_error("Failed to create the cull Descriptor Pool !");
+    }
+
+    descriptorSets.resize(imageCount);
+    std::vector<VkDescriptorSetLayout> setLayouts(imageCount, descriptorSetLayout);
+
+    VkDescriptorSetAllocateInfo setAllocInfo = {};
+    setAllocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+    setAllocInfo.descriptorPool = descriptorPool;
+    setAllocInfo.descriptorSetCount = imageCount;
+    setAllocInfo.pSetLayouts = setLayouts.data();
+
+    result = vkAllocateDescriptorSets(device, &setAllocInfo, descriptorSets.data());
+    if (result != VK_SUCCESS)
+    {
+        throw std::runtime_error("Failed to Allocate the cull Descriptor Sets !");
+    }
+}
+
+void GpuCuller::writeDescriptorSets(VkBuffer drawCommandBuffer)
+{
+    for (uint32_t i = 0; i < imageCount; ++i)
+    {
+        // Same binding order as the layout
+        std::array<VkDescriptorBufferInfo, 10> bufferInfos = {};
+        bufferInfos[0] = { arenaBuffer, 0, vpRange };
+        bufferInfos[1] = { arenaBuffer, 0, objectDataRange };
+        bufferInfos[2] = { objectBuffer, 0, sizeof(CullObject) * capacity };
+        bufferInfos[3] = { meshBuffer, 0, sizeof(CullMesh) * capacity };
+        bufferInfos[4] = { drawCommandBuffer, 0, sizeof(VkDrawIndexedIndirectCommand) * capacity };
+        bufferInfos[5] = getVisibleObjectsInfo(i);
+        bufferInfos[6] = { imageBuffers[i].buffer, instanceCountOffset, sizeof(uint32_t) * capacity };
+        bufferInfos[7] = { imageBuffers[i].buffer, drawCommandOffset, sizeof(VkDrawIndexedIndirectCommand) * capacity };
+        bufferInfos[8] = { imageBuffers[i].buffer, drawCountOffset, sizeof(uint32_t) * capacity };
+        bufferInfos[9] = { imageBuffers[i].statsBuffer, 0, sizeof(uint32_t) };
+
+        std::array<VkWriteDescriptorSet, 10> setWrites = {};
+        for (uint32_t binding = 0; binding < setWrites.size(); ++binding)
+        {
+            setWrites[binding].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+            setWrites[binding].dstSet = descriptorSets[i];
+            setWrites[binding].dstBinding = binding;
+            setWrites[binding].dstArrayElement = 0;
+            setWrites[binding].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+            setWrites[binding].descriptorCount = 1;
+            setWrites[binding].pBufferInfo = &bufferInfos[binding];
+        }
+        setWrites[0].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
+        setWrites[1].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC;
+
+        vkUpdateDescriptorSets(device, static_cast<uint32_t>(setWrites.size()), setWrites.data(), 0, nullptr);
+    }
+}
+
+VkDeviceSize GpuCuller::alignOffset(VkDeviceSize offset)
+{
+    return (offset + storageAlignment - 1) / storageAlignment * storageAlignment;
+}
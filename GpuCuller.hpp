@@ -0,0 +1,146 @@
+#pragma once
+
+// Project includes
+#include "Utilities.hpp"
+#include "StagingUploader.hpp"
+#include "DeletionQueue.hpp"
+
+// GLFW includes
+#define GLFW_INCLUDE_VULKAN
+#include <GLFW/glfw3.h>
+
+// C++ includes
+#include <vector>
+
+// Threads per workgroup of the cull compute shader (local_size_x in cull.comp)
+const uint32_t CULL_WORKGROUP_SIZE = 64;
+
+// Frustum culling in a compute pass.
+// Before the render pass, the cull shader tests the bounding sphere of every object (moved by its model, read from the
+// same object data as the vertex shader) against the frustum of the view projection, and writes for each swapchain image :
+// - the indices of the visible objects, packed per mesh (what the vertex shader reads its object data through)
+// - one indirect draw command per mesh with visible instances, compacted per pool chunk, with the draw count of each chunk
+// So the CPU never looks at per object visibility, it only records the dispatches once with the other commands.
+class GpuCuller
+{
+public:
+    GpuCuller();
+    ~GpuCuller();
+
+    // compactDraws : empty draws are removed and counted (for vkCmdDrawIndexedIndirectCount),
+    // otherwise every mesh keeps its draw command, with instanceCount = 0 when nothing is visible
+    void init(VkDevice newDevice, MemoryAllocator * newAllocator, StagingUploader * newUploader, uint32_t newImageCount,
+              VkDeviceSize newStorageAlignment, bool newCompactDraws, VkPipelineCache pipelineCache = VK_NULL_HANDLE);
+    void destroy();
+    // Same as destroy(), but everything is queued in the deletion queue instead : frames in flight may still run the cull.
+    // init() can be called again right after
+    void retire(DeletionQueue * deletionQueue, uint64_t retireValue);
+
+    // (Re)creates the buffers for objectCapacity objects (and meshes), after destroyBuffers() (the GPU must be done with
+    // the old ones) or retireBuffers().
+    // arenaBuffer holds the view projection and object data (ranges read from their dynamic offsets),
+    // drawCommandBuffer the draw command of every mesh.
+    void createBuffers(size_t objectCapacity, VkBuffer arenaBuffer, VkDeviceSize vpRange, VkDeviceSize objectDataRange,
+                       VkBuffer drawCommandBuffer);
+    void destroyBuffers();
+    // Queues the buffers and the descriptor sets pointing at them in the deletion queue, and allocates new descriptor sets :
+    // createBuffers() can follow right away while frames in flight still run the cull
+    void retireBuffers(DeletionQueue * deletionQueue, uint64_t retireValue);
+
+    // Bounds of a new mesh (model space sphere) and its place in the draw commands, sent with the next upload() :
+    // draw commands are grouped per pool chunk, drawSlot is the mesh's command, chunkFirstDraw the start of its chunk's range
+    void addMesh(glm::vec3 boundsCenter, float boundsRadius, uint32_t firstObject, uint32_t instanceCount,
+                 uint32_t chunk, uint32_t chunkFirstDraw, uint32_t drawSlot);
+    // The draw commands were laid out again : new place of a mesh's command, sent with the next upload().
+    // The mesh infos already uploaded are rewritten : replaceMeshBuffer() first if frames in flight may still read them
+    void setMeshDraw(uint32_t mesh, uint32_t chunk, uint32_t chunkFirstDraw, uint32_t drawSlot);
+    // Queues the mesh infos and the descriptor sets in the deletion queue, and binds a new mesh buffer (filled by the next
+    // upload()) and drawCommandBuffer to new descriptor sets : frames in flight keep culling with the old draw layout
+    void replaceMeshBuffer(DeletionQueue * deletionQueue, uint64_t retireValue, VkBuffer drawCommandBuffer);
+    void upload();
+
+    // Clears the counters and culls every object, the results are ready for the draws and vertex shaders after it
+    void recordCull(VkCommandBuffer commandBuffer, uint32_t image, uint32_t vpUniformOffset, uint32_t modelDataOffset,
+                    uint32_t chunkCount);
+
+    // Draw commands and per chunk draw counts of an image, in getBuffer(image)
+    VkBuffer getBuffer(uint32_t image);
+    VkDeviceSize getDrawCommandOffset();
+    VkDeviceSize getDrawCountOffset();
+    // Visible object indices of an image, bound to the vertex shader
+    VkDescriptorBufferInfo getVisibleObjectsInfo(uint32_t image);
+
+    // Objects found visible by the last cull of an image (its frame must be done)
+    uint32_t getVisibleCount(uint32_t image);
+
+private:
+    // Matches cull.comp
+    struct CullObject {
+        glm::vec4 sphere;       // Model space bounding sphere of the object's mesh (center, radius)
+        uint32_t mesh;
+        uint32_t padding[3];
+    };
+    struct CullMesh {
+        uint32_t chunk;             // Draw count slot
+        uint32_t chunkFirstDraw;    // Where the chunk's compacted commands start
+        uint32_t drawSlot;          // Mesh's command in the draw commands (and in the uncompacted results)
+    };
+    struct CullPushConstants {
+        uint32_t objectCount;
+        uint32_t meshCount;
+        uint32_t pass;          // 0 = test objects, 1 = write the draw commands
+        uint32_t compactDraws;
+    };
+
+    // Per swapchain image results
+    struct ImageBuffers {
+        VkBuffer buffer;                // Visible objects | instance counts | draw commands | draw counts
+        MemoryAllocation bufferMemory;
+        VkBuffer statsBuffer;           // Visible object count, read by the host
+        MemoryAllocation statsBufferMemory;
+        uint32_t * stats;
+    };
+
+    VkDevice device;
+    MemoryAllocator * allocator;
+    StagingUploader * uploader;
+    uint32_t imageCount;
+    VkDeviceSize storageAlignment;
+    bool compactDraws;
+
+    std::vector<CullObject> objects;
+    std::vector<CullMesh> meshes;
+    size_t uploadedObjects = 0;
+    size_t uploadedMeshes = 0;
+
+    // Static data (uploaded once) and results
+    size_t capacity = 0;
+    VkBuffer arenaBuffer;
+    VkDeviceSize vpRange;
+    VkDeviceSize objectDataRange;
+    VkBuffer objectBuffer;
+    MemoryAllocation objectBufferMemory;
+    VkBuffer meshBuffer;
+    MemoryAllocation meshBufferMemory;
+    std::vector<ImageBuffers> imageBuffers;
+    VkDeviceSize instanceCountOffset;
+    VkDeviceSize drawCommandOffset;
+    VkDeviceSize drawCountOffset;
+    VkDeviceSize imageBufferSize;
+
+    // Compute pipeline
+    VkDescriptorSetLayout descriptorSetLayout;
+    VkDescriptorPool descriptorPool;
+    std::vector<VkDescriptorSet> descriptorSets;
+    VkPipelineLayout pipelineLayout;
+    VkPipeline pipeline;
+
+    void createDescriptorSetLayout();
+    void createPipeline(VkPipelineCache pipelineCache);
+    void createDescriptorSets();
+    void retireBufferObjects(DeletionQueue * deletionQueue, uint64_t retireValue);
+    void retireDescriptorSets(DeletionQueue * deletionQueue, uint64_t retireValue);
+    void writeDescriptorSets(VkBuffer drawCommandBuffer);
+
+    VkDeviceSize alignOffset(VkDeviceSize offset);
+};
@@ -0,0 +1,108 @@
+#include "JobSystem.hpp"
+
+// C++ includes
+#include <algorithm>
+
+JobSystem::JobSystem()
+{
+}
+
+JobSystem::~JobSystem()
+{
+    // Threads must be joined before they're destroyed, even if the owner never got to destroy()
+    destroy();
+}
+
+void JobSystem::init(uint32_t threadCount)
+{
+    if (threadCount == 0)
+        threadCount = std::max(1u, std::thread::hardware_concurrency());
+
+    // The calling thread takes jobs too
+    stopping = false;
+    for (uint32_t i = 1; i < threadCount; ++i)
+    {
+        workers.emplace_back(&JobSystem::workerLoop, this);
+    }
+}
+
+void JobSystem::destroy()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    jobAvailable.notify_all();
+
+    for (auto & worker : workers)
+    {
+        worker.join();
+    }
+    workers.clear();
+}
+
+void JobSystem::dispatch(uint32_t newJobCount, const std::function<void(uint32_t)> & job)
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    currentJob = &job;
+    jobCount = newJobCount;
+    nextJob = 0;
+    jobException = nullptr;
+    jobAvailable.notify_all();
+
+    runJobs(lock);
+
+    // Workers may still be running the last jobs
+    jobsDone.wait(lock, [this] { return runningJobs == 0; });
+    currentJob = nullptr;
+    jobCount = 0;
+
+    if (jobException)
+    {
+        std::exception_ptr exception = jobException;
+        jobException = nullptr;
+        std::rethrow_exception(exception);
+    }
+}
+
+uint32_t JobSystem::getThreadCount()
+{
+    return static_cast<uint32_t>(workers.size()) + 1;
+}
+
+void JobSystem::workerLoop()
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    while (true)
+    {
+        jobAvailable.wait(lock, [this] { return stopping || nextJob < jobCount; });
+        if (stopping) return;
+
+        runJobs(lock);
+    }
+}
+
+void JobSystem::runJobs(std::unique_lock<std::mutex> & lock)
+{
+    while (nextJob < jobCount)
+    {
+        uint32_t jobIndex = nextJob++;
+        ++runningJobs;
+        const std::function<void(uint32_t)> & job = *currentJob;
+
+        lock.unlock();
+        std::exception_ptr exception;
+        try {
+            job(jobIndex);
+        } catch (...) {
+            exception = std::current_exception();
+        }
+        lock.lock();
+
+        if (exception && !jobException)
+            jobException = exception;
+
+        if (--runningJobs == 0 && nextJob >= jobCount)
+            jobsDone.notify_all();
+    }
+}
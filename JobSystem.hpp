@@ -0,0 +1,48 @@
+#pragma once
+
+// C++ includes
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <exception>
+#include <cstdint>
+
+// Small worker pool.
+// dispatch() splits work into numbered jobs and runs them on the worker threads and the calling thread,
+// then returns once every job is done. A job index is only ever run by one thread, so per-job resources
+// (command pools...) need no locking.
+class JobSystem
+{
+public:
+    JobSystem();
+    ~JobSystem();
+
+    // threadCount counts the calling thread, 0 = one per hardware thread
+    void init(uint32_t threadCount = 0);
+    void destroy();
+
+    // Runs job(0) ... job(jobCount - 1), rethrows the first exception thrown by a job
+    void dispatch(uint32_t jobCount, const std::function<void(uint32_t)> & job);
+
+    uint32_t getThreadCount();
+
+private:
+    std::vector<std::thread> workers;
+
+    std::mutex mutex;
+    std::condition_variable jobAvailable;   // Workers wait for a dispatch (or destroy)
+    std::condition_variable jobsDone;       // dispatch() waits for the last job
+
+    const std::function<void(uint32_t)> * currentJob = nullptr;
+    uint32_t jobCount = 0;
+    uint32_t nextJob = 0;                   // Next job index to hand out
+    uint32_t runningJobs = 0;               // Jobs handed out and not finished yet
+    std::exception_ptr jobException;
+    bool stopping = false;
+
+    void workerLoop();
+    // Runs jobs of the current dispatch until none is left, mutex must be locked
+    void runJobs(std::unique_lock<std::mutex> & lock);
+};
@@ -0,0 +1,363 @@
+#include "MemoryAllocator.hpp"
+
+// C++ includes
+#include <stdexcept>
+#include <algorithm>
+
+MemoryAllocator::MemoryAllocator()
+{
+}
+
+MemoryAllocator::~MemoryAllocator()
+{
+}
+
+void MemoryAllocator::init(VkPhysicalDevice newPhysicalDevice, VkDevice newDevice, VkDeviceSize newBlockSize)
+{
+    physicalDevice = newPhysicalDevice;
+    device = newDevice;
+    blockSize = newBlockSize;
+
+    // Memory types never change for a device, so query them only once
+    vkGetPhysicalDeviceMemoryProperties(physicalDevice, &memoryProperties);
+    pools.resize(memoryProperties.memoryTypeCount);
+
+    VkPhysicalDeviceProperties deviceProperties;
+    vkGetPhysicalDeviceProperties(physicalDevice, &deviceProperties);
+    nonCoherentAtomSize = std::max<VkDeviceSize>(deviceProperties.limits.nonCoherentAtomSize, 1);
+}
+
+void MemoryAllocator::destroy()
+{
+    for (auto & pool : pools)
+    {
+        for (auto & block : pool.blocks)
+        {
+            destroyBlock(block);
+        }
+    }
+    pools.clear();
+}
+
+MemoryAllocation MemoryAllocator::allocate(const VkMemoryRequirements & requirements, VkMemoryPropertyFlags properties, bool linear)
+{
+    uint32_t memoryTypeIndex = findMemoryType(requirements.memoryTypeBits, properties);
+    MemoryPool & pool = pools[memoryTypeIndex];
+
+    // Small heaps (e.g. 256MB device local + host visible) get smaller blocks so one block can't eat the heap
+    VkDeviceSize heapSize = memoryProperties.memoryHeaps[memoryProperties.memoryTypes[memoryTypeIndex].heapIndex].size;
+    VkDeviceSize poolBlockSize = std::min(blockSize, heapSize / 8);
+
+    MemoryAllocation allocation = {};
+    allocation.memoryTypeIndex = memoryTypeIndex;
+
+    // Big resources would waste most of a shared block, give them their own
+    if (requirements.size > poolBlockSize / 2)
+    {
+        allocation.blockIndex = createBlock(memoryTypeIndex, requirements.size, linear, true);
+        allocateFromBlock(pool.blocks[allocation.blockIndex], requirements, &allocation);
+        return allocation;
+    }
+
+    // Try to fit in an existing block of the same kind
+    for (uint32_t i = 0; i < pool.blocks.size(); ++i)
+    {
+        MemoryBlock & block = pool.blocks[i];
+        if (block.memory == VK_NULL_HANDLE || block.dedicated || block.linear != linear)
+            continue;
+
+        if (allocateFromBlock(block, requirements, &allocation))
+        {
+            allocation.blockIndex = i;
+            return allocation;
+        }
+    }
+
+    // Every block is full, reserve a new one
+    allocation.blockIndex = createBlock(memoryTypeIndex, poolBlockSize, linear, false);
+    allocateFromBlock(pool.blocks[allocation.blockIndex], requirements, &allocation);
+    return allocation;
+}
+
+void MemoryAllocator::free(MemoryAllocation & allocation)
+{
+    if (allocation.memory == VK_NULL_HANDLE)
+        return;
+
+    MemoryPool & pool = pools[allocation.memoryTypeIndex];
+    MemoryBlock & block = pool.blocks[allocation.blockIndex];
+
+    // Give the range back to the block, keeping the free list sorted
+    auto next = std::lower_bound(block.freeRanges.begin(), block.freeRanges.end(), allocation.offset,
+        [](const FreeRange & range, VkDeviceSize offset) { return range.offset < offset; });
+    next = block.freeRanges.insert(next, { allocation.offset, allocation.size });
+
+    // Merge with the following hole if they touch
+    auto following = next + 1;
+    if (following != block.freeRanges.end() && next->offset + next->size == following->offset)
+    {
+        next->size += following->size;
+        block.freeRanges.erase(following);
+    }
+
+    // Merge with the previous hole if they touch
+    if (next != block.freeRanges.begin())
+    {
+        auto previous = next - 1;
+        if (previous->offset + previous->size == next->offset)
+        {
+            previous->size += next->size;
+            block.freeRanges.erase(next);
+        }
+    }
+
+    block.usedSize -= allocation.size;
+    --block.allocationCount;
+
+    // Release empty blocks, but keep one spare regular block per pool to avoid allocation churn
+    if (block.allocationCount == 0)
+    {
+        bool hasSpareBlock = false;
+        for (uint32_t i = 0; i < pool.blocks.size(); ++i)
+        {
+            const MemoryBlock & other = pool.blocks[i];
+            if (i != allocation.blockIndex && other.memory != VK_NULL_HANDLE && !other.dedicated
+             && other.linear == block.linear && other.allocationCount == 0)
+            {
+                hasSpareBlock = true;
+                break;
+            }
+        }
+
+        if (block.dedicated || hasSpareBlock)
+        {
+            destroyBlock(block);
+        }
+    }
+
+    allocation = {};
+}
+
+void * MemoryAllocator::map(const MemoryAllocation & allocation)
+{
+    MemoryBlock & block = pools[allocation.memoryTypeIndex].blocks[allocation.blockIndex];
+
+    // Map the whole block on first use
+    if (block.mapCount == 0)
+    {
+        VkResult result = vkMapMemory(device, block.memory, 0, VK_WHOLE_SIZE, 0, &block.mapped);
+        if (result != VK_SUCCESS)
+        {
+            throw std::runtime_error("Failed to map a memory block !");
+        }
+    }
+    ++block.mapCount;
+
+    return static_cast<char *>(block.mapped) + allocation.offset;
+}
+
+void MemoryAllocator::unmap(const MemoryAllocation & allocation)
+{
+    MemoryBlock & block = pools[allocation.memoryTypeIndex].blocks[allocation.blockIndex];
+
+    if (block.mapCount == 0)
+        return;
+
+    // Unmap once the last user is done with the block
+    if (--block.mapCount == 0)
+    {
+        vkUnmapMemory(device, block.memory);
+        block.mapped = nullptr;
+    }
+}
+
+void MemoryAllocator::flush(const std::vector<MemoryRange> & ranges)
+{
+    std::vector<VkMappedMemoryRange> mappedRanges;
+    mappedRanges.reserve(ranges.size());
+
+    for (const auto & range : ranges)
+    {
+        if (range.size == 0 || isHostCoherent(range.allocation))
+            continue;
+
+        const MemoryBlock & block = pools[range.allocation.memoryTypeIndex].blocks[range.allocation.blockIndex];
+
+        // Flushed ranges are in block memory offsets and must start/end on nonCoherentAtomSize (or the end of the block)
+        VkDeviceSize start = range.allocation.offset + range.offset;
+        VkDeviceSize end = start + range.size;
+        start = start & ~(nonCoherentAtomSize - 1);
+        end = (end + nonCoherentAtomSize - 1) & ~(nonCoherentAtomSize - 1);
+
+        VkMappedMemoryRange mappedRange = {};
+        mappedRange.sType = VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE;
+        mappedRange.memory = block.memory;
+        mappedRange.offset = start;
+        mappedRange.size = end >= block.size ? VK_WHOLE_SIZE : end - start;
+        mappedRanges.push_back(mappedRange);
+    }
+
+    if (mappedRanges.empty())
+        return;
+
+    VkResult result = vkFlushMappedMemoryRanges(device, static_cast<uint32_t>(mappedRanges.size()), mappedRanges.data());
+    if (result != VK_SUCCESS)
+    {
+        throw std::runtime_error("Failed to flush mapped memory ranges !");
+    }
+}
+
+bool MemoryAllocator::isHostCoherent(const MemoryAllocation & allocation)
+{
+    return (memoryProperties.memoryTypes[allocation.memoryTypeIndex].propertyFlags & VK_MEMORY_PROPERTY_HOST_COHERENT_BIT) != 0;
+}
+
+MemoryAllocatorStats MemoryAllocator::getStats()
+{
+    MemoryAllocatorStats stats = {};
+
+    for (const auto & pool : pools)
+    {
+        for (const auto & block : pool.blocks)
+        {
+            if (block.memory == VK_NULL_HANDLE)
+                continue;
+
+            ++stats.blockCount;
+            stats.allocationCount += block.allocationCount;
+            stats.bytesAllocated += block.size;
+            stats.bytesInUse += block.usedSize;
+
+            for (const auto & range : block.freeRanges)
+            {
+                stats.bytesFree += range.size;
+                stats.largestFreeRange = std::max(stats.largestFreeRange, range.size);
+                ++stats.freeRangeCount;
+            }
+        }
+    }
+
+    if (stats.bytesFree > 0)
+    {
+        stats.fragmentation = 1.0f - static_cast<float>(stats.largestFreeRange) / static_cast<float>(stats.bytesFree);
+    }
+
+    return stats;
+}
+
+VkDevice MemoryAllocator::getDevice()
+{
+    return device;
+}
+
+uint32_t MemoryAllocator::findMemoryType(uint32_t allowedTypes, VkMemoryPropertyFlags properties)
+{
+    for (uint32_t i = 0; i < memoryProperties.memoryTypeCount; ++i)
+    {
+        // Index of memory type must match corresponding bit in allowedTypes
+        // && desired properties bit flags are part of memory type's property flags
+        if ((allowedTypes & (1 << i)) && (memoryProperties.memoryTypes[i].propertyFlags & properties) == properties)
+        {
+            return i;
+        }
+    }
+
+    throw std::runtime_error("Failed to find a suitable memory type !");
+}
+
+uint32_t MemoryAllocator::createBlock(uint32_t memoryTypeIndex, VkDeviceSize size, bool linear, bool dedicated)
+{
+    MemoryPool & pool = pools[memoryTypeIndex];
+
+    // Reuse a released slot so block indices held by allocations stay valid
+    uint32_t blockIndex = 0;
+    while (blockIndex < pool.blocks.size() && pool.blocks[blockIndex].memory != VK_NULL_HANDLE)
+        ++blockIndex;
+
+    if (blockIndex == pool.blocks.size())
+        pool.blocks.push_back({});
+
+    VkMemoryAllocateInfo memoryAllocateInfo = {};
+    memoryAllocateInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+    memoryAllocateInfo.allocationSize = size;
+    memoryAllocateInfo.memoryTypeIndex = memoryTypeIndex;
+
+    MemoryBlock & block = pool.blocks[blockIndex];
+    VkResult result = vkAllocateMemory(device, &memoryAllocateInfo, nullptr, &block.memory);
+    if (result != VK_SUCCESS)
+    {
+        block.memory = VK_NULL_HANDLE;
+        throw std::runtime_error("Failed to allocate a memory block !");
+    }
+
+    block.size = size;
+    block.usedSize = 0;
+    block.allocationCount = 0;
+    block.linear = linear;
+    block.dedicated = dedicated;
+    block.freeRanges = { { 0, size } };     // Whole block is one free hole
+    block.mapped = nullptr;
+    block.mapCount = 0;
+
+    return blockIndex;
+}
+
+void MemoryAllocator::destroyBlock(MemoryBlock & block)
+{
+    if (block.memory == VK_NULL_HANDLE)
+        return;
+
+    // Freeing the memory also unmaps it if it was still mapped
+    vkFreeMemory(device, block.memory, nullptr);
+    block = {};
+}
+
+bool MemoryAllocator::allocateFromBlock(MemoryBlock & block, const VkMemoryRequirements & requirements, MemoryAllocation * allocation)
+{
+    VkDeviceSize alignment = std::max<VkDeviceSize>(requirements.alignment, 1);
+
+    // Best fit : pick the hole that leaves the least space behind
+    size_t bestRange = block.freeRanges.size();
+    VkDeviceSize bestOffset = 0;
+    VkDeviceSize bestWaste = ~0ULL;
+
+    for (size_t i = 0; i < block.freeRanges.size(); ++i)
+    {
+        const FreeRange & range = block.freeRanges[i];
+
+        // Alignment is always a power of two
+        VkDeviceSize alignedOffset = (range.offset + alignment - 1) & ~(alignment - 1);
+        if (alignedOffset + requirements.size > range.offset + range.size)
+            continue;
+
+        VkDeviceSize waste = range.size - requirements.size;
+        if (waste < bestWaste)
+        {
+            bestRange = i;
+            bestOffset = alignedOffset;
+            bestWaste = waste;
+        }
+    }
+
+    if (bestRange == block.freeRanges.size())
+        return false;
+
+    // Split the hole : alignment padding in front and the rest behind stay free
+    FreeRange range = block.freeRanges[bestRange];
+    std::vector<FreeRange> leftovers;
+    if (bestOffset > range.offset)
+        leftovers.push_back({ range.offset, bestOffset - range.offset });
+    if (bestOffset + requirements.size < range.offset + range.size)
+        leftovers.push_back({ bestOffset + requirements.size, range.offset + range.size - (bestOffset + requirements.size) });
+
+    block.freeRanges.erase(block.freeRanges.begin() + bestRange);
+    block.freeRanges.insert(block.freeRanges.begin() + bestRange, leftovers.begin(), leftovers.end());
+
+    block.usedSize += requirements.size;
+    ++block.allocationCount;
+
+    allocation->memory = block.memory;
+    allocation->offset = bestOffset;
+    allocation->size = requirements.size;
+    return true;
+}
@@ -0,0 +1,117 @@
+#pragma once
+
+// GLFW includes
+#define GLFW_INCLUDE_VULKAN
+#include <GLFW/glfw3.h>
+
+// C++ includes
+#include <vector>
+
+// Size of a regular memory block (page) sub-allocations are carved from
+const VkDeviceSize DEFAULT_MEMORY_BLOCK_SIZE = 64 * 1024 * 1024;
+
+// A range of device memory handed out by the MemoryAllocator.
+// Resources are bound to "memory" at "offset" instead of owning a whole VkDeviceMemory.
+struct MemoryAllocation {
+    VkDeviceMemory memory = VK_NULL_HANDLE;     // Block the range lives in
+    VkDeviceSize offset = 0;                    // Start of the range inside the block (already aligned)
+    VkDeviceSize size = 0;                      // Size of the range
+    uint32_t memoryTypeIndex = 0;               // Memory type of the block
+    uint32_t blockIndex = 0;                    // Index of the block in its memory type pool
+};
+
+// Range of a mapped allocation written by the host, offset is relative to the allocation
+struct MemoryRange {
+    MemoryAllocation allocation;
+    VkDeviceSize offset = 0;
+    VkDeviceSize size = 0;
+};
+
+// Snapshot of the allocator usage, summed over every memory type
+struct MemoryAllocatorStats {
+    uint32_t blockCount = 0;            // Number of live vkAllocateMemory allocations
+    uint32_t allocationCount = 0;       // Number of live sub-allocations
+    VkDeviceSize bytesAllocated = 0;    // Bytes reserved from the driver (sum of block sizes)
+    VkDeviceSize bytesInUse = 0;        // Bytes handed out to resources
+    VkDeviceSize bytesFree = 0;         // Bytes reserved but not handed out
+    VkDeviceSize largestFreeRange = 0;  // Biggest contiguous free range in any block
+    uint32_t freeRangeCount = 0;        // Number of holes in all blocks
+
+    // 0 = all free memory is one contiguous range, close to 1 = free memory is scattered in small holes
+    float fragmentation = 0.0f;
+};
+
+// Block based device memory allocator.
+// Memory is reserved from the driver in large blocks (one pool of blocks per memory type) and
+// every buffer/image gets a sub-range of a block, so loading thousands of resources only costs
+// a handful of vkAllocateMemory calls and stays far below maxMemoryAllocationCount.
+class MemoryAllocator
+{
+public:
+    MemoryAllocator();
+    ~MemoryAllocator();
+
+    void init(VkPhysicalDevice newPhysicalDevice, VkDevice newDevice, VkDeviceSize newBlockSize = DEFAULT_MEMORY_BLOCK_SIZE);
+    void destroy();
+
+    // - Allocation Functions
+    // linear : true for buffers and linear images, false for optimal tiled images (kept in separate
+    //          blocks so bufferImageGranularity never has to be taken into account)
+    MemoryAllocation allocate(const VkMemoryRequirements & requirements, VkMemoryPropertyFlags properties, bool linear);
+    void free(MemoryAllocation & allocation);
+
+    // - Mapping Functions
+    // Blocks are mapped once and shared by every allocation inside them (Vulkan forbids mapping
+    // the same VkDeviceMemory twice), map/unmap calls are reference counted per block.
+    void * map(const MemoryAllocation & allocation);
+    void unmap(const MemoryAllocation & allocation);
+
+    // Host writes to non HOST_COHERENT memory must be flushed before the GPU reads them.
+    // Every range is expanded to nonCoherentAtomSize and all of them go in a single vkFlushMappedMemoryRanges,
+    // coherent ranges are skipped.
+    void flush(const std::vector<MemoryRange> & ranges);
+    bool isHostCoherent(const MemoryAllocation & allocation);
+
+    MemoryAllocatorStats getStats();
+
+    VkDevice getDevice();
+
+private:
+    // Free hole inside a block
+    struct FreeRange {
+        VkDeviceSize offset;
+        VkDeviceSize size;
+    };
+
+    struct MemoryBlock {
+        VkDeviceMemory memory = VK_NULL_HANDLE;     // VK_NULL_HANDLE when the slot is unused
+        VkDeviceSize size = 0;
+        VkDeviceSize usedSize = 0;
+        uint32_t allocationCount = 0;
+        bool linear = true;                         // Linear resources or optimal images
+        bool dedicated = false;                     // Block made for a single big resource
+
+        std::vector<FreeRange> freeRanges;          // Sorted by offset, never adjacent
+
+        void * mapped = nullptr;
+        uint32_t mapCount = 0;
+    };
+
+    struct MemoryPool {
+        std::vector<MemoryBlock> blocks;
+    };
+
+    VkPhysicalDevice physicalDevice;
+    VkDevice device;
+    VkDeviceSize blockSize;
+
+    VkPhysicalDeviceMemoryProperties memoryProperties;
+    VkDeviceSize nonCoherentAtomSize;
+    std::vector<MemoryPool> pools;      // One pool per memory type
+
+    // - Support Functions
+    uint32_t findMemoryType(uint32_t allowedTypes, VkMemoryPropertyFlags properties);
+    uint32_t createBlock(uint32_t memoryTypeIndex, VkDeviceSize size, bool linear, bool dedicated);
+    void destroyBlock(MemoryBlock & block);
+    bool allocateFromBlock(MemoryBlock & block, const VkMemoryRequirements & requirements, MemoryAllocation * allocation);
+};
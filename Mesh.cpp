@@ -1,122 +1,120 @@
 #include "Mesh.hpp"
 
+// C++ includes
+#include <algorithm>
+#include <cmath>
+
 Mesh::Mesh()
 {
 }
 
-Mesh::Mesh(VkPhysicalDevice newPhysicalDevice, VkDevice newDevice, VkQueue transferQueue,
-           VkCommandPool transferCommandPool, std::vector<Vertex>* vertices, std::vector<uint32_t>* indices)
+Mesh::Mesh(MeshPool * newMeshPool, std::vector<Vertex>* vertices, std::vector<uint32_t>* indices,
+           uint32_t newFirstObject, uint32_t newInstanceCount)
 {
-    vertexCount = vertices->size();
-    indexCount = indices->size();
-    physicalDevice = newPhysicalDevice;
-    device = newDevice;
-    createVertexBuffer(transferQueue, transferCommandPool, vertices);
-    createIndexBuffer(transferQueue, transferCommandPool, indices);
+    meshPool = newMeshPool;
+    firstObject = newFirstObject;
+    instanceCount = newInstanceCount;
 
-    model.model = glm::mat4(1.0f);
-}
+    // Bounds first : quantized vertex formats are stored relative to them
+    computeBounds(vertices);
+    dequantization = computeDequantization(meshPool->getVertexLayout().format, boundsMin, boundsMax);
 
-Mesh::~Mesh()
-{
+    // Vertex and index data go through the uploader's staging ring, the copies are submitted with the next flush
+    range = meshPool->addMesh(vertices, indices, dequantization, &uploadToken);
 }
 
-void Mesh::destroyVertexBuffer()
+Mesh::~Mesh()
 {
-    vkDestroyBuffer(device, vertexBuffer, nullptr);
-    vkFreeMemory(device, vertexBufferMemory, nullptr);
-    vkDestroyBuffer(device, indexBuffer, nullptr);
-    vkFreeMemory(device, indexBufferMemory, nullptr);
 }
 
-void Mesh::setModel(glm::mat4 newModel)
+uint32_t Mesh::getFirstObject()
 {
-    model.model = newModel;
+    return firstObject;
 }
 
-Model Mesh::getModel()
+uint32_t Mesh::getInstanceCount()
 {
-    return model;
+    return instanceCount;
 }
 
 int Mesh::getVertexCount()
 {
-    return vertexCount;
+    return range.vertexCount;
 }
 
-VkBuffer Mesh::getVertexBuffer()
+const VkBuffer * Mesh::getVertexBuffers()
 {
-    return vertexBuffer;
+    return meshPool->getVertexBuffers(range.chunk);
 }
 
 int Mesh::getIndexCount()
 {
-    return indexCount;
+    return range.indexCount;
 }
 
 VkBuffer Mesh::getIndexBuffer()
 {
-    return indexBuffer;
+    return meshPool->getIndexBuffer(range.chunk);
 }
 
-void Mesh::createVertexBuffer(VkQueue transferQueue, VkCommandPool transferCommandPool, std::vector<Vertex>* vertices)
+VkIndexType Mesh::getIndexType()
 {
-    // Get size of buffer needed for vertices
-    VkDeviceSize bufferSize = sizeof(Vertex) * vertices->size();
-
-    // Temporary buffer to "stage" vertex data before transferring to GPU
-    VkBuffer stagingBuffer;
-    VkDeviceMemory stagingBufferMemory;
-
-    // Create buffer and allocate memory to it
-    createBuffer(physicalDevice, device, bufferSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-                 VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-                 &stagingBuffer, &stagingBufferMemory);
-
-    // Map Memory to Vertex Buffer
-    void * data;                                                            // 1. Create a pointer to a point in normal memory
-    vkMapMemory(device, stagingBufferMemory, 0, bufferSize, 0, &data);  // 2. Map the vertex buffer memory to that point
-    memcpy(data, vertices->data(), static_cast<size_t>(bufferSize));   // 3. Copy memory from vertices to the point
-    vkUnmapMemory(device, stagingBufferMemory);                              // 4. Unmap the vertex buffer memory
-
-    // Create buffer with TRANSFER_DST_BIT to mark as recipient of transfer data (also VERTEX_BUFFER)
-    // Buffer memory is to be DEVICE_LOCAL_BIT meaning memory is on the GPU and only accessible by it and not CPU (host)
-    createBuffer(physicalDevice, device, bufferSize, VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
-                 VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &vertexBuffer, &vertexBufferMemory);
+    return meshPool->getIndexType(range.chunk);
+}
 
-    // Copy staging buffer to vertex buffer on GPU
-    copyBuffer(device, transferQueue, transferCommandPool, stagingBuffer, vertexBuffer, bufferSize);
+MeshRange Mesh::getRange()
+{
+    return range;
+}
 
-    // Clean up staging buffer parts
-    vkDestroyBuffer(device, stagingBuffer, nullptr);
-    vkFreeMemory(device, stagingBufferMemory, nullptr);
+glm::vec3 Mesh::getBoundsMin()
+{
+    return boundsMin;
 }
 
-void Mesh::createIndexBuffer(VkQueue transferQueue, VkCommandPool transferCommandPool, std::vector<uint32_t>* indices)
+glm::vec3 Mesh::getBoundsMax()
 {
-    // Get size of buffer needed for indices
-    VkDeviceSize bufferSize = sizeof(uint32_t) * indices->size();
+    return boundsMax;
+}
 
-    // Temporary buffer to "stage" index data before transferring to GPU
-    VkBuffer stagingBuffer;
-    VkDeviceMemory stagingBufferMemory;
-    createBuffer(physicalDevice, device, bufferSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-        VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, &stagingBuffer, &stagingBufferMemory);
+glm::vec3 Mesh::getBoundsCenter()
+{
+    return (boundsMin + boundsMax) * 0.5f;
+}
 
-    // Map memory to index buffer
-    void* data;                                                            // 1. Create a pointer to a point in normal memory
-    vkMapMemory(device, stagingBufferMemory, 0, bufferSize, 0, &data);  // 2. Map the vertex buffer memory to that point
-    memcpy(data, indices->data(), static_cast<size_t>(bufferSize));   // 3. Copy memory from vertices to the point
-    vkUnmapMemory(device, stagingBufferMemory);                              // 4. Unmap the vertex buffer memory
+float Mesh::getBoundsRadius()
+{
+    return boundsRadius;
+}
 
-    // Create buffer for INDEX data on GPU access only area
-    createBuffer(physicalDevice, device, bufferSize, VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT,
-                 VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &indexBuffer, &indexBufferMemory);
+VertexDequantization Mesh::getDequantization()
+{
+    return dequantization;
+}
 
-    // Copy from staging buffer to GPU access buffer
-    copyBuffer(device, transferQueue, transferCommandPool, stagingBuffer, indexBuffer, bufferSize);
+void Mesh::computeBounds(std::vector<Vertex> * vertices)
+{
+    if (vertices->empty()) return;
+
+    boundsMin = boundsMax = (*vertices)[0].pos;
+    for (const auto & vertex : *vertices)
+    {
+        boundsMin = glm::min(boundsMin, vertex.pos);
+        boundsMax = glm::max(boundsMax, vertex.pos);
+    }
+
+    // Farthest vertex from the box center : tighter than the half diagonal when the mesh doesn't fill the corners
+    glm::vec3 center = getBoundsCenter();
+    float radiusSquared = 0.0f;
+    for (const auto & vertex : *vertices)
+    {
+        glm::vec3 offset = vertex.pos - center;
+        radiusSquared = std::max(radiusSquared, glm::dot(offset, offset));
+    }
+    boundsRadius = std::sqrt(radiusSquared);
+}
 
-    // Destroy + Release Staging buffer resources
-    vkDestroyBuffer(device, stagingBuffer, nullptr);
-    vkFreeMemory(device, stagingBufferMemory, nullptr);
+UploadToken Mesh::getUploadToken()
+{
+    return uploadToken;
 }
@@ -2,6 +2,7 @@
 
 // Project includes
 #include "Utilities.hpp"
+#include "MeshPool.hpp"
 
 // GLFW includes
 #define GLFW_INCLUDE_VULKAN
@@ -10,48 +11,65 @@
 // C++ includes
 #include <vector>
 
+// Per object (or per instance) data read by the vertex shader
 struct Model
 {
     glm::mat4 model;
-
+    glm::vec4 color = glm::vec4(1.0f);  // Multiplies the vertex colours (per instance tint)
 };
 
 class Mesh
 {
 public:
     Mesh();
-    Mesh(VkPhysicalDevice newPhysicalDevice, VkDevice newDevice, VkQueue transferQueue,
-         VkCommandPool transferCommandPool, std::vector<Vertex> * vertices, std::vector<uint32_t> * indices);
+    // Mesh data is stored in the pool's shared buffers, the pool owns (and frees) the memory.
+    // The mesh is drawn newInstanceCount times, instance i using the object data at newFirstObject + i.
+    Mesh(MeshPool * newMeshPool, std::vector<Vertex> * vertices, std::vector<uint32_t> * indices,
+         uint32_t newFirstObject, uint32_t newInstanceCount = 1);
 
     ~Mesh();
-    void destroyVertexBuffer();
 
-    void setModel(glm::mat4 newModel);
-    Model getModel();
+    uint32_t getFirstObject();
+    uint32_t getInstanceCount();
 
     int getVertexCount();
-    VkBuffer getVertexBuffer();
+    // One per stream of the pool's vertex layout
+    const VkBuffer * getVertexBuffers();
 
     int getIndexCount();
     VkBuffer getIndexBuffer();
+    // 16 bit when the mesh has few enough vertices, decided by the pool when it's added
+    VkIndexType getIndexType();
 
-private:
-    void createVertexBuffer(VkQueue transferQueue, VkCommandPool transferCommandPool,
-                            std::vector<Vertex> * vertices);
-    void createIndexBuffer(VkQueue transferQueue, VkCommandPool transferCommandPool,
-        std::vector<uint32_t>* indices);
+    // Position in the pool buffers (to pass to the draw)
+    MeshRange getRange();
+
+    // Bounds of the vertices in model space, computed when the mesh is added
+    glm::vec3 getBoundsMin();
+    glm::vec3 getBoundsMax();
+    // Bounding sphere (centered on the box), what frustum culling tests
+    glm::vec3 getBoundsCenter();
+    float getBoundsRadius();
+
+    // Maps the stored vertex positions back to model space (identity unless the pool quantizes them)
+    VertexDequantization getDequantization();
+
+    // Token of the upload filling the buffers, the mesh can be drawn once it's submitted
+    UploadToken getUploadToken();
 
 private:
-    Model model;
+    uint32_t firstObject;
+    uint32_t instanceCount;
+
+    MeshPool * meshPool;
+    MeshRange range;
 
-    int vertexCount;
-    VkBuffer vertexBuffer;
-    VkDeviceMemory vertexBufferMemory;
+    glm::vec3 boundsMin = glm::vec3(0.0f);
+    glm::vec3 boundsMax = glm::vec3(0.0f);
+    float boundsRadius = 0.0f;
+    VertexDequantization dequantization;
 
-    int indexCount;
-    VkBuffer indexBuffer;
-    VkDeviceMemory indexBufferMemory;
+    void computeBounds(std::vector<Vertex> * vertices);
 
-    VkPhysicalDevice physicalDevice;
-    VkDevice device;
+    UploadToken uploadToken;
 };
\ No newline at end of file
@@ -0,0 +1,370 @@
+#include "MeshOptimizer.hpp"
+
+// C++ includes
+#include <algorithm>
+#include <cstring>
+#include <chrono>
+
+const uint32_t NO_VERTEX = UINT32_MAX;
+
+// FNV-1a over the vertex bytes : identical vertices are identical bit for bit.
+// Byte by byte so every byte reaches the low bits the table slot is taken from (positions often only differ in high bits)
+static uint32_t hashVertex(const Vertex & vertex)
+{
+    const unsigned char * bytes = reinterpret_cast<const unsigned char *>(&vertex);
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; i < sizeof(Vertex); ++i)
+    {
+        hash ^= bytes[i];
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+// Every step walks whole triangles and indexes per vertex arrays with the indices
+static bool isValidMesh(const std::vector<uint32_t> & indices, size_t vertexCount)
+{
+    if (indices.size() % 3 != 0)
+        return false;
+    for (uint32_t index : indices)
+    {
+        if (index >= vertexCount)
+            return false;
+    }
+    return true;
+}
+
+double MeshOptimizerStats::getAcmrBefore() const
+{
+    return triangles > 0 ? static_cast<double>(cacheMissesBefore) / triangles : 0.0;
+}
+
+double MeshOptimizerStats::getAcmrAfter() const
+{
+    return triangles > 0 ? static_cast<double>(cacheMissesAfter) / triangles : 0.0;
+}
+
+double MeshOptimizerStats::getAtvrBefore() const
+{
+    return verticesBefore > 0 ? static_cast<double>(cacheMissesBefore) / verticesBefore : 0.0;
+}
+
+double MeshOptimizerStats::getAtvrAfter() const
+{
+    return verticesAfter > 0 ? static_cast<double>(cacheMissesAfter) / verticesAfter : 0.0;
+}
+
+void MeshOptimizerStats::add(const MeshOptimizerStats & other)
+{
+    meshes += other.meshes;
+    triangles += other.triangles;
+    verticesBefore += other.verticesBefore;
+    verticesAfter += other.verticesAfter;
+    cacheMissesBefore += other.cacheMissesBefore;
+    cacheMissesAfter += other.cacheMissesAfter;
+    optimizeMs += other.optimizeMs;
+}
+
+MeshOptimizer::MeshOptimizer()
+{
+}
+
+MeshOptimizer::~MeshOptimizer()
+{
+}
+
+void MeshOptimizer::setCacheSize(uint32_t newCacheSize)
+{
+    cacheSize = std::max(newCacheSize, 3u);
+}
+
+MeshOptimizerStats MeshOptimizer::optimize(std::vector<Vertex> * vertices, std::vector<uint32_t> * indices)
+{
+    // A partial triangle or an index past the vertices : the mesh is left as is (not counted as optimised)
+    MeshOptimizerStats stats;
+    if (!isValidMesh(*indices, vertices->size()))
+        return stats;
+
+    stats.meshes = 1;
+    stats.triangles = indices->size() / 3;
+    stats.verticesBefore = vertices->size();
+    stats.cacheMissesBefore = countCacheMisses(*indices, vertices->size());
+
+    auto optimizeStart = std::chrono::steady_clock::now();
+
+    // Order matters : the cache order needs the merged vertices (shared vertices are what the cache reuses),
+    // the overdraw sort moves whole clusters of the cache order, and fetch order follows the final triangle order
+    deduplicateVertices(vertices, indices);
+    optimizeVertexCache(indices, vertices->size(), &clusterStarts);
+    optimizeOverdraw(*vertices, indices, clusterStarts);
+    optimizeVertexFetch(vertices, indices);
+
+    stats.optimizeMs = elapsedMs(optimizeStart);
+
+    stats.verticesAfter = vertices->size();
+    stats.cacheMissesAfter = countCacheMisses(*indices, vertices->size());
+    return stats;
+}
+
+void MeshOptimizer::deduplicateVertices(std::vector<Vertex> * vertices, std::vector<uint32_t> * indices)
+{
+    size_t vertexCount = vertices->size();
+
+    // Open addressing table of the unique vertices, at least twice as big as the vertex count : short probe sequences
+    size_t tableSize = 1;
+    while (tableSize < vertexCount * 2)
+        tableSize *= 2;
+    hashTable.assign(tableSize, NO_VERTEX);
+    remap.resize(vertexCount);
+
+    // Unique vertices are compacted in place, in order : the unique one being written never passes the one being read
+    uint32_t uniqueCount = 0;
+    for (size_t v = 0; v < vertexCount; ++v)
+    {
+        const Vertex vertex = (*vertices)[v];
+        size_t slot = hashVertex(vertex) & (tableSize - 1);
+        while (hashTable[slot] != NO_VERTEX && memcmp(&(*vertices)[hashTable[slot]], &vertex, sizeof(Vertex)) != 0)
+        {
+            slot = (slot + 1) & (tableSize - 1);
+        }
+
+        if (hashTable[slot] == NO_VERTEX)
+        {
+            hashTable[slot] = uniqueCount;
+            (*vertices)[uniqueCount] = vertex;
+            remap[v] = uniqueCount++;
+        }
+        else
+        {
+            remap[v] = hashTable[slot];
+        }
+    }
+
+    vertices->resize(uniqueCount);
+    for (auto & index : *indices)
+    {
+        index = remap[index];
+    }
+}
+
+void MeshOptimizer::optimizeVertexCache(std::vector<uint32_t> * indices, size_t vertexCount, std::vector<uint32_t> * newClusterStarts)
+{
+    // Tipsify (Sander, Nehab, Barczak 2007) : emit every triangle around a "fanning" vertex, then fan around the emitted vertex
+    // that will still be in the cache after its own triangles are emitted. When none is left (dead end), restart from the
+    // most recently used vertex with triangles left, or the next one in index order : a new cluster starts there.
+    const std::vector<uint32_t> & source = *indices;
+    size_t triangleCount = source.size() / 3;
+    newClusterStarts->clear();
+    if (triangleCount == 0) return;
+
+    // Triangles of every vertex (counting sort of the triangle corners by vertex)
+    triangleOffsets.assign(vertexCount + 1, 0);
+    for (uint32_t index : source)
+    {
+        triangleOffsets[index + 1]++;
+    }
+    for (size_t v = 0; v < vertexCount; ++v)
+    {
+        triangleOffsets[v + 1] += triangleOffsets[v];
+    }
+    adjacentTriangles.resize(source.size());
+    remap.assign(triangleOffsets.begin(), triangleOffsets.end() - 1);
+    for (size_t corner = 0; corner < triangleCount * 3; ++corner)
+    {
+        adjacentTriangles[remap[source[corner]]++] = static_cast<uint32_t>(corner / 3);
+    }
+
+    liveTriangles.resize(vertexCount);
+    for (size_t v = 0; v < vertexCount; ++v)
+    {
+        liveTriangles[v] = triangleOffsets[v + 1] - triangleOffsets[v];
+    }
+
+    // Cache entry time of every vertex : in the cache while time - cacheTimes[v] <= cacheSize (FIFO)
+    cacheTimes.assign(vertexCount, 0);
+    uint32_t time = cacheSize + 1;
+    emitted.assign(triangleCount, 0);
+    deadEnds.clear();
+    reordered.clear();
+    reordered.reserve(source.size());
+
+    uint32_t cursor = 0;
+    bool deadEnd = true;
+    int64_t fanning = 0;
+    while (fanning >= 0)
+    {
+        candidates.clear();
+        for (uint32_t i = triangleOffsets[fanning]; i < triangleOffsets[fanning + 1]; ++i)
+        {
+            uint32_t triangle = adjacentTriangles[i];
+            if (emitted[triangle]) continue;
+
+            if (deadEnd)
+            {
+                newClusterStarts->push_back(static_cast<uint32_t>(reordered.size() / 3));
+                deadEnd = false;
+            }
+
+            for (size_t corner = 0; corner < 3; ++corner)
+            {
+                uint32_t vertex = source[triangle * 3 + corner];
+                reordered.push_back(vertex);
+                deadEnds.push_back(vertex);
+                candidates.push_back(vertex);
+                liveTriangles[vertex]--;
+                if (time - cacheTimes[vertex] > cacheSize)
+                {
+                    cacheTimes[vertex] = time++;
+                }
+            }
+            emitted[triangle] = 1;
+        }
+
+        fanning = getNextVertex(time, &cursor, vertexCount, &deadEnd);
+    }
+
+    std::copy(reordered.begin(), reordered.end(), indices->begin());
+}
+
+int64_t MeshOptimizer::getNextVertex(uint32_t time, uint32_t * cursor, size_t vertexCount, bool * deadEnd)
+{
+    // Candidate that stays in the cache through its remaining triangles (each adds up to 2 vertices),
+    // the one that entered the cache first among them (it would be evicted first otherwise)
+    int64_t best = -1;
+    int64_t bestPriority = -1;
+    for (uint32_t vertex : candidates)
+    {
+        if (liveTriangles[vertex] == 0) continue;
+
+        int64_t priority = 0;
+        int64_t age = time - cacheTimes[vertex];
+        if (age + 2 * static_cast<int64_t>(liveTriangles[vertex]) <= cacheSize)
+            priority = age;
+
+        if (priority > bestPriority)
+        {
+            bestPriority = priority;
+            best = vertex;
+        }
+    }
+    if (best >= 0)
+        return best;
+
+    // Dead end
+    *deadEnd = true;
+    while (!deadEnds.empty())
+    {
+        uint32_t vertex = deadEnds.back();
+        deadEnds.pop_back();
+        if (liveTriangles[vertex] > 0)
+            return vertex;
+    }
+    for (; *cursor < vertexCount; ++(*cursor))
+    {
+        if (liveTriangles[*cursor] > 0)
+            return *cursor;
+    }
+    return -1;
+}
+
+void MeshOptimizer::optimizeOverdraw(const std::vector<Vertex> & vertices, std::vector<uint32_t> * indices,
+                                     const std::vector<uint32_t> & newClusterStarts)
+{
+    // Clusters facing away from the mesh center are drawn first : on a convex-ish mesh they're the ones in front, so
+    // triangles behind them fail the depth test instead of being shaded and overwritten.
+    // Only whole clusters move, the order inside them (and so their cache hits) is kept
+    size_t triangleCount = indices->size() / 3;
+    size_t clusterCount = newClusterStarts.size();
+    if (clusterCount <= 1 || vertices.empty()) return;
+
+    glm::vec3 meshCenter = glm::vec3(0.0f);
+    for (const auto & vertex : vertices)
+    {
+        meshCenter += vertex.pos;
+    }
+    meshCenter = meshCenter / static_cast<float>(vertices.size());
+
+    struct ClusterOrder {
+        float facing;       // How much the cluster faces away from the mesh center
+        uint32_t cluster;
+    };
+    std::vector<ClusterOrder> clusterOrder(clusterCount);
+
+    const std::vector<uint32_t> & source = *indices;
+    for (size_t cluster = 0; cluster < clusterCount; ++cluster)
+    {
+        size_t clusterEnd = cluster + 1 < clusterCount ? newClusterStarts[cluster + 1] : triangleCount;
+
+        // Area weighted normal and centroid (counter-clockwise triangles : the normal points out of the front face)
+        glm::vec3 normal = glm::vec3(0.0f);
+        glm::vec3 centroid = glm::vec3(0.0f);
+        float area = 0.0f;
+        for (size_t triangle = newClusterStarts[cluster]; triangle < clusterEnd; ++triangle)
+        {
+            const glm::vec3 & p0 = vertices[source[triangle * 3 + 0]].pos;
+            const glm::vec3 & p1 = vertices[source[triangle * 3 + 1]].pos;
+            const glm::vec3 & p2 = vertices[source[triangle * 3 + 2]].pos;
+            glm::vec3 triangleNormal = glm::cross(p1 - p0, p2 - p0);
+            float triangleArea = glm::length(triangleNormal);
+
+            normal += triangleNormal;
+            centroid += (p0 + p1 + p2) * (triangleArea / 3.0f);
+            area += triangleArea;
+        }
+
+        float normalLength = glm::length(normal);
+        clusterOrder[cluster].cluster = static_cast<uint32_t>(cluster);
+        clusterOrder[cluster].facing = area > 0.0f && normalLength > 0.0f
+            ? glm::dot(centroid / area - meshCenter, normal / normalLength) : 0.0f;
+    }
+
+    std::stable_sort(clusterOrder.begin(), clusterOrder.end(), [](const ClusterOrder & a, const ClusterOrder & b) {
+        return a.facing > b.facing;
+    });
+
+    reordered.clear();
+    for (const auto & order : clusterOrder)
+    {
+        size_t clusterStart = newClusterStarts[order.cluster];
+        size_t clusterEnd = order.cluster + 1 < clusterCount ? newClusterStarts[order.cluster + 1] : triangleCount;
+        reordered.insert(reordered.end(), source.begin() + clusterStart * 3, source.begin() + clusterEnd * 3);
+    }
+    std::copy(reordered.begin(), reordered.end(), indices->begin());
+}
+
+void MeshOptimizer::optimizeVertexFetch(std::vector<Vertex> * vertices, std::vector<uint32_t> * indices)
+{
+    // Vertices numbered in first use order : the vertex fetches of consecutive triangles read neighbouring memory.
+    // Vertices no triangle uses are dropped
+    remap.assign(vertices->size(), NO_VERTEX);
+    reorderedVertices.clear();
+    reorderedVertices.reserve(vertices->size());
+    for (auto & index : *indices)
+    {
+        if (remap[index] == NO_VERTEX)
+        {
+            remap[index] = static_cast<uint32_t>(reorderedVertices.size());
+            reorderedVertices.push_back((*vertices)[index]);
+        }
+        index = remap[index];
+    }
+
+    vertices->assign(reorderedVertices.begin(), reorderedVertices.end());
+}
+
+uint64_t MeshOptimizer::countCacheMisses(const std::vector<uint32_t> & indices, size_t vertexCount)
+{
+    // FIFO : a vertex stays cached until cacheSize other vertices entered after it
+    cacheTimes.assign(vertexCount, 0);
+    uint32_t time = cacheSize + 1;
+    uint64_t misses = 0;
+    for (uint32_t index : indices)
+    {
+        if (time - cacheTimes[index] > cacheSize)
+        {
+            cacheTimes[index] = time++;
+            ++misses;
+        }
+    }
+    return misses;
+}
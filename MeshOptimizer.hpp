@@ -0,0 +1,79 @@
+#pragma once
+
+// Project includes
+#include "Utilities.hpp"
+
+// C++ includes
+#include <vector>
+#include <cstdint>
+
+// Post-transform vertex cache size the triangle order is optimised for, and simulated by the stats (FIFO).
+// GPUs reuse recently shaded vertices from a small cache, 16 is a safe guess for most of them.
+const uint32_t DEFAULT_VERTEX_CACHE_SIZE = 16;
+
+// What optimize() did, summed over every mesh it optimised
+struct MeshOptimizerStats {
+    uint64_t meshes = 0;
+    uint64_t triangles = 0;
+    uint64_t verticesBefore = 0;        // Given vertices
+    uint64_t verticesAfter = 0;         // Left after deduplication (and dropping unused ones)
+    uint64_t cacheMissesBefore = 0;     // Simulated vertex shader invocations, in the given order
+    uint64_t cacheMissesAfter = 0;
+    double optimizeMs = 0.0;
+
+    // Average cache miss ratio : vertices shaded per triangle (0.5 at best on big regular meshes, 3 at worst)
+    double getAcmrBefore() const;
+    double getAcmrAfter() const;
+    // Average transformed vertex ratio : times each vertex is shaded (1 at best)
+    double getAtvrBefore() const;
+    double getAtvrAfter() const;
+
+    void add(const MeshOptimizerStats & other);
+};
+
+// Mesh optimisation, run on the CPU before the mesh is uploaded (same vertices and triangles, drawn faster) :
+// 1. identical vertices are merged (indexed meshes from unwelded data shade each vertex once instead of up to 6 times)
+// 2. triangles are reordered for the post-transform vertex cache (Tipsify : fans around recently used vertices)
+// 3. the clusters Tipsify produces are sorted so outward facing ones come first (less overdraw, cache locality kept)
+// 4. vertices are renumbered in the order the triangles first use them (sequential vertex fetches)
+class MeshOptimizer
+{
+public:
+    MeshOptimizer();
+    ~MeshOptimizer();
+
+    void setCacheSize(uint32_t newCacheSize);
+
+    // Every step in place, returns the stats of this mesh. Meshes with a partial triangle (index count not a multiple of 3)
+    // or an index past the vertices are left unchanged, with empty stats
+    MeshOptimizerStats optimize(std::vector<Vertex> * vertices, std::vector<uint32_t> * indices);
+
+    // - Steps (also usable on their own)
+    void deduplicateVertices(std::vector<Vertex> * vertices, std::vector<uint32_t> * indices);
+    // clusterStarts receives the first triangle of every cluster (where the order restarts away from the cache)
+    void optimizeVertexCache(std::vector<uint32_t> * indices, size_t vertexCount, std::vector<uint32_t> * clusterStarts);
+    void optimizeOverdraw(const std::vector<Vertex> & vertices, std::vector<uint32_t> * indices, const std::vector<uint32_t> & clusterStarts);
+    void optimizeVertexFetch(std::vector<Vertex> * vertices, std::vector<uint32_t> * indices);
+
+    // Vertex shader invocations of drawing indices with a FIFO cache of cacheSize vertices
+    uint64_t countCacheMisses(const std::vector<uint32_t> & indices, size_t vertexCount);
+
+private:
+    uint32_t cacheSize = DEFAULT_VERTEX_CACHE_SIZE;
+
+    // Scratch arrays, kept between meshes to reuse their memory
+    std::vector<uint32_t> remap;
+    std::vector<uint32_t> hashTable;
+    std::vector<uint32_t> triangleOffsets;      // Adjacency : triangles of vertex v are adjacentTriangles[triangleOffsets[v] ...]
+    std::vector<uint32_t> adjacentTriangles;
+    std::vector<uint32_t> liveTriangles;        // Triangles of each vertex not emitted yet
+    std::vector<uint32_t> cacheTimes;
+    std::vector<uint32_t> deadEnds;             // Vertices of the emitted triangles, most recent last
+    std::vector<uint32_t> candidates;
+    std::vector<uint32_t> clusterStarts;
+    std::vector<uint8_t> emitted;
+    std::vector<uint32_t> reordered;
+    std::vector<Vertex> reorderedVertices;
+
+    int64_t getNextVertex(uint32_t time, uint32_t * cursor, size_t vertexCount, bool * deadEnd);
+};
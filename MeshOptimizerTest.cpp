@@ -0,0 +1,72 @@
+// Checks of the mesh optimiser on meshes it must leave alone : make optimizer_test
+// Exits with EXIT_FAILURE if any check fails
+
+// Project includes
+#include "MeshOptimizer.hpp"
+
+// C++ includes
+#include <iostream>
+#include <vector>
+
+int failures = 0;
+
+void check(bool condition, const char * name)
+{
+    std::cout << (condition ? "PASS " : "FAIL ") << name << std::endl;
+    if (!condition)
+        ++failures;
+}
+
+// Quad of two triangles, 4 vertices
+void createQuad(std::vector<Vertex> * vertices, std::vector<uint32_t> * indices)
+{
+    glm::vec3 colour = glm::vec3(1.0f, 0.0f, 0.0f);
+    *vertices = {
+        { glm::vec3(-1.0f, -1.0f, 0.0f), colour },
+        { glm::vec3(1.0f, -1.0f, 0.0f), colour },
+        { glm::vec3(1.0f, 1.0f, 0.0f), colour },
+        { glm::vec3(-1.0f, 1.0f, 0.0f), colour }
+    };
+    *indices = { 0, 1, 2, 2, 3, 0 };
+}
+
+// The mesh must come back exactly as given, with nothing counted as optimised
+void checkUnchanged(const std::vector<Vertex> & sourceVertices, const std::vector<uint32_t> & sourceIndices, const char * name)
+{
+    MeshOptimizer optimizer;
+    std::vector<Vertex> vertices = sourceVertices;
+    std::vector<uint32_t> indices = sourceIndices;
+    MeshOptimizerStats stats = optimizer.optimize(&vertices, &indices);
+
+    bool sameVertices = vertices.size() == sourceVertices.size();
+    for (size_t i = 0; sameVertices && i < vertices.size(); ++i)
+    {
+        sameVertices = vertices[i].pos == sourceVertices[i].pos;
+    }
+    check(sameVertices && indices == sourceIndices && stats.meshes == 0, name);
+}
+
+int main()
+{
+    std::vector<Vertex> vertices;
+    std::vector<uint32_t> indices;
+
+    // Trailing partial triangle
+    createQuad(&vertices, &indices);
+    indices.push_back(1);
+    indices.push_back(3);
+    checkUnchanged(vertices, indices, "partial triangle is left unchanged");
+
+    // Index past the vertices
+    createQuad(&vertices, &indices);
+    indices[4] = 4;
+    checkUnchanged(vertices, indices, "out of range index is left unchanged");
+
+    // Valid mesh still optimised
+    createQuad(&vertices, &indices);
+    MeshOptimizer optimizer;
+    MeshOptimizerStats stats = optimizer.optimize(&vertices, &indices);
+    check(stats.meshes == 1 && stats.triangles == 2 && indices.size() == 6 && vertices.size() == 4, "valid mesh is optimised");
+
+    return failures == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
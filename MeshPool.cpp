@@ -0,0 +1,184 @@
+#include "MeshPool.hpp"
+
+// C++ includes
+#include <algorithm>
+
+// Index narrowing uses SSE2 on any x86-64 CPU, a scalar loop otherwise
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+    #include <emmintrin.h>
+    #define MESH_POOL_SSE2
+#endif
+
+// 32 to 16 bit indices (every index <= 0xFFFF)
+static void narrowIndices(const uint32_t * indices, size_t count, uint16_t * narrowed)
+{
+    size_t i = 0;
+#if defined(MESH_POOL_SSE2)
+    // 8 indices per iteration. SSE2 only packs with signed saturation : indices are moved to [-32768, 32767] first,
+    // packed, then moved back by flipping the top bit of each 16 bit lane
+    const __m128i bias = _mm_set1_epi32(0x8000);
+    const __m128i flip = _mm_set1_epi16(static_cast<short>(0x8000));
+    for (; i + 8 <= count; i += 8)
+    {
+        __m128i low = _mm_sub_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i *>(indices + i)), bias);
+        __m128i high = _mm_sub_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i *>(indices + i + 4)), bias);
+        __m128i packed = _mm_xor_si128(_mm_packs_epi32(low, high), flip);
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(narrowed + i), packed);
+    }
+#endif
+    for (; i < count; ++i)
+    {
+        narrowed[i] = static_cast<uint16_t>(indices[i]);
+    }
+}
+
+MeshPool::MeshPool()
+{
+}
+
+MeshPool::~MeshPool()
+{
+}
+
+void MeshPool::init(VkDevice newDevice, MemoryAllocator * newAllocator, StagingUploader * newUploader, VertexLayout newVertexLayout,
+                    uint32_t newChunkVertices)
+{
+    device = newDevice;
+    allocator = newAllocator;
+    uploader = newUploader;
+    vertexLayout = newVertexLayout;
+    chunkVertices = newChunkVertices;
+}
+
+void MeshPool::destroy()
+{
+    for (auto & chunk : chunks)
+    {
+        for (uint32_t stream = 0; stream < vertexLayout.getStreamCount(); ++stream)
+        {
+            vkDestroyBuffer(device, chunk.vertexBuffers[stream], nullptr);
+            allocator->free(chunk.vertexBufferMemory[stream]);
+        }
+        vkDestroyBuffer(device, chunk.indexBuffer, nullptr);
+        allocator->free(chunk.indexBufferMemory);
+    }
+    chunks.clear();
+    openChunks[0] = openChunks[1] = NO_CHUNK;
+}
+
+MeshRange MeshPool::addMesh(std::vector<Vertex> * vertices, std::vector<uint32_t> * indices, const VertexDequantization & dequantization,
+                            UploadToken * uploadToken)
+{
+    uint32_t vertexCount = static_cast<uint32_t>(vertices->size());
+    uint32_t indexCount = static_cast<uint32_t>(indices->size());
+
+    VkIndexType indexType = vertexCount <= MAX_UINT16_INDEXED_VERTICES ? VK_INDEX_TYPE_UINT16 : VK_INDEX_TYPE_UINT32;
+
+    // Start a new chunk when the mesh doesn't fit in the open chunk of its index type (the rest of that one is left unused)
+    uint32_t & openChunk = openChunks[indexType == VK_INDEX_TYPE_UINT16 ? 0 : 1];
+    if (openChunk == NO_CHUNK
+        || chunks[openChunk].vertexCount + vertexCount > chunks[openChunk].vertexCapacity
+        || chunks[openChunk].indexCount + indexCount > chunks[openChunk].indexCapacity)
+    {
+        if (indexType == VK_INDEX_TYPE_UINT32)
+            createChunk(vertexCount, indexCount, indexType);
+        else
+            createChunk(std::max(chunkVertices, vertexCount), std::max(chunkVertices * 3, indexCount), indexType);
+        openChunk = static_cast<uint32_t>(chunks.size()) - 1;
+    }
+
+    Chunk & chunk = chunks[openChunk];
+
+    MeshRange range = {};
+    range.chunk = openChunk;
+    range.vertexOffset = static_cast<int32_t>(chunk.vertexCount);
+    range.firstIndex = chunk.indexCount;
+    range.indexCount = indexCount;
+    range.vertexCount = vertexCount;
+
+    // Interleaved float vertices are uploaded as they are, other layouts are converted first (streams one after the other)
+    const void * streamData[MAX_VERTEX_STREAMS] = { vertices->data() };
+    if (vertexLayout.format != VertexFormat::FULL || vertexLayout.splitStreams)
+    {
+        encodedVertices.resize(static_cast<size_t>(vertexLayout.getVertexSize()) * vertexCount);
+        void * streams[MAX_VERTEX_STREAMS] = {};
+        size_t streamOffset = 0;
+        for (uint32_t stream = 0; stream < vertexLayout.getStreamCount(); ++stream)
+        {
+            streams[stream] = encodedVertices.data() + streamOffset;
+            streamData[stream] = streams[stream];
+            streamOffset += static_cast<size_t>(vertexLayout.getStride(stream)) * vertexCount;
+        }
+        encodeVertices(vertexLayout, vertices->data(), vertexCount, dequantization, streams);
+    }
+
+    // Mesh data goes through the uploader's staging ring, to its place in the chunk (in every stream)
+    for (uint32_t stream = 0; stream < vertexLayout.getStreamCount(); ++stream)
+    {
+        VkDeviceSize stride = vertexLayout.getStride(stream);
+        uploader->uploadBuffer(streamData[stream], stride * vertexCount, chunk.vertexBuffers[stream], stride * chunk.vertexCount);
+    }
+    if (indexType == VK_INDEX_TYPE_UINT16)
+    {
+        narrowedIndices.resize(indexCount);
+        narrowIndices(indices->data(), indexCount, narrowedIndices.data());
+        *uploadToken = uploader->uploadBuffer(narrowedIndices.data(), sizeof(uint16_t) * indexCount, chunk.indexBuffer,
+                                              sizeof(uint16_t) * chunk.indexCount);
+    }
+    else
+    {
+        *uploadToken = uploader->uploadBuffer(indices->data(), sizeof(uint32_t) * indexCount, chunk.indexBuffer,
+                                              sizeof(uint32_t) * chunk.indexCount);
+    }
+
+    chunk.vertexCount += vertexCount;
+    chunk.indexCount += indexCount;
+
+    return range;
+}
+
+VertexLayout MeshPool::getVertexLayout()
+{
+    return vertexLayout;
+}
+
+uint32_t MeshPool::getChunkCount()
+{
+    return static_cast<uint32_t>(chunks.size());
+}
+
+const VkBuffer * MeshPool::getVertexBuffers(uint32_t chunk)
+{
+    return chunks[chunk].vertexBuffers;
+}
+
+VkBuffer MeshPool::getIndexBuffer(uint32_t chunk)
+{
+    return chunks[chunk].indexBuffer;
+}
+
+VkIndexType MeshPool::getIndexType(uint32_t chunk)
+{
+    return chunks[chunk].indexType;
+}
+
+void MeshPool::createChunk(uint32_t vertexCapacity, uint32_t indexCapacity, VkIndexType indexType)
+{
+    Chunk chunk = {};
+    chunk.indexType = indexType;
+    chunk.vertexCapacity = vertexCapacity;
+    chunk.indexCapacity = indexCapacity;
+
+    // Buffer memory is DEVICE_LOCAL, only filled with transfers
+    for (uint32_t stream = 0; stream < vertexLayout.getStreamCount(); ++stream)
+    {
+        createBuffer(device, allocator, static_cast<VkDeviceSize>(vertexLayout.getStride(stream)) * vertexCapacity,
+                     VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+                     &chunk.vertexBuffers[stream], &chunk.vertexBufferMemory[stream]);
+    }
+    VkDeviceSize indexSize = indexType == VK_INDEX_TYPE_UINT16 ? sizeof(uint16_t) : sizeof(uint32_t);
+    createBuffer(device, allocator, indexSize * indexCapacity, VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT,
+                 VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &chunk.indexBuffer, &chunk.indexBufferMemory);
+
+    chunks.push_back(chunk);
+}
@@ -0,0 +1,89 @@
+#pragma once
+
+// Project includes
+#include "Utilities.hpp"
+#include "StagingUploader.hpp"
+#include "VertexLayout.hpp"
+
+// GLFW includes
+#define GLFW_INCLUDE_VULKAN
+#include <GLFW/glfw3.h>
+
+// C++ includes
+#include <vector>
+
+// Vertex count a chunk is created with (index capacity is 3 times that), bigger meshes get a chunk of their size
+const uint32_t DEFAULT_MESH_POOL_CHUNK_VERTICES = 256 * 1024;
+
+// Meshes with up to this many vertices store 16 bit indices (indices are relative to the mesh's first vertex)
+const uint32_t MAX_UINT16_INDEXED_VERTICES = 65535;
+
+// Where a mesh lives in the pool
+struct MeshRange {
+    uint32_t chunk = 0;         // Chunk holding the mesh (vertex + index buffer pair)
+    int32_t vertexOffset = 0;   // First vertex of the mesh in the chunk vertex buffer (added to every index)
+    uint32_t firstIndex = 0;    // First index of the mesh in the chunk index buffer
+    uint32_t indexCount = 0;
+    uint32_t vertexCount = 0;
+};
+
+// Shared vertex/index "mega" buffers.
+// Meshes are appended to big DEVICE_LOCAL vertex and index buffers instead of owning two buffers each, so a whole
+// chunk of meshes is drawn with a single buffer bind (and a single indirect draw).
+// A chunk has one index type : 16 bit for meshes small enough, half the index memory and bandwidth. There's one open chunk
+// per index type, a mesh goes to the open chunk of its type (32 bit meshes get a chunk of their own size, they're the big
+// and rare ones), so mixing both types never leaves a 16 bit chunk half used.
+// Chunks are only appended, but a mesh can go to an older chunk than the previous mesh (16 bit after 32 bit).
+class MeshPool
+{
+public:
+    MeshPool();
+    ~MeshPool();
+
+    // Vertices are stored in newVertexLayout (one vertex buffer per stream in every chunk)
+    void init(VkDevice newDevice, MemoryAllocator * newAllocator, StagingUploader * newUploader,
+              VertexLayout newVertexLayout = VertexLayout(), uint32_t newChunkVertices = DEFAULT_MESH_POOL_CHUNK_VERTICES);
+    void destroy();
+
+    // Converts the vertices to the pool's layout (quantized with dequantization) and copies the mesh data through the uploader,
+    // uploadToken receives the token of the upload
+    MeshRange addMesh(std::vector<Vertex> * vertices, std::vector<uint32_t> * indices, const VertexDequantization & dequantization,
+                      UploadToken * uploadToken);
+
+    VertexLayout getVertexLayout();
+
+    uint32_t getChunkCount();
+    // One buffer per stream of the layout, to bind from binding 0
+    const VkBuffer * getVertexBuffers(uint32_t chunk);
+    VkBuffer getIndexBuffer(uint32_t chunk);
+    // Type to bind the chunk's index buffer with
+    VkIndexType getIndexType(uint32_t chunk);
+
+private:
+    static const uint32_t NO_CHUNK = UINT32_MAX;
+
+    struct Chunk {
+        VkBuffer vertexBuffers[MAX_VERTEX_STREAMS];
+        MemoryAllocation vertexBufferMemory[MAX_VERTEX_STREAMS];
+        VkBuffer indexBuffer;
+        MemoryAllocation indexBufferMemory;
+        VkIndexType indexType;
+        uint32_t vertexCapacity;
+        uint32_t indexCapacity;
+        uint32_t vertexCount = 0;   // Vertices used
+        uint32_t indexCount = 0;    // Indices used
+    };
+
+    VkDevice device;
+    MemoryAllocator * allocator;
+    StagingUploader * uploader;
+    uint32_t chunkVertices;
+    VertexLayout vertexLayout;
+
+    std::vector<Chunk> chunks;
+    uint32_t openChunks[2] = { NO_CHUNK, NO_CHUNK };    // Chunk new meshes go to, per index type (16 bit, 32 bit)
+    std::vector<uint8_t> encodedVertices;   // Converted vertices of the mesh being added (kept to reuse its memory)
+    std::vector<uint16_t> narrowedIndices;  // Same for 16 bit indices
+
+    void createChunk(uint32_t vertexCapacity, uint32_t indexCapacity, VkIndexType indexType);
+};
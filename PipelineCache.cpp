@@ -0,0 +1,157 @@
+#include "PipelineCache.hpp"
+
+// C++ includes
+#include <stdexcept>
+#include <fstream>
+#include <cstdio>
+#include <cstring>
+
+// "VKPC" : marks the file as one of ours
+const uint32_t PIPELINE_CACHE_FILE_MAGIC = 0x43504B56;
+// Bumped when FileHeader changes
+const uint32_t PIPELINE_CACHE_FILE_VERSION = 1;
+
+PipelineCache::PipelineCache()
+{
+}
+
+PipelineCache::~PipelineCache()
+{
+}
+
+void PipelineCache::init(VkDevice newDevice, VkPhysicalDevice physicalDevice, const std::string & newFilePath)
+{
+    device = newDevice;
+    filePath = newFilePath;
+    warm = false;
+    loadedBytes = 0;
+
+    // Identity of this device and driver : a cache file made by anything else is rejected
+    VkPhysicalDeviceProperties deviceProperties;
+    vkGetPhysicalDeviceProperties(physicalDevice, &deviceProperties);
+
+    deviceHeader = {};
+    deviceHeader.magic = PIPELINE_CACHE_FILE_MAGIC;
+    deviceHeader.headerVersion = PIPELINE_CACHE_FILE_VERSION;
+    deviceHeader.vendorID = deviceProperties.vendorID;
+    deviceHeader.deviceID = deviceProperties.deviceID;
+    deviceHeader.driverVersion = deviceProperties.driverVersion;
+    memcpy(deviceHeader.pipelineCacheUUID, deviceProperties.pipelineCacheUUID, VK_UUID_SIZE);
+
+    std::vector<char> initialData;
+    warm = !filePath.empty() && load(&initialData);
+
+    // Pipeline cache creation information (starts empty when there's nothing valid to load)
+    VkPipelineCacheCreateInfo pipelineCacheCreateInfo = {};
+    pipelineCacheCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+    pipelineCacheCreateInfo.initialDataSize = warm ? initialData.size() : 0;
+    pipelineCacheCreateInfo.pInitialData = warm ? initialData.data() : nullptr;
+
+    VkResult result = vkCreatePipelineCache(device, &pipelineCacheCreateInfo, nullptr, &cache);
+    if (result != VK_SUCCESS && warm)
+    {
+        // Driver refused the data after all : start from an empty cache, the file gets replaced on destroy()
+        warm = false;
+        pipelineCacheCreateInfo.initialDataSize = 0;
+        pipelineCacheCreateInfo.pInitialData = nullptr;
+        result = vkCreatePipelineCache(device, &pipelineCacheCreateInfo, nullptr, &cache);
+    }
+    if (result != VK_SUCCESS)
+    {
+        throw std::runtime_error("Failed to create a Pipeline Cache !");
+    }
+
+    if (warm)
+        loadedBytes = initialData.size();
+}
+
+void PipelineCache::destroy()
+{
+    if (cache == VK_NULL_HANDLE)
+        return;
+
+    if (!filePath.empty())
+        save();
+
+    vkDestroyPipelineCache(device, cache, nullptr);
+    cache = VK_NULL_HANDLE;
+}
+
+VkPipelineCache PipelineCache::getCache()
+{
+    return cache;
+}
+
+bool PipelineCache::isWarm()
+{
+    return warm;
+}
+
+size_t PipelineCache::getLoadedBytes()
+{
+    return loadedBytes;
+}
+
+bool PipelineCache::load(std::vector<char> * data)
+{
+    // No file yet (first run) is a cold start, not an error
+    std::ifstream file(filePath, std::ios::binary);
+    if (!file.is_open())
+        return false;
+
+    FileHeader fileHeader = {};
+    file.read(reinterpret_cast<char *>(&fileHeader), sizeof(FileHeader));
+    if (!file
+        || fileHeader.magic != deviceHeader.magic
+        || fileHeader.headerVersion != deviceHeader.headerVersion
+        || fileHeader.vendorID != deviceHeader.vendorID
+        || fileHeader.deviceID != deviceHeader.deviceID
+        || fileHeader.driverVersion != deviceHeader.driverVersion
+        || memcmp(fileHeader.pipelineCacheUUID, deviceHeader.pipelineCacheUUID, VK_UUID_SIZE) != 0
+        || fileHeader.dataSize == 0)
+    {
+        return false;
+    }
+
+    data->resize(static_cast<size_t>(fileHeader.dataSize));
+    file.read(data->data(), data->size());
+
+    // Truncated file (crash while writing it)
+    return static_cast<bool>(file);
+}
+
+void PipelineCache::save()
+{
+    // Size first, then the data itself
+    size_t dataSize = 0;
+    if (vkGetPipelineCacheData(device, cache, &dataSize, nullptr) != VK_SUCCESS || dataSize == 0)
+        return;
+
+    std::vector<char> data(dataSize);
+    if (vkGetPipelineCacheData(device, cache, &dataSize, data.data()) != VK_SUCCESS)
+        return;
+
+    FileHeader fileHeader = deviceHeader;
+    fileHeader.dataSize = dataSize;
+
+    // Written next to the old file then swapped in, so an interrupted write never leaves a half cache behind.
+    // A cache that can't be written only costs a cold start next time : no error
+    std::string tempPath = filePath + ".tmp";
+    {
+        std::ofstream file(tempPath, std::ios::binary | std::ios::trunc);
+        if (!file.is_open())
+            return;
+
+        file.write(reinterpret_cast<const char *>(&fileHeader), sizeof(FileHeader));
+        file.write(data.data(), dataSize);
+        if (!file)
+        {
+            file.close();
+            std::remove(tempPath.c_str());
+            return;
+        }
+    }
+
+    std::remove(filePath.c_str());
+    std::rename(tempPath.c_str(), filePath.c_str());
+}
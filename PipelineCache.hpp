@@ -0,0 +1,56 @@
+#pragma once
+
+// GLFW includes
+#define GLFW_INCLUDE_VULKAN
+#include <GLFW/glfw3.h>
+
+// C++ includes
+#include <string>
+#include <vector>
+
+// File the pipeline cache is kept in between runs (next to the executable's working directory)
+const char * const DEFAULT_PIPELINE_CACHE_FILE = "pipeline_cache.bin";
+
+// VkPipelineCache persisted to disk.
+// Pipelines compiled by a run are stored by the driver in the cache, which is written to a file on destroy() and given
+// back to the driver at the next startup : pipelines it already knows are then created without compiling the SPIR-V again.
+// The file starts with the device it was made on (vendor, device, driver version, cache UUID) : a cache from another
+// GPU or driver is ignored instead of being handed to the driver.
+class PipelineCache
+{
+public:
+    PipelineCache();
+    ~PipelineCache();
+
+    // Empty filePath : the cache only lives as long as the renderer
+    void init(VkDevice newDevice, VkPhysicalDevice physicalDevice, const std::string & newFilePath);
+    // Writes the cache file back and destroys the cache
+    void destroy();
+
+    VkPipelineCache getCache();
+    // The cache file was valid for this device and loaded (pipelines should be created without compiling)
+    bool isWarm();
+    size_t getLoadedBytes();
+
+private:
+    // Written before the driver's cache data
+    struct FileHeader {
+        uint32_t magic;
+        uint32_t headerVersion;
+        uint32_t vendorID;
+        uint32_t deviceID;
+        uint32_t driverVersion;
+        uint8_t pipelineCacheUUID[VK_UUID_SIZE];
+        uint64_t dataSize;
+    };
+
+    VkDevice device;
+    VkPipelineCache cache = VK_NULL_HANDLE;
+    std::string filePath;
+    FileHeader deviceHeader;        // Header of this device, what a valid file starts with
+    bool warm = false;
+    size_t loadedBytes = 0;
+
+    bool load(std::vector<char> * data);
+    void save();
+};
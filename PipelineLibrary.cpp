@@ -0,0 +1,420 @@
+#include "PipelineLibrary.hpp"
+
+// Project includes
+#include "Utilities.hpp"
+
+// C++ includes
+#include <stdexcept>
+#include <chrono>
+#include <cstring>
+#include <algorithm>
+
+// FNV-1a, enough to spread descriptions (equal hashes are compared anyway)
+static void hashBytes(uint64_t * hash, const void * data, size_t size)
+{
+    const unsigned char * bytes = static_cast<const unsigned char *>(data);
+    for (size_t i = 0; i < size; ++i)
+    {
+        *hash ^= bytes[i];
+        *hash *= 1099511628211ull;
+    }
+}
+
+bool PipelineDescription::operator==(const PipelineDescription & other) const
+{
+    if (vertexShader != other.vertexShader || fragmentShader != other.fragmentShader
+        || vertexBindings.size() != other.vertexBindings.size() || vertexAttributes.size() != other.vertexAttributes.size()
+        || topology != other.topology || polygonMode != other.polygonMode || cullMode != other.cullMode
+        || frontFace != other.frontFace || depthTest != other.depthTest || depthWrite != other.depthWrite
+        || depthCompareOp != other.depthCompareOp || alphaBlending != other.alphaBlending)
+    {
+        return false;
+    }
+
+    for (size_t i = 0; i < vertexBindings.size(); ++i)
+    {
+        const VkVertexInputBindingDescription & a = vertexBindings[i];
+        const VkVertexInputBindingDescription & b = other.vertexBindings[i];
+        if (a.binding != b.binding || a.stride != b.stride || a.inputRate != b.inputRate)
+            return false;
+    }
+    for (size_t i = 0; i < vertexAttributes.size(); ++i)
+    {
+        const VkVertexInputAttributeDescription & a = vertexAttributes[i];
+        const VkVertexInputAttributeDescription & b = other.vertexAttributes[i];
+        if (a.location != b.location || a.binding != b.binding || a.format != b.format || a.offset != b.offset)
+            return false;
+    }
+    return true;
+}
+
+uint64_t PipelineDescription::hash() const
+{
+    // Field by field : structs may have padding bytes
+    uint64_t hash = 14695981039346656037ull;
+    hashBytes(&hash, vertexShader.data(), vertexShader.size());
+    hashBytes(&hash, fragmentShader.data(), fragmentShader.size());
+    for (const auto & binding : vertexBindings)
+    {
+        hashBytes(&hash, &binding.binding, sizeof(binding.binding));
+        hashBytes(&hash, &binding.stride, sizeof(binding.stride));
+        hashBytes(&hash, &binding.inputRate, sizeof(binding.inputRate));
+    }
+    for (const auto & attribute : vertexAttributes)
+    {
+        hashBytes(&hash, &attribute.location, sizeof(attribute.location));
+        hashBytes(&hash, &attribute.binding, sizeof(attribute.binding));
+        hashBytes(&hash, &attribute.format, sizeof(attribute.format));
+        hashBytes(&hash, &attribute.offset, sizeof(attribute.offset));
+    }
+    hashBytes(&hash, &topology, sizeof(topology));
+    hashBytes(&hash, &polygonMode, sizeof(polygonMode));
+    hashBytes(&hash, &cullMode, sizeof(cullMode));
+    hashBytes(&hash, &frontFace, sizeof(frontFace));
+    hashBytes(&hash, &depthTest, sizeof(depthTest));
+    hashBytes(&hash, &depthWrite, sizeof(depthWrite));
+    hashBytes(&hash, &depthCompareOp, sizeof(depthCompareOp));
+    hashBytes(&hash, &alphaBlending, sizeof(alphaBlending));
+    return hash;
+}
+
+PipelineLibrary::PipelineLibrary()
+{
+}
+
+PipelineLibrary::~PipelineLibrary()
+{
+}
+
+void PipelineLibrary::init(VkDevice newDevice, VkPipelineCache newPipelineCache, VkPipelineLayout newPipelineLayout, VkRenderPass newRenderPass,
+                           uint32_t threadCount)
+{
+    device = newDevice;
+    pipelineCache = newPipelineCache;
+    pipelineLayout = newPipelineLayout;
+    renderPass = newRenderPass;
+
+    stopping = false;
+    for (uint32_t i = 0; i < std::max(1u, threadCount); ++i)
+    {
+        workers.emplace_back(&PipelineLibrary::workerLoop, this);
+    }
+}
+
+void PipelineLibrary::destroy()
+{
+    // Compilations not started yet are dropped, the ones in progress finish first
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+        pendingCompiles.clear();
+    }
+    compileAvailable.notify_all();
+
+    for (auto & worker : workers)
+    {
+        worker.join();
+    }
+    workers.clear();
+
+    for (auto & entry : entries)
+    {
+        if (entry.pipeline != VK_NULL_HANDLE)
+            vkDestroyPipeline(device, entry.pipeline, nullptr);
+    }
+    entries.clear();
+    handlesByHash.clear();
+}
+
+PipelineHandle PipelineLibrary::request(const PipelineDescription & description)
+{
+    uint64_t hash = description.hash();
+
+    std::unique_lock<std::mutex> lock(mutex);
+    ++stats.requested;
+
+    // Same description already requested : same pipeline (ready or not)
+    auto range = handlesByHash.equal_range(hash);
+    for (auto it = range.first; it != range.second; ++it)
+    {
+        if (entries[it->second].description == description)
+        {
+            ++stats.deduplicated;
+            return it->second;
+        }
+    }
+
+    PipelineHandle handle = static_cast<PipelineHandle>(entries.size());
+    entries.emplace_back();
+    entries.back().description = description;
+    handlesByHash.emplace(hash, handle);
+
+    pendingCompiles.push_back(handle);
+    lock.unlock();
+    compileAvailable.notify_one();
+
+    return handle;
+}
+
+bool PipelineLibrary::isReady(PipelineHandle pipeline)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return pipeline < entries.size() && entries[pipeline].state == PipelineState::READY;
+}
+
+VkPipeline PipelineLibrary::getPipeline(PipelineHandle pipeline)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    if (pipeline >= entries.size() || entries[pipeline].state != PipelineState::READY)
+        return VK_NULL_HANDLE;
+
+    return entries[pipeline].pipeline;
+}
+
+void PipelineLibrary::wait(PipelineHandle pipeline)
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    if (pipeline >= entries.size())
+    {
+        throw std::runtime_error("Failed to wait for an unknown pipeline !");
+    }
+
+    compileDone.wait(lock, [&] { return entries[pipeline].state != PipelineState::PENDING; });
+    if (entries[pipeline].state == PipelineState::FAILED)
+    {
+        throw std::runtime_error(entries[pipeline].error);
+    }
+}
+
+PipelineLibraryStats PipelineLibrary::getStats()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return stats;
+}
+
+void PipelineLibrary::workerLoop()
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    while (true)
+    {
+        compileAvailable.wait(lock, [this] { return stopping || !pendingCompiles.empty(); });
+        if (stopping) return;
+
+        PipelineHandle handle = pendingCompiles.front();
+        pendingCompiles.pop_front();
+        const PipelineDescription & description = entries[handle].description;
+
+        // Shader loading and compilation run unlocked : other threads keep requesting and compiling
+        lock.unlock();
+        auto compileStart = std::chrono::steady_clock::now();
+        VkPipeline pipeline = VK_NULL_HANDLE;
+        std::string error;
+        try {
+            pipeline = compile(description);
+        } catch (const std::exception & e) {
+            // Anything thrown (missing file, out of memory...) fails this pipeline only, the thread keeps compiling
+            error = e.what();
+        }
+        double compileMs = elapsedMs(compileStart);
+        lock.lock();
+
+        PipelineEntry & entry = entries[handle];
+        entry.pipeline = pipeline;
+        entry.error = error;
+        entry.state = pipeline != VK_NULL_HANDLE ? PipelineState::READY : PipelineState::FAILED;
+        stats.compileMs += compileMs;
+        if (entry.state == PipelineState::READY)
+            ++stats.compiled;
+        else
+            ++stats.failed;
+
+        compileDone.notify_all();
+    }
+}
+
+VkPipeline PipelineLibrary::compile(const PipelineDescription & description)
+{
+    // Read in SPIR-V code of shaders
+    auto vertexShaderCode = readFile(description.vertexShader);
+    auto fragmentShaderCode = readFile(description.fragmentShader);
+
+    // Build Shader Modules to link to Graphics Pipeline
+    // Nothing below throws until both are destroyed, except the second one : it releases the first one on failure
+    VkShaderModule vertexShaderModule = createShaderModule(vertexShaderCode);
+    VkShaderModule fragmentShaderModule = VK_NULL_HANDLE;
+    try {
+        fragmentShaderModule = createShaderModule(fragmentShaderCode);
+    } catch (...) {
+        vkDestroyShaderModule(device, vertexShaderModule, nullptr);
+        throw;
+    }
+
+    // -- SHADER STAGE CREATION INFO --
+    // Vertex Stage creation information
+    VkPipelineShaderStageCreateInfo vertexShaderCreateInfo = {};
+    vertexShaderCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+    vertexShaderCreateInfo.stage = VK_SHADER_STAGE_VERTEX_BIT;  // Shader stage name
+    vertexShaderCreateInfo.module = vertexShaderModule;         // Shader module to be used by stage
+    vertexShaderCreateInfo.pName = "main";                      // Entry point in the shader
+
+    // Fragment Stage creation information
+    VkPipelineShaderStageCreateInfo fragmentShaderCreateInfo = {};
+    fragmentShaderCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+    fragmentShaderCreateInfo.stage = VK_SHADER_STAGE_FRAGMENT_BIT;  // Shader stage name
+    fragmentShaderCreateInfo.module = fragmentShaderModule;         // Shader module to be used by stage
+    fragmentShaderCreateInfo.pName = "main";                      // Entry point in the shader
+
+    // Put shader stage creation info into array
+    // Graphics Pipeline creation info requires array of shader stage creates
+    VkPipelineShaderStageCreateInfo shaderStages[] = { vertexShaderCreateInfo, fragmentShaderCreateInfo };
+
+    // -- Vertex input --
+    // Bindings : how the data for a single vertex is spaced in each stream, attributes : where each one is in it
+    VkPipelineVertexInputStateCreateInfo vertexInputCreateInfo = {};
+    vertexInputCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
+    vertexInputCreateInfo.vertexBindingDescriptionCount = static_cast<uint32_t>(description.vertexBindings.size());
+    vertexInputCreateInfo.pVertexBindingDescriptions = description.vertexBindings.data();       // List of Vertex Binding Descriptions (data spacing / stride info)
+    vertexInputCreateInfo.vertexAttributeDescriptionCount = static_cast<uint32_t>(description.vertexAttributes.size());
+    vertexInputCreateInfo.pVertexAttributeDescriptions = description.vertexAttributes.data();   // List of Vertex Attribute Descriptions (data format and where to bind/to or from)
+
+    // -- Input assembly --
+    VkPipelineInputAssemblyStateCreateInfo inputAssembly = {};
+    inputAssembly.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
+    inputAssembly.topology = description.topology;                      // Primitive type to assemble vertices as
+    inputAssembly.primitiveRestartEnable = VK_FALSE;                    // Allow overriding of "strip" topology to start new primitives
+
+    // -- Viewport & Scissor --
+    // Both are dynamic (set when recording, see recordViewport) : the pipeline doesn't depend on the swapchain extent
+    // and survives its recreation. Only their count is given here.
+    VkPipelineViewportStateCreateInfo viewportStateCreateInfo = {};
+    viewportStateCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
+    viewportStateCreateInfo.viewportCount = 1;
+    viewportStateCreateInfo.pViewports = nullptr;
+    viewportStateCreateInfo.scissorCount = 1;
+    viewportStateCreateInfo.pScissors = nullptr;
+
+    // -- Dynamic states --
+    // Dynamic states to enable
+    // (fixed array : no allocation while the shader modules are alive)
+    VkDynamicState dynamicStateEnables[] = {
+        VK_DYNAMIC_STATE_VIEWPORT,      // Dynamic viewport : Can resize in command buffer with vkCmdSetViewport(commandBuffer, 0, 1, &viewport)
+        VK_DYNAMIC_STATE_SCISSOR        // Dynamic Scissor  : Can resize in command buffer with vkCmdSetScissor(commandBuffer, 0, 1, &viewport)
+    };
+
+    // Dynamic States creation info
+    VkPipelineDynamicStateCreateInfo dynamicStateCreateInfo = {};
+    dynamicStateCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
+    dynamicStateCreateInfo.dynamicStateCount = static_cast<uint32_t>(sizeof(dynamicStateEnables) / sizeof(dynamicStateEnables[0]));
+    dynamicStateCreateInfo.pDynamicStates = dynamicStateEnables;
+
+    // -- Rasterizer --
+    VkPipelineRasterizationStateCreateInfo rasterizerCreateInfo = {};
+    rasterizerCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
+    rasterizerCreateInfo.depthClampEnable = VK_FALSE; // = VK_TRUE;         // Change if fragments beyoond near/far planes are clipped (default) or clamped to plane
+    rasterizerCreateInfo.rasterizerDiscardEnable = VK_FALSE;                // Whether to discard data and skip rasterizer. Never creates fragments, only suitable for pipeline without framebuffer output.
+    rasterizerCreateInfo.polygonMode = description.polygonMode;             // How to handle filling points between vertices
+    rasterizerCreateInfo.lineWidth = 1.0f;                                  // How thick lines should be when drawn
+    rasterizerCreateInfo.cullMode = description.cullMode;                   // Which face of a tri to cull
+    rasterizerCreateInfo.frontFace = description.frontFace;                 // Winding to determine which size is front
+    rasterizerCreateInfo.depthBiasEnable = VK_FALSE;                        // Whether to add depth bias to fragments (good for stopping "shadow acne" in shadow mapping)
+
+    // -- Multi sampling --
+    VkPipelineMultisampleStateCreateInfo multiSamplingCreateInfo = {};
+    multiSamplingCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
+    multiSamplingCreateInfo.sampleShadingEnable = VK_FALSE;                  // Enable multisample shading or not.
+    multiSamplingCreateInfo.rasterizationSamples = VK_SAMPLE_COUNT_1_BIT;   // Number of samples to use per fragment.
+
+    // -- Blending --
+    // Blending decides how to blend a new color being written to a fragment, with the old value
+
+    // Blend attachment state (how blending is handled)
+    VkPipelineColorBlendAttachmentState colorState = {};
+    colorState.colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT         // Colors to apply landing to
+                              | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
+    colorState.blendEnable = description.alphaBlending ? VK_TRUE : VK_FALSE;    // Enable blending
+
+    // Blending uses equation : (srcColorBlendFactor * new color) colorBlendOp (dstColorBlendFactor * old color)
+    colorState.srcColorBlendFactor = VK_BLEND_FACTOR_SRC_ALPHA;
+    colorState.dstColorBlendFactor = VK_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA;
+    colorState.colorBlendOp = VK_BLEND_OP_ADD;
+
+    // Summarised: (VK_BLEND_FACTOR_SRC_ALPHA * new color) + (VK_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA * old color)
+    //             (new color alpha * new color) + ((1 - new color alpha) * old color)
+
+    colorState.srcAlphaBlendFactor = VK_BLEND_FACTOR_ONE;
+    colorState.dstAlphaBlendFactor = VK_BLEND_FACTOR_ZERO;
+    colorState.alphaBlendOp = VK_BLEND_OP_ADD;
+    // Summarised: (1 * new alpha) + (0 * old alpha) = new alpha
+
+    VkPipelineColorBlendStateCreateInfo colorBlendingStateCreateInfo = {};
+    colorBlendingStateCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
+    colorBlendingStateCreateInfo.logicOpEnable = VK_FALSE;              // Alternative to calculations is to use logical operations
+    colorBlendingStateCreateInfo.attachmentCount = 1;
+    colorBlendingStateCreateInfo.pAttachments = &colorState;
+
+    // -- Depth Stencil Testing
+    VkPipelineDepthStencilStateCreateInfo depthStencilCreateInfo = {};
+    depthStencilCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO;
+    depthStencilCreateInfo.depthTestEnable = description.depthTest ? VK_TRUE : VK_FALSE;     // Enable checking depth to determine fragment write
+    depthStencilCreateInfo.depthWriteEnable = description.depthWrite ? VK_TRUE : VK_FALSE;   // Enable writing to depth buffer (to replace old values)
+    depthStencilCreateInfo.depthCompareOp = description.depthCompareOp;  // Comparison operation that allows an overwrite (is in front)
+    depthStencilCreateInfo.depthBoundsTestEnable = VK_FALSE;    // Depth Bounds Test: Does the depth value exist between two bounds
+    depthStencilCreateInfo.stencilTestEnable = VK_FALSE;        // Enable Stenci Test
+
+    // -- Graphics Pipeline Creation --
+    VkGraphicsPipelineCreateInfo pipelineCreateInfo = {};
+    pipelineCreateInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
+    pipelineCreateInfo.stageCount = 2;                                      // Number of shader stages
+    pipelineCreateInfo.pStages = shaderStages;                              // List of shader stages
+    pipelineCreateInfo.pVertexInputState = &vertexInputCreateInfo;          // All the fixed function pipeline states
+    pipelineCreateInfo.pInputAssemblyState = &inputAssembly;
+    pipelineCreateInfo.pViewportState = &viewportStateCreateInfo;
+    pipelineCreateInfo.pDynamicState = &dynamicStateCreateInfo;
+    pipelineCreateInfo.pRasterizationState = &rasterizerCreateInfo;
+    pipelineCreateInfo.pMultisampleState = &multiSamplingCreateInfo;
+    pipelineCreateInfo.pColorBlendState = &colorBlendingStateCreateInfo;
+    pipelineCreateInfo.pDepthStencilState = &depthStencilCreateInfo;
+    pipelineCreateInfo.layout = pipelineLayout;                             // Pipeline layout pipeline should use
+    pipelineCreateInfo.renderPass = renderPass;                             // Render Pass description the pipeline is compatible with
+    pipelineCreateInfo.subpass = 0;                                         // Subpass of render pass to use with pipeline
+
+    // Pipeline Derivatives : Can Create multiple pipelines that derive from one
+    pipelineCreateInfo.basePipelineHandle = VK_NULL_HANDLE; // Existing pipeline to derive from...
+    pipelineCreateInfo.basePipelineIndex = -1;              // or index of pipeline being created to derive from (in case creating multiple at once)
+
+    // Create graphics pipeline (compiled from the SPIR-V, unless the pipeline cache already has it).
+    // The cache is internally synchronized : every compile thread uses it at the same time
+    VkPipeline pipeline;
+    VkResult result = vkCreateGraphicsPipelines(device, pipelineCache, 1, &pipelineCreateInfo, nullptr, &pipeline);
+
+    // Destroy shader modules, no longer needed after Pipeline created
+    vkDestroyShaderModule(device, fragmentShaderModule, nullptr);
+    vkDestroyShaderModule(device, vertexShaderModule, nullptr);
+
+    if (result != VK_SUCCESS)
+    {
+        throw std::runtime_error("Failed to create a Graphics Pipeline !");
+    }
+
+    return pipeline;
+}
+
+VkShaderModule PipelineLibrary::createShaderModule(const std::vector<char> & code)
+{
+    // Shader Module Create Info
+    VkShaderModuleCreateInfo shaderModuleCreateInfo = {};
+    shaderModuleCreateInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
+    shaderModuleCreateInfo.codeSize = code.size();
+    shaderModuleCreateInfo.pCode = reinterpret_cast<const uint32_t *>(code.data());
+
+    VkShaderModule shaderModule;
+
+    VkResult result = vkCreateShaderModule(device, &shaderModuleCreateInfo, nullptr, &shaderModule);
+
+    if (result != VK_SUCCESS)
+    {
+        throw std::runtime_error("Failed to create a shader module !");
+    }
+
+    return shaderModule;
+}
@@ -0,0 +1,119 @@
+#pragma once
+
+// GLFW includes
+#define GLFW_INCLUDE_VULKAN
+#include <GLFW/glfw3.h>
+
+// C++ includes
+#include <string>
+#include <vector>
+#include <deque>
+#include <unordered_map>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+// Background threads compiling pipelines (pipeline creation is long and independent, it doesn't share the JobSystem workers)
+const uint32_t DEFAULT_PIPELINE_COMPILE_THREADS = 2;
+
+// Identifies a requested pipeline, valid for the library's lifetime
+typedef uint32_t PipelineHandle;
+const PipelineHandle INVALID_PIPELINE = UINT32_MAX;
+
+// Everything a graphics pipeline of the library differs by. The pipeline layout, render pass and dynamic
+// viewport/scissor are shared by every pipeline of the library.
+struct PipelineDescription {
+    std::string vertexShader;       // SPIR-V files
+    std::string fragmentShader;
+
+    // Vertex layout
+    std::vector<VkVertexInputBindingDescription> vertexBindings;
+    std::vector<VkVertexInputAttributeDescription> vertexAttributes;
+    VkPrimitiveTopology topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
+
+    // Raster state
+    VkPolygonMode polygonMode = VK_POLYGON_MODE_FILL;
+    VkCullModeFlags cullMode = VK_CULL_MODE_BACK_BIT;
+    VkFrontFace frontFace = VK_FRONT_FACE_COUNTER_CLOCKWISE;
+
+    // Depth state
+    bool depthTest = true;
+    bool depthWrite = true;
+    VkCompareOp depthCompareOp = VK_COMPARE_OP_LESS;
+
+    // Blend state : alpha blending (src alpha, 1 - src alpha) or straight writes
+    bool alphaBlending = true;
+
+    bool operator==(const PipelineDescription & other) const;
+    uint64_t hash() const;
+};
+
+struct PipelineLibraryStats {
+    uint32_t requested = 0;         // request() calls
+    uint32_t deduplicated = 0;      // Requests answered with an existing pipeline
+    uint32_t compiled = 0;          // Pipelines created
+    uint32_t failed = 0;
+    double compileMs = 0.0;         // Time spent by the compile threads, all pipelines together
+};
+
+// Pipeline library service.
+// Pipelines are requested by description : identical descriptions (same hash, then compared) share one pipeline,
+// new ones are compiled on background threads. The handle resolves once its pipeline is ready, callers keep
+// drawing with a pipeline they already have until then, so new content never stalls a frame on a compilation.
+class PipelineLibrary
+{
+public:
+    PipelineLibrary();
+    ~PipelineLibrary();
+
+    void init(VkDevice newDevice, VkPipelineCache newPipelineCache, VkPipelineLayout newPipelineLayout, VkRenderPass newRenderPass,
+              uint32_t threadCount = DEFAULT_PIPELINE_COMPILE_THREADS);
+    // Waits for the compilations in progress, destroys every pipeline
+    void destroy();
+
+    // Returns at once, the pipeline is compiled in the background (or already exists)
+    PipelineHandle request(const PipelineDescription & description);
+
+    bool isReady(PipelineHandle pipeline);
+    // VK_NULL_HANDLE until the pipeline is ready (or if its compilation failed)
+    VkPipeline getPipeline(PipelineHandle pipeline);
+    // Blocks until the pipeline is compiled, throws if its compilation failed
+    void wait(PipelineHandle pipeline);
+
+    PipelineLibraryStats getStats();
+
+private:
+    enum class PipelineState {
+        PENDING,
+        READY,
+        FAILED
+    };
+
+    struct PipelineEntry {
+        PipelineDescription description;    // Never changes once added, read by the compile threads without locking
+        PipelineState state = PipelineState::PENDING;
+        VkPipeline pipeline = VK_NULL_HANDLE;
+        std::string error;
+    };
+
+    VkDevice device;
+    VkPipelineCache pipelineCache;
+    VkPipelineLayout pipelineLayout;
+    VkRenderPass renderPass;
+
+    std::deque<PipelineEntry> entries;      // Indexed by handle (deque : entries don't move when new ones are added)
+    std::unordered_multimap<uint64_t, PipelineHandle> handlesByHash;
+    PipelineLibraryStats stats;
+
+    // - Compile Threads
+    std::vector<std::thread> workers;
+    std::mutex mutex;
+    std::condition_variable compileAvailable;   // Workers wait for a request (or destroy)
+    std::condition_variable compileDone;        // wait() waits for its pipeline
+    std::deque<PipelineHandle> pendingCompiles;
+    bool stopping = false;
+
+    void workerLoop();
+    VkPipeline compile(const PipelineDescription & description);
+    VkShaderModule createShaderModule(const std::vector<char> & code);
+};
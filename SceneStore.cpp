@@ -0,0 +1,273 @@
+#include "SceneStore.hpp"
+
+// C++ includes
+#include <algorithm>
+#include <stdexcept>
+
+// Matrix products use SSE on any x86-64 CPU, glm's own operator otherwise
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+    #include <xmmintrin.h>
+    #define SCENE_STORE_SSE
+#endif
+
+// result = a * b, column major : column j of the result is a's columns weighted by column j of b
+static void multiplyMatrices(const glm::mat4 & a, const glm::mat4 & b, glm::mat4 * result)
+{
+#if defined(SCENE_STORE_SSE)
+    __m128 a0 = _mm_loadu_ps(&a[0][0]);
+    __m128 a1 = _mm_loadu_ps(&a[1][0]);
+    __m128 a2 = _mm_loadu_ps(&a[2][0]);
+    __m128 a3 = _mm_loadu_ps(&a[3][0]);
+    for (int j = 0; j < 4; ++j)
+    {
+        __m128 column = _mm_add_ps(_mm_mul_ps(a0, _mm_set1_ps(b[j][0])), _mm_mul_ps(a1, _mm_set1_ps(b[j][1])));
+        column = _mm_add_ps(column, _mm_add_ps(_mm_mul_ps(a2, _mm_set1_ps(b[j][2])), _mm_mul_ps(a3, _mm_set1_ps(b[j][3]))));
+        _mm_storeu_ps(&(*result)[j][0], column);
+    }
+#else
+    *result = a * b;
+#endif
+}
+
+SceneStore::SceneStore()
+{
+}
+
+SceneStore::~SceneStore()
+{
+}
+
+uint32_t SceneStore::addObjects(uint32_t mesh, glm::vec4 meshBounds, const VertexDequantization & dequantization,
+                                const std::vector<Model> & instances)
+{
+    uint32_t firstObject = static_cast<uint32_t>(objectData.size());
+
+    objectData.insert(objectData.end(), instances.begin(), instances.end());
+    worldTransforms.resize(objectData.size());
+    localBounds.insert(localBounds.end(), instances.size(), meshBounds);
+    dequantizations.insert(dequantizations.end(), instances.size(), dequantization);
+    meshes.insert(meshes.end(), instances.size(), mesh);
+    parents.resize(objectData.size(), NO_PARENT);
+    localTransforms.reserve(objectData.size());
+    dirty.resize(objectData.size(), 0);
+    for (uint32_t object = firstObject; object < objectData.size(); ++object)
+    {
+        localTransforms.push_back(objectData[object].model);
+        markDirty(object);
+    }
+    hierarchyChanged = true;
+
+    return firstObject;
+}
+
+size_t SceneStore::size()
+{
+    return objectData.size();
+}
+
+bool SceneStore::empty()
+{
+    return objectData.empty();
+}
+
+void SceneStore::setTransform(uint32_t object, const glm::mat4 & transform)
+{
+    localTransforms[object] = transform;
+    markDirty(object);
+}
+
+void SceneStore::setTransforms(const uint32_t * objects, const glm::mat4 * transforms, size_t count)
+{
+    for (size_t i = 0; i < count; ++i)
+    {
+        localTransforms[objects[i]] = transforms[i];
+        markDirty(objects[i]);
+    }
+}
+
+void SceneStore::setObject(uint32_t object, const Model & model)
+{
+    localTransforms[object] = model.model;
+    objectData[object].color = model.color;
+    markDirty(object);
+}
+
+void SceneStore::setParent(uint32_t object, uint32_t parent)
+{
+    for (uint32_t ancestor = parent; ancestor != NO_PARENT; ancestor = parents[ancestor])
+    {
+        if (ancestor == object)
+        {
+            throw std::runtime_error("Failed to set an object's parent, it would be its own ancestor !");
+        }
+    }
+
+    parents[object] = parent;
+    hierarchyChanged = true;
+    markDirty(object);
+}
+
+uint32_t SceneStore::getParent(uint32_t object)
+{
+    return parents[object];
+}
+
+void SceneStore::updateWorld(FrustumCuller * worldBounds, JobSystem * jobSystem)
+{
+    if (dirtyObjects.empty()) return;
+
+    if (hierarchyChanged)
+        sortByDepth();
+
+    if (levelStarts.size() <= 2)
+    {
+        // Every object is a root : only the listed ones change
+        forEachRange(jobSystem, dirtyObjects.size(), [&](size_t begin, size_t end) {
+            for (size_t i = begin; i < end; ++i)
+            {
+                updateObject(dirtyObjects[i], worldBounds);
+                dirty[dirtyObjects[i]] = 0;
+            }
+        });
+    }
+    else
+    {
+        // Level by level from the shallowest changed object : parents are done before their children,
+        // and an object changes when it was set or its parent changed (so whole dirty subtrees, and nothing else)
+        uint32_t firstLevel = UINT32_MAX;
+        for (uint32_t object : dirtyObjects)
+        {
+            firstLevel = std::min(firstLevel, depths[object]);
+        }
+
+        for (size_t level = firstLevel; level + 1 < levelStarts.size(); ++level)
+        {
+            size_t levelStart = levelStarts[level];
+            forEachRange(jobSystem, levelStarts[level + 1] - levelStart, [&](size_t begin, size_t end) {
+                for (size_t i = levelStart + begin; i < levelStart + end; ++i)
+                {
+                    uint32_t object = updateOrder[i];
+                    uint32_t parent = parents[object];
+                    if (!dirty[object] && (parent == NO_PARENT || !dirty[parent]))
+                        continue;
+
+                    dirty[object] = 1;
+                    updateObject(object, worldBounds);
+                }
+            });
+        }
+        std::fill(dirty.begin(), dirty.end(), 0);
+    }
+
+    dirtyObjects.clear();
+}
+
+const Model * SceneStore::getObjectData()
+{
+    return objectData.data();
+}
+
+const Model & SceneStore::getObject(uint32_t object)
+{
+    return objectData[object];
+}
+
+uint32_t SceneStore::getMesh(uint32_t object)
+{
+    return meshes[object];
+}
+
+void SceneStore::markDirty(uint32_t object)
+{
+    // Listed once, however many times it changes before the next update
+    if (dirty[object]) return;
+
+    dirty[object] = 1;
+    dirtyObjects.push_back(object);
+}
+
+void SceneStore::sortByDepth()
+{
+    // Depth of every object : walk up to the first ancestor with a known depth, then back down the path
+    const uint32_t unknownDepth = UINT32_MAX;
+    depths.assign(objectData.size(), unknownDepth);
+    std::vector<uint32_t> path;
+    uint32_t depthCount = 0;
+    for (uint32_t object = 0; object < objectData.size(); ++object)
+    {
+        uint32_t current = object;
+        while (current != NO_PARENT && depths[current] == unknownDepth)
+        {
+            path.push_back(current);
+            current = parents[current];
+        }
+
+        uint32_t depth = current == NO_PARENT ? 0 : depths[current] + 1;
+        for (auto it = path.rbegin(); it != path.rend(); ++it, ++depth)
+        {
+            depths[*it] = depth;
+        }
+        depthCount = std::max(depthCount, depth);
+        path.clear();
+    }
+
+    // Counting sort by depth, objects of a level stay in slot order
+    levelStarts.assign(depthCount + 1, 0);
+    for (uint32_t depth : depths)
+    {
+        levelStarts[depth + 1]++;
+    }
+    for (size_t level = 1; level < levelStarts.size(); ++level)
+    {
+        levelStarts[level] += levelStarts[level - 1];
+    }
+
+    updateOrder.resize(objectData.size());
+    std::vector<size_t> levelEnds(levelStarts.begin(), levelStarts.end() - 1);
+    for (uint32_t object = 0; object < objectData.size(); ++object)
+    {
+        updateOrder[levelEnds[depths[object]]++] = object;
+    }
+
+    hierarchyChanged = false;
+}
+
+void SceneStore::updateObject(uint32_t object, FrustumCuller * worldBounds)
+{
+    glm::mat4 & world = worldTransforms[object];
+    if (parents[object] == NO_PARENT)
+        world = localTransforms[object];
+    else
+        multiplyMatrices(worldTransforms[parents[object]], localTransforms[object], &world);
+
+    // Shaders get stored positions : world * translate(offset) * scale(scale) brings them to world space.
+    // (scale the axes, move the origin, no full matrix product)
+    const VertexDequantization & dequantization = dequantizations[object];
+    glm::mat4 & objectModel = objectData[object].model;
+    objectModel[0] = world[0] * dequantization.scale.x;
+    objectModel[1] = world[1] * dequantization.scale.y;
+    objectModel[2] = world[2] * dequantization.scale.z;
+    objectModel[3] = world * glm::vec4(dequantization.offset, 1.0f);
+
+    if (worldBounds == nullptr) return;
+
+    // World bounding sphere : model space sphere moved by the model, radius scaled by its biggest axis scale
+    glm::vec4 bounds = localBounds[object];
+    float scale = std::max(glm::length(glm::vec3(world[0])), std::max(glm::length(glm::vec3(world[1])), glm::length(glm::vec3(world[2]))));
+    worldBounds->setBounds(object, glm::vec3(world * glm::vec4(glm::vec3(bounds), 1.0f)), bounds.w * scale);
+}
+
+void SceneStore::forEachRange(JobSystem * jobSystem, size_t count, const std::function<void(size_t, size_t)> & work)
+{
+    size_t jobCount = jobSystem == nullptr ? 1 : std::min<size_t>(jobSystem->getThreadCount(), count / MIN_OBJECTS_PER_TRANSFORM_JOB);
+    if (jobCount <= 1)
+    {
+        work(0, count);
+        return;
+    }
+
+    // Contiguous slices : neighbouring objects (and their cache lines) stay on the same thread
+    jobSystem->dispatch(static_cast<uint32_t>(jobCount), [&](uint32_t job) {
+        work(count * job / jobCount, count * (job + 1) / jobCount);
+    });
+}
@@ -0,0 +1,80 @@
+#pragma once
+
+// Project includes
+#include "Mesh.hpp"
+#include "FrustumCuller.hpp"
+#include "JobSystem.hpp"
+
+// C++ includes
+#include <vector>
+#include <functional>
+
+// Parent of a root object
+const uint32_t NO_PARENT = UINT32_MAX;
+
+// Below this many objects per thread, world matrices are computed inline on the calling thread
+const size_t MIN_OBJECTS_PER_TRANSFORM_JOB = 4096;
+
+// Components of every scene object (mesh instance), in object slot order.
+// Each component lives in its own contiguous array instead of inside the meshes. The object data (world matrix + color)
+// is kept in the layout the shaders read, so uploading every transform is a single memcpy. Its matrix also dequantizes
+// the mesh's stored vertices (world * dequantization), the plain world matrix is kept aside for the children.
+// Objects can have a parent : their transform is then relative to the parent's world matrix.
+// Transform changes are only recorded by the setters, updateWorld() applies them all at once.
+class SceneStore
+{
+public:
+    SceneStore();
+    ~SceneStore();
+
+    // Adds the instances of a mesh (localBounds = its model space bounding sphere, dequantization = how its vertices are stored),
+    // returns the first object id
+    uint32_t addObjects(uint32_t mesh, glm::vec4 localBounds, const VertexDequantization & dequantization,
+                        const std::vector<Model> & instances);
+
+    size_t size();
+    bool empty();
+
+    void setTransform(uint32_t object, const glm::mat4 & transform);
+    void setTransforms(const uint32_t * objects, const glm::mat4 * transforms, size_t count);
+    void setObject(uint32_t object, const Model & model);
+
+    // parent = NO_PARENT detaches the object, throws if the object would become its own ancestor
+    void setParent(uint32_t object, uint32_t parent);
+    uint32_t getParent(uint32_t object);
+
+    // Computes the world matrix of the objects changed since the last call and of their descendants,
+    // and their world bounding sphere in worldBounds (can be null). Big updates are split across jobSystem (can be null).
+    void updateWorld(FrustumCuller * worldBounds, JobSystem * jobSystem);
+
+    // Object data of every object, what the shaders read
+    const Model * getObjectData();
+    const Model & getObject(uint32_t object);
+    uint32_t getMesh(uint32_t object);
+
+private:
+    std::vector<glm::mat4> localTransforms;
+    std::vector<glm::mat4> worldTransforms;
+    std::vector<Model> objectData;          // World matrix (with the dequantization) + color
+    std::vector<VertexDequantization> dequantizations;
+    std::vector<glm::vec4> localBounds;     // Bounding sphere of the object's mesh (center, radius)
+    std::vector<uint32_t> meshes;           // Mesh the object is an instance of
+    std::vector<uint32_t> parents;
+
+    // Objects sorted by depth (breadth first) : every parent comes before its children, so one linear pass
+    // updates the whole hierarchy. Level d is updateOrder[levelStarts[d]] ... updateOrder[levelStarts[d + 1] - 1].
+    std::vector<uint32_t> depths;
+    std::vector<uint32_t> updateOrder;
+    std::vector<size_t> levelStarts;
+    bool hierarchyChanged = false;
+
+    std::vector<uint32_t> dirtyObjects;     // Changed since the last updateWorld()
+    std::vector<uint8_t> dirty;
+
+    void markDirty(uint32_t object);
+    void sortByDepth();
+    void updateObject(uint32_t object, FrustumCuller * worldBounds);
+
+    // Runs work(begin, end) over [0, count), in parallel jobs when count is big enough
+    void forEachRange(JobSystem * jobSystem, size_t count, const std::function<void(size_t, size_t)> & work);
+};
@@ -1,2 +1,6 @@
 D:\Vulkan\1.2.162.0\Bin\glslangValidator.exe -V shader1.frag -o shader1_frag.spv
-D:\Vulkan\1.2.162.0\Bin\glslangValidator.exe -V shader1.vert -o shader1_vert.spv
\ No newline at end of file
+D:\Vulkan\1.2.162.0\Bin\glslangValidator.exe -V shader1.vert -o shader1_vert.spv
+D:\Vulkan\1.2.162.0\Bin\glslangValidator.exe -V shader4.vert -o shader4_vert.spv
+D:\Vulkan\1.2.162.0\Bin\glslangValidator.exe -V shader5.vert -o shader5_vert.spv
+D:\Vulkan\1.2.162.0\Bin\glslangValidator.exe -V shader6.vert -o shader6_vert.spv
+D:\Vulkan\1.2.162.0\Bin\glslangValidator.exe -V cull.comp -o cull_comp.spv
\ No newline at end of file
@@ -8,13 +8,9 @@ layout(binding = 0) uniform UboViewProjection {
 	mat4 view;
 } uboViewProjection;
 
-// Not in use, left for reference
-layout(binding = 1) uniform UboModel {
-	mat4 model;
-} uboModel;
-
 layout(push_constant) uniform PushModel {
 	mat4 model;
+	vec4 color;
 } pushModel;
 
 layout(location = 0) out vec3 fragCol;
@@ -22,5 +18,5 @@ layout(location = 0) out vec3 fragCol;
 void main() {
 	gl_Position = uboViewProjection.projection * uboViewProjection.view * pushModel.model * vec4(pos, 1.0);
 	
-	fragCol = col;
+	fragCol = col * pushModel.color.rgb;
 }
\ No newline at end of file
@@ -0,0 +1,23 @@
+#version 450 		// Use GLSL 4.5
+
+layout(location = 0) in vec3 pos;
+layout(location = 1) in vec3 col;
+
+layout(binding = 0) uniform UboViewProjection {
+	mat4 projection;
+	mat4 view;
+} uboViewProjection;
+
+// Model of the object being drawn, selected per draw with a dynamic offset
+layout(binding = 1) uniform UboModel {
+	mat4 model;
+	vec4 color;
+} uboModel;
+
+layout(location = 0) out vec3 fragCol;
+
+void main() {
+	gl_Position = uboViewProjection.projection * uboViewProjection.view * uboModel.model * vec4(pos, 1.0);
+	
+	fragCol = col * uboModel.color.rgb;
+}
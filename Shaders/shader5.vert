@@ -0,0 +1,27 @@
+#version 450 		// Use GLSL 4.5
+
+layout(location = 0) in vec3 pos;
+layout(location = 1) in vec3 col;
+
+layout(binding = 0) uniform UboViewProjection {
+	mat4 projection;
+	mat4 view;
+} uboViewProjection;
+
+struct ObjectModel {
+	mat4 model;
+	vec4 color;
+};
+
+// Data of every object, a draw's instances read the objects from its firstInstance on
+layout(std430, binding = 1) readonly buffer ObjectModels {
+	ObjectModel objects[];
+} objectModels;
+
+layout(location = 0) out vec3 fragCol;
+
+void main() {
+	gl_Position = uboViewProjection.projection * uboViewProjection.view * objectModels.objects[gl_InstanceIndex].model * vec4(pos, 1.0);
+	
+	fragCol = col * objectModels.objects[gl_InstanceIndex].color.rgb;
+}
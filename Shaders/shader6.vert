@@ -0,0 +1,33 @@
+#version 450 		// Use GLSL 4.5
+
+layout(location = 0) in vec3 pos;
+layout(location = 1) in vec3 col;
+
+layout(binding = 0) uniform UboViewProjection {
+	mat4 projection;
+	mat4 view;
+} uboViewProjection;
+
+struct ObjectModel {
+	mat4 model;
+	vec4 color;
+};
+
+layout(std430, binding = 1) readonly buffer ObjectModels {
+	ObjectModel objects[];
+} objectModels;
+
+// Written by the cull compute pass : visible objects packed per mesh, a draw's instances read them from its firstInstance on
+layout(std430, binding = 2) readonly buffer VisibleObjects {
+	uint indices[];
+} visibleObjects;
+
+layout(location = 0) out vec3 fragCol;
+
+void main() {
+	ObjectModel object = objectModels.objects[visibleObjects.indices[gl_InstanceIndex]];
+
+	gl_Position = uboViewProjection.projection * uboViewProjection.view * object.model * vec4(pos, 1.0);
+	
+	fragCol = col * object.color.rgb;
+}
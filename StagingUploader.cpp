@@ -0,0 +1,415 @@
+#include "StagingUploader.hpp"
+
+// Project includes
+#include "Utilities.hpp"
+
+// C++ includes
+#include <stdexcept>
+#include <algorithm>
+#include <cstring>
+
+StagingUploader::StagingUploader()
+{
+}
+
+StagingUploader::~StagingUploader()
+{
+}
+
+void StagingUploader::init(VkDevice newDevice, MemoryAllocator * newAllocator, UploadQueue newTransferQueue, UploadQueue newGraphicsQueue,
+                           VkDeviceSize newRingSize)
+{
+    device = newDevice;
+    allocator = newAllocator;
+    transferQueue = newTransferQueue;
+    graphicsQueue = newGraphicsQueue;
+    ownershipTransfer = transferQueue.family != graphicsQueue.family;
+    completionTimeline = ownershipTransfer ? graphicsQueue.timeline : transferQueue.timeline;
+    ringSize = newRingSize;
+
+    // Staging ring is created and mapped once, then reused by every upload
+    createBuffer(device, allocator, ringSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+                 VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+                 &stagingBuffer, &stagingBufferMemory);
+    stagingData = static_cast<char *>(allocator->map(stagingBufferMemory));
+
+    // One command buffer per batch
+    std::array<VkCommandBuffer, MAX_UPLOAD_BATCHES> commandBuffers;
+
+    VkCommandBufferAllocateInfo allocInfo = {};
+    allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+    allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+    allocInfo.commandPool = transferQueue.commandPool;
+    allocInfo.commandBufferCount = static_cast<uint32_t>(commandBuffers.size());
+
+    VkResult result = vkAllocateCommandBuffers(device, &allocInfo, commandBuffers.data());
+    if (result != VK_SUCCESS)
+    {
+        throw std::runtime_error("Failed to allocate upload Command Buffers !");
+    }
+
+    // Ownership transfer also needs an acquire command buffer on the graphics queue and a semaphore between both sides
+    std::array<VkCommandBuffer, MAX_UPLOAD_BATCHES> acquireCommandBuffers = {};
+    if (ownershipTransfer)
+    {
+        allocInfo.commandPool = graphicsQueue.commandPool;
+        result = vkAllocateCommandBuffers(device, &allocInfo, acquireCommandBuffers.data());
+        if (result != VK_SUCCESS)
+        {
+            throw std::runtime_error("Failed to allocate upload acquire Command Buffers !");
+        }
+    }
+
+    VkSemaphoreCreateInfo semaphoreCreateInfo = {};
+    semaphoreCreateInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+
+    for (size_t i = 0; i < batches.size(); ++i)
+    {
+        batches[i].commandBuffer = commandBuffers[i];
+        batches[i].acquireCommandBuffer = acquireCommandBuffers[i];
+        if (ownershipTransfer && vkCreateSemaphore(device, &semaphoreCreateInfo, nullptr, &batches[i].transferComplete) != VK_SUCCESS)
+        {
+            throw std::runtime_error("Failed to create an upload Semaphore !");
+        }
+    }
+}
+
+void StagingUploader::destroy()
+{
+    // Make sure no copy still reads from the ring
+    flush();
+    waitIdle();
+
+    for (auto & batch : batches)
+    {
+        vkFreeCommandBuffers(device, transferQueue.commandPool, 1, &batch.commandBuffer);
+        if (ownershipTransfer)
+        {
+            vkFreeCommandBuffers(device, graphicsQueue.commandPool, 1, &batch.acquireCommandBuffer);
+            vkDestroySemaphore(device, batch.transferComplete, nullptr);
+        }
+    }
+
+    allocator->unmap(stagingBufferMemory);
+    vkDestroyBuffer(device, stagingBuffer, nullptr);
+    allocator->free(stagingBufferMemory);
+}
+
+UploadToken StagingUploader::uploadBuffer(const void * data, VkDeviceSize size, VkBuffer dstBuffer, VkDeviceSize dstOffset)
+{
+    // Big uploads are split so a single copy never needs the whole ring
+    const VkDeviceSize maxChunkSize = ringSize / 4;
+
+    VkDeviceSize copied = 0;
+    while (copied < size)
+    {
+        VkDeviceSize chunkSize = std::min(size - copied, maxChunkSize);
+
+        // Reserve ring space first (may submit the current batch to make room)
+        VkDeviceSize ringBytes = 0;
+        VkDeviceSize ringOffset = allocateRing(chunkSize, &ringBytes);
+
+        UploadBatch & batch = beginBatch();
+        batch.ringBytes += ringBytes;
+
+        // Write data to the ring, GPU copies it into the destination buffer
+        memcpy(stagingData + ringOffset, static_cast<const char *>(data) + copied, static_cast<size_t>(chunkSize));
+
+        VkBufferCopy bufferCopyRegion = {};
+        bufferCopyRegion.srcOffset = ringOffset;
+        bufferCopyRegion.dstOffset = dstOffset + copied;
+        bufferCopyRegion.size = chunkSize;
+        vkCmdCopyBuffer(batch.commandBuffer, stagingBuffer, dstBuffer, 1, &bufferCopyRegion);
+
+        // Range is written by the transfer family, it has to be released to the graphics family once copied
+        if (ownershipTransfer)
+        {
+            VkBufferMemoryBarrier ownershipBarrier = {};
+            ownershipBarrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+            ownershipBarrier.srcQueueFamilyIndex = transferQueue.family;
+            ownershipBarrier.dstQueueFamilyIndex = graphicsQueue.family;
+            ownershipBarrier.buffer = dstBuffer;
+            ownershipBarrier.offset = bufferCopyRegion.dstOffset;
+            ownershipBarrier.size = chunkSize;
+            batch.ownershipBarriers.push_back(ownershipBarrier);
+        }
+
+        copied += chunkSize;
+        ++stats.copyCount;
+    }
+    stats.bytesUploaded += size;
+
+    return lastToken;
+}
+
+UploadToken StagingUploader::flush()
+{
+    if (recordingBatch < 0)
+        return lastToken;
+
+    UploadBatch & batch = batches[recordingBatch];
+
+    if (ownershipTransfer)
+    {
+        // Release : access masks of the destination side are ignored, the acquire barrier makes the data visible
+        for (auto & ownershipBarrier : batch.ownershipBarriers)
+        {
+            ownershipBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+            ownershipBarrier.dstAccessMask = 0;
+        }
+        vkCmdPipelineBarrier(batch.commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0,
+            0, nullptr, static_cast<uint32_t>(batch.ownershipBarriers.size()), batch.ownershipBarriers.data(), 0, nullptr);
+    }
+    else
+    {
+        // Make the copied data visible to every later command on the queue (vertex input, shaders, indirect...)
+        VkMemoryBarrier memoryBarrier = {};
+        memoryBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+        memoryBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+        memoryBarrier.dstAccessMask = VK_ACCESS_MEMORY_READ_BIT;
+        vkCmdPipelineBarrier(batch.commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, 0,
+            1, &memoryBarrier, 0, nullptr, 0, nullptr);
+    }
+
+    VkResult result = vkEndCommandBuffer(batch.commandBuffer);
+    if (result != VK_SUCCESS)
+    {
+        throw std::runtime_error("Failed to stop recording an upload Command Buffer !");
+    }
+
+    // Queue submission infos
+    VkSubmitInfo submitInfo = {};
+    submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+    submitInfo.commandBufferCount = 1;
+    submitInfo.pCommandBuffers = &batch.commandBuffer;
+
+    // Submit every copy of the batch at once, its timeline value tells when the ring space can be reused
+    // (with an ownership transfer, it's the value of the acquire submit that runs after the copies)
+    if (ownershipTransfer)
+    {
+        submitInfo.signalSemaphoreCount = 1;
+        submitInfo.pSignalSemaphores = &batch.transferComplete;
+    }
+
+    batch.submitValue = transferQueue.timeline->submit(submitInfo);
+    ++stats.submitCount;
+
+    if (ownershipTransfer)
+        submitOwnershipTransfer(batch);
+
+    batch.submitted = true;
+    recordingBatch = -1;
+
+    return batch.token;
+}
+
+bool StagingUploader::hasPendingUploads()
+{
+    return recordingBatch >= 0;
+}
+
+bool StagingUploader::isComplete(UploadToken token)
+{
+    retireBatches(false);
+    return token <= completedToken;
+}
+
+void StagingUploader::wait(UploadToken token)
+{
+    // Copies still being recorded have to be submitted before they can be waited on
+    if (recordingBatch >= 0 && batches[recordingBatch].token <= token)
+        flush();
+
+    retireBatches(false);
+    while (completedToken < token)
+    {
+        UploadToken previousToken = completedToken;
+        retireBatches(true);
+
+        // Nothing left in flight, token was never handed out
+        if (previousToken == completedToken)
+            break;
+    }
+}
+
+void StagingUploader::waitIdle()
+{
+    wait(lastToken);
+}
+
+StagingUploaderStats StagingUploader::getStats()
+{
+    return stats;
+}
+
+VkDeviceSize StagingUploader::allocateRing(VkDeviceSize size, VkDeviceSize * ringBytes)
+{
+    // Copy offsets are kept 16 bytes aligned, enough for every vertex/index/uniform element
+    const VkDeviceSize alignment = 16;
+
+    while (true)
+    {
+        // Ring is empty, restart from the beginning to keep big free ranges
+        if (ringUsed == 0)
+            ringHead = 0;
+
+        VkDeviceSize alignedHead = (ringHead + alignment - 1) & ~(alignment - 1);
+        VkDeviceSize offset;
+        VkDeviceSize needed;
+
+        if (alignedHead + size <= ringSize)
+        {
+            // Fits after the head
+            offset = alignedHead;
+            needed = alignedHead - ringHead + size;
+        }
+        else
+        {
+            // Wrap around, the end of the ring is skipped
+            offset = 0;
+            needed = ringSize - ringHead + size;
+        }
+
+        if (ringUsed + needed <= ringSize)
+        {
+            ringHead = offset + size;
+            ringUsed += needed;
+            *ringBytes = needed;
+            return offset;
+        }
+
+        // Ring is full : submit what's recorded and wait for the oldest batch to give its space back
+        flush();
+        UploadToken previousToken = completedToken;
+        retireBatches(true);
+        ++stats.stallCount;
+
+        if (previousToken == completedToken)
+        {
+            throw std::runtime_error("Staging ring is too small for upload !");
+        }
+    }
+}
+
+StagingUploader::UploadBatch & StagingUploader::beginBatch()
+{
+    if (recordingBatch >= 0)
+        return batches[recordingBatch];
+
+    // Find a free batch, waiting for the oldest one if they are all in flight
+    while (true)
+    {
+        for (size_t i = 0; i < batches.size(); ++i)
+        {
+            if (batches[i].token == 0)
+            {
+                recordingBatch = static_cast<int>(i);
+                break;
+            }
+        }
+
+        if (recordingBatch >= 0)
+            break;
+
+        retireBatches(true);
+        ++stats.stallCount;
+    }
+
+    UploadBatch & batch = batches[recordingBatch];
+    batch.token = ++lastToken;
+    batch.ringBytes = 0;
+    batch.ownershipBarriers.clear();
+    batch.submitted = false;
+
+    // Information to begin the command buffer record
+    VkCommandBufferBeginInfo beginInfo = {};
+    beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT; // Each batch is submitted only once
+
+    VkResult result = vkBeginCommandBuffer(batch.commandBuffer, &beginInfo);
+    if (result != VK_SUCCESS)
+    {
+        throw std::runtime_error("Failed to start recording an upload Command Buffer !");
+    }
+
+    return batch;
+}
+
+void StagingUploader::submitOwnershipTransfer(UploadBatch & batch)
+{
+    // Acquire : same ranges and families as the release, the data is now visible to the graphics family
+    for (auto & ownershipBarrier : batch.ownershipBarriers)
+    {
+        ownershipBarrier.srcAccessMask = 0;
+        ownershipBarrier.dstAccessMask = VK_ACCESS_MEMORY_READ_BIT;
+    }
+
+    VkCommandBufferBeginInfo beginInfo = {};
+    beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+
+    VkResult result = vkBeginCommandBuffer(batch.acquireCommandBuffer, &beginInfo);
+    if (result != VK_SUCCESS)
+    {
+        throw std::runtime_error("Failed to start recording an upload acquire Command Buffer !");
+    }
+
+    vkCmdPipelineBarrier(batch.acquireCommandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, 0,
+        0, nullptr, static_cast<uint32_t>(batch.ownershipBarriers.size()), batch.ownershipBarriers.data(), 0, nullptr);
+
+    result = vkEndCommandBuffer(batch.acquireCommandBuffer);
+    if (result != VK_SUCCESS)
+    {
+        throw std::runtime_error("Failed to stop recording an upload acquire Command Buffer !");
+    }
+
+    // Wait for the copies on the transfer queue, every later graphics submit is ordered after this one
+    VkPipelineStageFlags waitStage = VK_PIPELINE_STAGE_ALL_COMMANDS_BIT;
+
+    VkSubmitInfo submitInfo = {};
+    submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+    submitInfo.waitSemaphoreCount = 1;
+    submitInfo.pWaitSemaphores = &batch.transferComplete;
+    submitInfo.pWaitDstStageMask = &waitStage;
+    submitInfo.commandBufferCount = 1;
+    submitInfo.pCommandBuffers = &batch.acquireCommandBuffer;
+
+    batch.submitValue = graphicsQueue.timeline->submit(submitInfo);
+    ++stats.submitCount;
+    stats.ownershipTransfers += static_cast<uint32_t>(batch.ownershipBarriers.size());
+}
+
+void StagingUploader::retireBatches(bool waitOldest)
+{
+    // Batches are retired in token order so the ring space is always given back from its tail
+    while (true)
+    {
+        UploadBatch * oldest = nullptr;
+        for (auto & batch : batches)
+        {
+            if (batch.submitted && (oldest == nullptr || batch.token < oldest->token))
+                oldest = &batch;
+        }
+
+        if (oldest == nullptr)
+            return;
+
+        if (waitOldest)
+        {
+            completionTimeline->wait(oldest->submitValue);
+            waitOldest = false;
+        }
+        else if (!completionTimeline->isComplete(oldest->submitValue))
+        {
+            return;
+        }
+
+        completedToken = oldest->token;
+        ringUsed -= oldest->ringBytes;
+
+        oldest->token = 0;
+        oldest->ringBytes = 0;
+        oldest->submitValue = 0;
+        oldest->submitted = false;
+    }
+}
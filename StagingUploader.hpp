@@ -0,0 +1,111 @@
+#pragma once
+
+// Project includes
+#include "MemoryAllocator.hpp"
+#include "SubmitTimeline.hpp"
+
+// GLFW includes
+#define GLFW_INCLUDE_VULKAN
+#include <GLFW/glfw3.h>
+
+// C++ includes
+#include <array>
+#include <vector>
+
+// Size of the persistent staging ring every upload is copied through
+const VkDeviceSize DEFAULT_STAGING_RING_SIZE = 32 * 1024 * 1024;
+
+// Number of upload batches that can be in flight on the GPU at the same time
+const int MAX_UPLOAD_BATCHES = 4;
+
+// Queue an uploader side submits to (through its timeline), with the pool its command buffers come from
+struct UploadQueue {
+    SubmitTimeline * timeline = nullptr;
+    uint32_t family = 0;
+    VkCommandPool commandPool = VK_NULL_HANDLE;
+};
+
+// Identifies the batch an upload was recorded in, batches complete in increasing token order
+typedef uint64_t UploadToken;
+
+struct StagingUploaderStats {
+    uint64_t bytesUploaded = 0;     // Bytes copied through the staging ring
+    uint32_t copyCount = 0;         // vkCmdCopyBuffer regions recorded
+    uint32_t submitCount = 0;       // vkQueueSubmit calls
+    uint32_t stallCount = 0;        // Times the CPU had to wait for the GPU to free ring space
+    uint32_t ownershipTransfers = 0; // Buffer ranges handed over from the transfer to the graphics family
+};
+
+// Batched staging uploader.
+// Upload data is written into one persistently mapped ring buffer and the copies are recorded into
+// a single command buffer per batch, which is submitted once on the queue's timeline. Callers get a token back
+// and only wait for it when they really need the data on the GPU.
+// When the transfer queue belongs to another family than the graphics queue, copies run on the transfer
+// queue (overlapping with rendering) and the destination buffers are handed over to the graphics family
+// with release/acquire barriers, the acquire side being a small submit on the graphics queue.
+class StagingUploader
+{
+public:
+    StagingUploader();
+    ~StagingUploader();
+
+    void init(VkDevice newDevice, MemoryAllocator * newAllocator, UploadQueue newTransferQueue, UploadQueue newGraphicsQueue,
+              VkDeviceSize newRingSize = DEFAULT_STAGING_RING_SIZE);
+    void destroy();
+
+    // - Upload Functions
+    // Copies data to the staging ring now and records a copy into dstBuffer for the next flush
+    UploadToken uploadBuffer(const void * data, VkDeviceSize size, VkBuffer dstBuffer, VkDeviceSize dstOffset = 0);
+
+    // Submits every recorded copy in one submission, returns the token of the submitted batch
+    UploadToken flush();
+    bool hasPendingUploads();
+
+    // - Completion Functions
+    bool isComplete(UploadToken token);
+    void wait(UploadToken token);
+    void waitIdle();
+
+    StagingUploaderStats getStats();
+
+private:
+    struct UploadBatch {
+        VkCommandBuffer commandBuffer = VK_NULL_HANDLE;         // Copies, recorded for the transfer queue
+        VkCommandBuffer acquireCommandBuffer = VK_NULL_HANDLE;  // Ownership acquire, recorded for the graphics queue
+        VkSemaphore transferComplete = VK_NULL_HANDLE;          // Transfer submit -> acquire submit
+        uint64_t submitValue = 0;                               // Timeline value reached once the whole batch is done
+        std::vector<VkBufferMemoryBarrier> ownershipBarriers;   // Ranges to hand over to the graphics family
+        UploadToken token = 0;          // 0 = batch is free
+        VkDeviceSize ringBytes = 0;     // Ring bytes the batch holds until it completes
+        bool submitted = false;
+    };
+
+    VkDevice device;
+    MemoryAllocator * allocator;
+    UploadQueue transferQueue;
+    UploadQueue graphicsQueue;
+    bool ownershipTransfer;         // Transfer and graphics queues are from different families
+    SubmitTimeline * completionTimeline;    // Timeline of the last submit of a batch
+
+    // - Staging Ring
+    VkBuffer stagingBuffer;
+    MemoryAllocation stagingBufferMemory;
+    char * stagingData;             // Persistently mapped pointer to the ring
+    VkDeviceSize ringSize;
+    VkDeviceSize ringHead = 0;      // Next write position
+    VkDeviceSize ringUsed = 0;      // Bytes still owned by recording or in flight batches
+
+    // - Batches
+    std::array<UploadBatch, MAX_UPLOAD_BATCHES> batches;
+    int recordingBatch = -1;        // Batch currently recording copies (-1 = none)
+    UploadToken lastToken = 0;      // Token given to the last started batch
+    UploadToken completedToken = 0; // Every batch up to this token is done
+
+    StagingUploaderStats stats;
+
+    // - Support Functions
+    VkDeviceSize allocateRing(VkDeviceSize size, VkDeviceSize * ringBytes);
+    UploadBatch & beginBatch();
+    void submitOwnershipTransfer(UploadBatch & batch);
+    void retireBatches(bool waitOldest);
+};
@@ -0,0 +1,228 @@
+#include "SubmitTimeline.hpp"
+
+// C++ includes
+#include <stdexcept>
+#include <algorithm>
+#include <limits>
+
+SubmitTimeline::SubmitTimeline()
+{
+}
+
+SubmitTimeline::~SubmitTimeline()
+{
+}
+
+void SubmitTimeline::init(VkDevice newDevice, VkQueue newQueue, bool useTimelineSemaphore)
+{
+    device = newDevice;
+    queue = newQueue;
+    timelineSemaphore = useTimelineSemaphore;
+    lastSubmitted = 0;
+    completed = 0;
+
+    if (!timelineSemaphore)
+        return;
+
+    // Core in Vulkan 1.2, loaded like the other functions the renderer may run without
+    getSemaphoreCounterValue = (PFN_vkGetSemaphoreCounterValue)vkGetDeviceProcAddr(device, "vkGetSemaphoreCounterValue");
+    waitSemaphores = (PFN_vkWaitSemaphores)vkGetDeviceProcAddr(device, "vkWaitSemaphores");
+    if (getSemaphoreCounterValue == nullptr || waitSemaphores == nullptr)
+    {
+        throw std::runtime_error("Failed to load the timeline semaphore functions !");
+    }
+
+    // Counter starts at 0 : nothing submitted, so nothing to wait for
+    VkSemaphoreTypeCreateInfo semaphoreTypeCreateInfo = {};
+    semaphoreTypeCreateInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO;
+    semaphoreTypeCreateInfo.semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE;
+    semaphoreTypeCreateInfo.initialValue = 0;
+
+    VkSemaphoreCreateInfo semaphoreCreateInfo = {};
+    semaphoreCreateInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+    semaphoreCreateInfo.pNext = &semaphoreTypeCreateInfo;
+
+    if (vkCreateSemaphore(device, &semaphoreCreateInfo, nullptr, &semaphore) != VK_SUCCESS)
+    {
+        throw std::runtime_error("Failed to create a timeline Semaphore !");
+    }
+}
+
+void SubmitTimeline::destroy()
+{
+    waitIdle();
+
+    if (semaphore != VK_NULL_HANDLE)
+        vkDestroySemaphore(device, semaphore, nullptr);
+    semaphore = VK_NULL_HANDLE;
+
+    for (VkFence fence : freeFences)
+    {
+        vkDestroyFence(device, fence, nullptr);
+    }
+    freeFences.clear();
+}
+
+uint64_t SubmitTimeline::submit(const VkSubmitInfo & submitInfo)
+{
+    uint64_t value = lastSubmitted + 1;
+    VkResult result;
+
+    if (timelineSemaphore)
+    {
+        // Timeline semaphore is signaled after the caller's semaphores, with the new value
+        // (values of binary semaphores are ignored, the caller's waits are all binary)
+        std::vector<VkSemaphore> signalSemaphores(submitInfo.pSignalSemaphores, submitInfo.pSignalSemaphores + submitInfo.signalSemaphoreCount);
+        signalSemaphores.push_back(semaphore);
+        std::vector<uint64_t> signalValues(signalSemaphores.size(), 0);
+        signalValues.back() = value;
+
+        VkTimelineSemaphoreSubmitInfo timelineSubmitInfo = {};
+        timelineSubmitInfo.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO;
+        timelineSubmitInfo.pNext = submitInfo.pNext;
+        timelineSubmitInfo.signalSemaphoreValueCount = static_cast<uint32_t>(signalValues.size());
+        timelineSubmitInfo.pSignalSemaphoreValues = signalValues.data();
+
+        VkSubmitInfo timelineSubmit = submitInfo;
+        timelineSubmit.pNext = &timelineSubmitInfo;
+        timelineSubmit.signalSemaphoreCount = static_cast<uint32_t>(signalSemaphores.size());
+        timelineSubmit.pSignalSemaphores = signalSemaphores.data();
+
+        result = vkQueueSubmit(queue, 1, &timelineSubmit, VK_NULL_HANDLE);
+    }
+    else
+    {
+        VkFence fence = acquireFence();
+        result = vkQueueSubmit(queue, 1, &submitInfo, fence);
+        if (result == VK_SUCCESS)
+            pendingSubmits.push_back({ value, fence });
+        else
+            freeFences.push_back(fence);
+    }
+
+    if (result != VK_SUCCESS)
+    {
+        throw std::runtime_error("Failed to submit to Queue !");
+    }
+
+    lastSubmitted = value;
+    return value;
+}
+
+uint64_t SubmitTimeline::getLastSubmitted()
+{
+    return lastSubmitted;
+}
+
+uint64_t SubmitTimeline::getCompleted()
+{
+    if (completed == lastSubmitted)
+        return completed;
+
+    if (timelineSemaphore)
+    {
+        uint64_t value = 0;
+        if (getSemaphoreCounterValue(device, semaphore, &value) != VK_SUCCESS)
+        {
+            throw std::runtime_error("Failed to read a timeline Semaphore value !");
+        }
+        completed = std::max(completed, value);
+    }
+    else
+    {
+        retireFences(0);
+    }
+
+    return completed;
+}
+
+bool SubmitTimeline::isComplete(uint64_t value)
+{
+    return value <= completed || value <= getCompleted();
+}
+
+void SubmitTimeline::wait(uint64_t value)
+{
+    // Never submitted values would never be signaled
+    value = std::min(value, lastSubmitted);
+    if (isComplete(value))
+        return;
+
+    if (timelineSemaphore)
+    {
+        VkSemaphoreWaitInfo waitInfo = {};
+        waitInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO;
+        waitInfo.semaphoreCount = 1;
+        waitInfo.pSemaphores = &semaphore;
+        waitInfo.pValues = &value;
+
+        if (waitSemaphores(device, &waitInfo, std::numeric_limits<uint64_t>::max()) != VK_SUCCESS)
+        {
+            throw std::runtime_error("Failed to wait for a timeline Semaphore !");
+        }
+        completed = std::max(completed, value);
+    }
+    else
+    {
+        retireFences(value);
+    }
+}
+
+void SubmitTimeline::waitIdle()
+{
+    wait(lastSubmitted);
+}
+
+VkQueue SubmitTimeline::getQueue()
+{
+    return queue;
+}
+
+bool SubmitTimeline::usesTimelineSemaphore()
+{
+    return timelineSemaphore;
+}
+
+VkFence SubmitTimeline::acquireFence()
+{
+    // Reuse the fences of retired submissions first
+    getCompleted();
+    if (!freeFences.empty())
+    {
+        VkFence fence = freeFences.back();
+        freeFences.pop_back();
+        return fence;
+    }
+
+    VkFenceCreateInfo fenceCreateInfo = {};
+    fenceCreateInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+
+    VkFence fence;
+    if (vkCreateFence(device, &fenceCreateInfo, nullptr, &fence) != VK_SUCCESS)
+    {
+        throw std::runtime_error("Failed to create a submission Fence !");
+    }
+    return fence;
+}
+
+void SubmitTimeline::retireFences(uint64_t waitValue)
+{
+    // Submissions of a queue complete in order : stop at the first unsignaled fence, unless it has to be waited for
+    while (!pendingSubmits.empty())
+    {
+        PendingSubmit & oldest = pendingSubmits.front();
+        if (oldest.value <= waitValue)
+        {
+            vkWaitForFences(device, 1, &oldest.fence, VK_TRUE, std::numeric_limits<uint64_t>::max());
+        }
+        else if (vkGetFenceStatus(device, oldest.fence) != VK_SUCCESS)
+        {
+            return;
+        }
+
+        completed = oldest.value;
+        vkResetFences(device, 1, &oldest.fence);
+        freeFences.push_back(oldest.fence);
+        pendingSubmits.pop_front();
+    }
+}
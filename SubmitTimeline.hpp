@@ -0,0 +1,65 @@
+#pragma once
+
+// GLFW includes
+#define GLFW_INCLUDE_VULKAN
+#include <GLFW/glfw3.h>
+
+// C++ includes
+#include <deque>
+#include <vector>
+
+// Submission scheduler of one queue.
+// Every submission gets the next value of a monotonically increasing counter, signaled by the GPU once the
+// submission is done. Users keep the value of the work they depend on, and the CPU waits for that exact point
+// instead of a fence per object or a whole queue/device idle.
+// The counter is a timeline semaphore (Vulkan 1.2) when the device supports it, otherwise one fence per
+// submission (recycled once signaled) stands in for it, so callers only ever deal with values.
+// Values from two queues can't be compared : each queue has its own timeline.
+class SubmitTimeline
+{
+public:
+    SubmitTimeline();
+    ~SubmitTimeline();
+
+    void init(VkDevice newDevice, VkQueue newQueue, bool useTimelineSemaphore);
+    void destroy();
+
+    // Submits one batch, which also signals the next value. Returns that value
+    uint64_t submit(const VkSubmitInfo & submitInfo);
+
+    // Value of the last submission, every submission up to it is done once it's reached
+    uint64_t getLastSubmitted();
+    // Latest value the GPU reached (polls the GPU)
+    uint64_t getCompleted();
+
+    bool isComplete(uint64_t value);
+    void wait(uint64_t value);
+    void waitIdle();
+
+    VkQueue getQueue();
+    bool usesTimelineSemaphore();
+
+private:
+    VkDevice device;
+    VkQueue queue;
+    bool timelineSemaphore;
+
+    uint64_t lastSubmitted = 0;
+    uint64_t completed = 0;         // Cached, only moves forward
+
+    // - Timeline Semaphore
+    VkSemaphore semaphore = VK_NULL_HANDLE;
+    PFN_vkGetSemaphoreCounterValue getSemaphoreCounterValue = nullptr;
+    PFN_vkWaitSemaphores waitSemaphores = nullptr;
+
+    // - Fence Fallback
+    struct PendingSubmit {
+        uint64_t value;
+        VkFence fence;
+    };
+    std::deque<PendingSubmit> pendingSubmits;   // In value order
+    std::vector<VkFence> freeFences;            // Signaled and reset, ready for the next submissions
+
+    VkFence acquireFence();
+    void retireFences(uint64_t waitValue);
+};
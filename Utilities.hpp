@@ -5,16 +5,27 @@
 
 #include <glm/glm.hpp>
 
+#ifdef _WIN32
+#include <malloc.h>
+#endif
+
+// Project includes
+#include "MemoryAllocator.hpp"
+
 #include <vector>
+#include <cstdlib>
 #include <fstream>
+#include <stdexcept>
+#include <chrono>
 
 const int MAX_FRAME_DRAWS = 2;
-const int MAX_OBJECTS = 2;
+const int DEFAULT_OBJECT_CAPACITY = 1024;     // Objects the per-object data has room for at start, grown when exceeded
 
 const std::vector<const char *> deviceExtensions = {
     VK_KHR_SWAPCHAIN_EXTENSION_NAME
 };
 
+// Vertex as meshes are given (see VertexFormat for how the mesh pool stores them)
 struct Vertex
 {
     glm::vec3 pos; // Vertex position (x, y, z)
@@ -25,12 +36,19 @@ struct Vertex
 struct QueueFamilyIndices {
     int graphicsFamily = -1;        // Location of Graphics Queue Family
     int presentationFamily = -1;
+    int transferFamily = -1;        // Transfer only family if the device has one, graphics family otherwise
 
     // Check if queue families are valid.
     bool isValid()
     {
         return graphicsFamily >= 0 && presentationFamily >= 0;
     }
+
+    // Check if uploads run on their own queue family (needs queue family ownership transfers).
+    bool hasDedicatedTransfer()
+    {
+        return transferFamily >= 0 && transferFamily != graphicsFamily;
+    }
 };
 
 struct SwapChainDetails {
@@ -44,6 +62,39 @@ struct SwapChainImage {
     VkImageView imageView;
 };
 
+// Milliseconds elapsed since start (CPU side timings)
+static double elapsedMs(std::chrono::steady_clock::time_point start)
+{
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+// Aligned host allocation (_aligned_malloc only exists with MSVC), alignment must be a power of two
+static void * alignedAlloc(size_t size, size_t alignment)
+{
+#ifdef _WIN32
+    void * data = _aligned_malloc(size, alignment);
+#else
+    // posix_memalign also wants a multiple of sizeof(void *)
+    void * data = nullptr;
+    if (posix_memalign(&data, alignment < sizeof(void *) ? sizeof(void *) : alignment, size) != 0)
+        data = nullptr;
+#endif
+    if (data == nullptr)
+    {
+        throw std::runtime_error("Failed to allocate aligned memory !");
+    }
+    return data;
+}
+
+static void alignedFree(void * data)
+{
+#ifdef _WIN32
+    _aligned_free(data);
+#else
+    free(data);
+#endif
+}
+
 static std::vector<char> readFile(const std::string & fileName)
 {
     // Open stream from given file.
@@ -73,26 +124,8 @@ static std::vector<char> readFile(const std::string & fileName)
     return fileBuffer;
 }
 
-static uint32_t findMemoryTypeIndex(VkPhysicalDevice physicalDevice, uint32_t allowedTypes, VkMemoryPropertyFlags properties)
-{
-    // Get properties of physical device memory
-    VkPhysicalDeviceMemoryProperties memoryProperties;
-    vkGetPhysicalDeviceMemoryProperties(physicalDevice, &memoryProperties);
-
-    for (uint32_t i = 0; i < memoryProperties.memoryTypeCount; ++i)
-    {
-        // Index of memory type must match corresponding bit in allowedTypes
-        // && desired properties bit flags are part of memory type's property flags
-        if (((allowedTypes) & (1 << i)) && (memoryProperties.memoryTypes[i].propertyFlags & properties) == properties)
-        {
-            // This memory type is valid, so return the index
-            return i;
-        }
-    }
-}
-
-static void createBuffer(VkPhysicalDevice physicalDevice, VkDevice device, VkDeviceSize bufferSize, VkBufferUsageFlags bufferUsageFlags,
-                         VkMemoryPropertyFlags bufferProperties, VkBuffer * buffer, VkDeviceMemory * memory)
+static void createBuffer(VkDevice device, MemoryAllocator * allocator, VkDeviceSize bufferSize, VkBufferUsageFlags bufferUsageFlags,
+                         VkMemoryPropertyFlags bufferProperties, VkBuffer * buffer, MemoryAllocation * allocation)
 {
     // Create Vertex Buffer
     // Infos to create a buffer (doesn't include assigning memory)
@@ -113,78 +146,16 @@ static void createBuffer(VkPhysicalDevice physicalDevice, VkDevice device, VkDev
     VkMemoryRequirements memRequirements;
     vkGetBufferMemoryRequirements(device, *buffer, &memRequirements);
 
-    // Allocate memory to buffer
-    VkMemoryAllocateInfo memoryAllocateInfo = {};
-    memoryAllocateInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-    memoryAllocateInfo.allocationSize = memRequirements.size;
-    memoryAllocateInfo.memoryTypeIndex = findMemoryTypeIndex(physicalDevice, memRequirements.memoryTypeBits,    // Index of memory type on Physical Device that has required bit flags
-        bufferProperties);
+    // Sub-allocate a range of a memory block with the required memory type and alignment
     // VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT : CPU can interact with memory
     // VK_MEMORY_PROPERTY_HOST_COHERENT_BIT : Allows placement of data straight into buffer after mapping (otherwise we'd have to specify manually)
+    *allocation = allocator->allocate(memRequirements, bufferProperties, true);
 
-    // Allocate memory to vkDeviceMemory
-    result = vkAllocateMemory(device, &memoryAllocateInfo, nullptr, memory);
-
-    if (result != VK_SUCCESS)
-    {
-        throw std::runtime_error("Failed to allocate vertex buffer memory !");
-    }
-
-    // Allocate memory to given vertex buffer
-    result = vkBindBufferMemory(device, *buffer, *memory, 0);
+    // Bind the buffer to its range of the block
+    result = vkBindBufferMemory(device, *buffer, allocation->memory, allocation->offset);
 
     if (result != VK_SUCCESS)
     {
         throw std::runtime_error("Failed to bind buffer memory !");
     }
-}
-
-static void copyBuffer(VkDevice device, VkQueue transferQueue, VkCommandPool transferCommandPool,
-                       VkBuffer srcBuffer, VkBuffer dstBuffer, VkDeviceSize bufferSize)
-{
-    // Commmand buffer to hold transfer commmands 
-    VkCommandBuffer transferCommandBuffer;
-
-    // Command buffer details
-    VkCommandBufferAllocateInfo allocInfo = {};
-    allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
-    allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
-    allocInfo.commandPool = transferCommandPool;
-    allocInfo.commandBufferCount = 1;
-
-    // Allocate command buffer from pool
-    vkAllocateCommandBuffers(device, &allocInfo, &transferCommandBuffer);
-
-    // Information to begin the command buffer record
-    VkCommandBufferBeginInfo beginInfo = {};
-    beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
-    beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT; // We're only using the command buffer once, so set up for one time submit
-    
-    // Begin recording transfer commands
-    vkBeginCommandBuffer(transferCommandBuffer, &beginInfo);
-
-    // Region of data to copy from and to
-    VkBufferCopy bufferCopyRegion = {};
-    bufferCopyRegion.srcOffset = 0;
-    bufferCopyRegion.dstOffset = 0;
-    bufferCopyRegion.size = bufferSize;
-
-    // Command to copy src buffer to dst buffer
-    vkCmdCopyBuffer(transferCommandBuffer, srcBuffer, dstBuffer, 1, &bufferCopyRegion);
-
-    // End commands
-    vkEndCommandBuffer(transferCommandBuffer);
-
-    // Queue submission infos
-    VkSubmitInfo submitInfo = {};
-    submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
-    submitInfo.commandBufferCount = 1;
-    submitInfo.pCommandBuffers = &transferCommandBuffer;
-
-    // Submit transfer command to transfer queue and wait until it finishes
-    vkQueueSubmit(transferQueue, 1, &submitInfo, VK_NULL_HANDLE);
-    vkQueueWaitIdle(transferQueue);
-
-    // Free temporary command buffer back to pool
-    vkFreeCommandBuffers(device, transferCommandPool, 1, &transferCommandBuffer);
 }
\ No newline at end of file
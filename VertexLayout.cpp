@@ -0,0 +1,188 @@
+#include "VertexLayout.hpp"
+
+// C++ includes
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+// Quantization uses SSE2 integer packing on any x86-64 CPU, a scalar loop otherwise
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+    #include <emmintrin.h>
+    #define VERTEX_LAYOUT_SSE2
+#endif
+
+// Largest SNORM16 value : stored = round(normalized * 32767)
+static const float SNORM16_MAX = 32767.0f;
+
+// Size of the position and of the other attributes of a vertex in the format
+static uint32_t getPositionSize(VertexFormat format)
+{
+    return format == VertexFormat::COMPACT ? sizeof(CompactVertex::pos) : sizeof(Vertex::pos);
+}
+
+static uint32_t getAttributeSize(VertexFormat format)
+{
+    return format == VertexFormat::COMPACT ? sizeof(CompactVertex::col) : sizeof(Vertex::col);
+}
+
+uint32_t VertexLayout::getStreamCount() const
+{
+    return splitStreams ? 2 : 1;
+}
+
+uint32_t VertexLayout::getStride(uint32_t stream) const
+{
+    if (!splitStreams)
+        return getVertexSize();
+
+    return stream == POSITION_STREAM ? getPositionSize(format) : getAttributeSize(format);
+}
+
+uint32_t VertexLayout::getVertexSize() const
+{
+    return getPositionSize(format) + getAttributeSize(format);
+}
+
+void getVertexInputDescriptions(const VertexLayout & layout, std::vector<VkVertexInputBindingDescription> * bindings,
+                                std::vector<VkVertexInputAttributeDescription> * attributes)
+{
+    // How the data for a single vertex (including info such as position, color, texture coords, normals, etc) is as a whole.
+    // One binding per stream : split streams are each read from their own vertex buffer, with their own stride
+    for (uint32_t stream = 0; stream < layout.getStreamCount(); ++stream)
+    {
+        VkVertexInputBindingDescription bindingDescription = {};
+        bindingDescription.binding = stream;                        // Can bind multiple streams of data
+        bindingDescription.stride = layout.getStride(stream);       // Size of a single vertex object (in this stream)
+        bindingDescription.inputRate = VK_VERTEX_INPUT_RATE_VERTEX; // How to move between data after each vertex
+                                                                    // VK_VERTEX_INPUT_RATE_INDEX       : Move on to the next vertex
+                                                                    // VK_VERTEX_INPUT_RATE_DISTANCE    : Move to a vertex for the next instance
+        bindings->push_back(bindingDescription);
+    }
+
+    // How the data for an attribute is defined within a vertex.
+    // The format must match the stored data exactly : normalized formats are converted to floats when fetched,
+    // so the shaders read vec3 positions and colours whatever the vertex format.
+    VkVertexInputAttributeDescription positionAttribute = {};
+    positionAttribute.binding = POSITION_STREAM;    // Which binding the data is at (should be one of the above)
+    positionAttribute.location = 0;                 // Location in shader where data will be read from
+    positionAttribute.offset = 0;                   // Where this attribute is defined in the data for a single vertex
+
+    // Interleaved : the colour follows the position in the same vertex
+    VkVertexInputAttributeDescription colorAttribute = {};
+    colorAttribute.binding = layout.splitStreams ? ATTRIBUTE_STREAM : POSITION_STREAM;
+    colorAttribute.location = 1;
+    colorAttribute.offset = layout.splitStreams ? 0 : getPositionSize(layout.format);
+
+    if (layout.format == VertexFormat::COMPACT)
+    {
+        // 3 component 16 bit formats are rarely supported for vertex input : the 4th one is padding
+        positionAttribute.format = VK_FORMAT_R16G16B16A16_SNORM;
+        colorAttribute.format = VK_FORMAT_R8G8B8A8_UNORM;
+    }
+    else
+    {
+        positionAttribute.format = VK_FORMAT_R32G32B32_SFLOAT;     // Format the data will take (also helps defined size of data)
+        colorAttribute.format = VK_FORMAT_R32G32B32_SFLOAT;
+    }
+
+    attributes->push_back(positionAttribute);
+    attributes->push_back(colorAttribute);
+}
+
+VertexDequantization computeDequantization(VertexFormat format, glm::vec3 boundsMin, glm::vec3 boundsMax)
+{
+    VertexDequantization dequantization;
+    if (format != VertexFormat::COMPACT)
+        return dequantization;
+
+    // [-1, 1] covers the bounds. A flat axis keeps scale 1 : every vertex stores 0 on it, and the matrix stays invertible
+    dequantization.offset = (boundsMin + boundsMax) * 0.5f;
+    dequantization.scale = (boundsMax - boundsMin) * 0.5f;
+    for (int axis = 0; axis < 3; ++axis)
+    {
+        if (dequantization.scale[axis] <= 0.0f)
+            dequantization.scale[axis] = 1.0f;
+    }
+    return dequantization;
+}
+
+// Positions and colours are written with their stream's stride : interleaved or split, the same loop fills them
+static void encodeCompactVertices(const Vertex * vertices, size_t count, const VertexDequantization & dequantization,
+                                  uint8_t * positions, size_t positionStride, uint8_t * colors, size_t colorStride)
+{
+    glm::vec3 quantizationScale = glm::vec3(SNORM16_MAX) / dequantization.scale;
+
+#if defined(VERTEX_LAYOUT_SSE2)
+    // One vertex per iteration, every component at once : (pos - offset) * 32767 / scale then (col * 255),
+    // rounded and narrowed with saturating packs
+    const __m128 offset = _mm_setr_ps(dequantization.offset.x, dequantization.offset.y, dequantization.offset.z, 0.0f);
+    const __m128 scale = _mm_setr_ps(quantizationScale.x, quantizationScale.y, quantizationScale.z, 0.0f);
+    const __m128 zero = _mm_setzero_ps();
+    const __m128 one = _mm_set1_ps(1.0f);
+    const __m128 colorScale = _mm_set1_ps(255.0f);
+    const __m128 alphaMask = _mm_castsi128_ps(_mm_setr_epi32(0, 0, 0, -1));
+
+    for (size_t i = 0; i < count; ++i)
+    {
+        // Both loads stay inside the 24 bytes of the vertex : pos.xyz + col.r, then pos.z + col.rgb
+        const float * vertex = &vertices[i].pos.x;
+        __m128 position = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(vertex), offset), scale);
+        __m128i quantizedPosition = _mm_cvtps_epi32(position);
+        _mm_storel_epi64(reinterpret_cast<__m128i *>(positions + i * positionStride), _mm_packs_epi32(quantizedPosition, quantizedPosition));
+
+        __m128 color = _mm_loadu_ps(vertex + 2);
+        color = _mm_shuffle_ps(color, color, _MM_SHUFFLE(3, 3, 2, 1));
+        color = _mm_or_ps(_mm_andnot_ps(alphaMask, color), _mm_and_ps(alphaMask, one));    // Alpha = 1
+        color = _mm_mul_ps(_mm_min_ps(_mm_max_ps(color, zero), one), colorScale);
+        __m128i quantizedColor = _mm_cvtps_epi32(color);
+        quantizedColor = _mm_packs_epi32(quantizedColor, quantizedColor);
+        quantizedColor = _mm_packus_epi16(quantizedColor, quantizedColor);
+        int packedColor = _mm_cvtsi128_si32(quantizedColor);
+        memcpy(colors + i * colorStride, &packedColor, sizeof(packedColor));
+    }
+#else
+    for (size_t i = 0; i < count; ++i)
+    {
+        int16_t position[4] = { 0, 0, 0, 0 };
+        uint8_t color[4] = { 0, 0, 0, 255 };
+        for (int axis = 0; axis < 3; ++axis)
+        {
+            float quantized = (vertices[i].pos[axis] - dequantization.offset[axis]) * quantizationScale[axis];
+            quantized = std::min(std::max(quantized, -SNORM16_MAX), SNORM16_MAX);
+            position[axis] = static_cast<int16_t>(std::lround(quantized));
+
+            float channel = std::min(std::max(vertices[i].col[axis], 0.0f), 1.0f);
+            color[axis] = static_cast<uint8_t>(std::lround(channel * 255.0f));
+        }
+        memcpy(positions + i * positionStride, position, sizeof(position));
+        memcpy(colors + i * colorStride, color, sizeof(color));
+    }
+#endif
+}
+
+void encodeVertices(const VertexLayout & layout, const Vertex * vertices, size_t count, const VertexDequantization & dequantization,
+                    void * const * streams)
+{
+    // Interleaved : the colour follows the position in stream 0
+    uint8_t * positions = static_cast<uint8_t *>(streams[POSITION_STREAM]);
+    size_t positionStride = layout.getStride(POSITION_STREAM);
+    uint8_t * colors = layout.splitStreams ? static_cast<uint8_t *>(streams[ATTRIBUTE_STREAM]) : positions + getPositionSize(layout.format);
+    size_t colorStride = layout.getStride(layout.splitStreams ? ATTRIBUTE_STREAM : POSITION_STREAM);
+
+    if (layout.format == VertexFormat::COMPACT)
+    {
+        encodeCompactVertices(vertices, count, dequantization, positions, positionStride, colors, colorStride);
+    }
+    else if (!layout.splitStreams)
+    {
+        memcpy(positions, vertices, sizeof(Vertex) * count);
+    }
+    else
+    {
+        for (size_t i = 0; i < count; ++i)
+        {
+            memcpy(positions + i * positionStride, &vertices[i].pos, sizeof(Vertex::pos));
+            memcpy(colors + i * colorStride, &vertices[i].col, sizeof(Vertex::col));
+        }
+    }
+}
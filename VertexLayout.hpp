@@ -0,0 +1,63 @@
+#pragma once
+
+// Project includes
+#include "Utilities.hpp"
+
+// GLFW includes
+#define GLFW_INCLUDE_VULKAN
+#include <GLFW/glfw3.h>
+
+// C++ includes
+#include <vector>
+#include <cstdint>
+
+// How mesh vertices are stored in the mesh pool, and so read by the vertex input stage.
+// Meshes are always given as Vertex (floats), they're converted when added.
+enum class VertexFormat {
+    FULL,       // Vertex as is : float position + float colour (24 bytes)
+    COMPACT     // SNORM16 position inside the mesh bounds + UNORM8 colour (12 bytes)
+};
+
+// COMPACT vertex as stored in the vertex buffer
+struct CompactVertex {
+    int16_t pos[4];     // Position mapped to [-1, 1] over the mesh bounds (w unused, keeps the attribute 8 bytes aligned)
+    uint8_t col[4];     // Colour (alpha unused)
+};
+
+// Vertex buffers (streams) a mesh can be split in, each bound to the vertex input binding of the same index
+const uint32_t MAX_VERTEX_STREAMS = 2;
+const uint32_t POSITION_STREAM = 0;     // Positions only
+const uint32_t ATTRIBUTE_STREAM = 1;    // Every other attribute
+
+// Format of the vertices and how they're spread over vertex buffers
+struct VertexLayout {
+    VertexFormat format = VertexFormat::FULL;
+    // Positions in their own buffer (POSITION_STREAM), the rest in another (ATTRIBUTE_STREAM) :
+    // a pass only reading positions binds the first one and fetches nothing else. Otherwise one interleaved buffer.
+    bool splitStreams = false;
+
+    uint32_t getStreamCount() const;
+    // Size of one vertex in a stream
+    uint32_t getStride(uint32_t stream) const;
+    // Size of one vertex in all the streams together
+    uint32_t getVertexSize() const;
+};
+
+// What turns a stored position back into a model space one : pos = stored * scale + offset.
+// Identity for FULL vertices. Applied by the object's matrix (see SceneStore), so shaders read every format the same way.
+struct VertexDequantization {
+    glm::vec3 scale = glm::vec3(1.0f);
+    glm::vec3 offset = glm::vec3(0.0f);
+};
+
+// Vertex input state of the layout : one binding per stream (binding = stream), position at location 0, colour at location 1
+void getVertexInputDescriptions(const VertexLayout & layout, std::vector<VkVertexInputBindingDescription> * bindings,
+                                std::vector<VkVertexInputAttributeDescription> * attributes);
+
+// Dequantization of a mesh with these model space bounds
+VertexDequantization computeDequantization(VertexFormat format, glm::vec3 boundsMin, glm::vec3 boundsMax);
+
+// Writes count vertices in the layout, streams[s] receives layout.getStride(s) * count bytes.
+// COMPACT positions are quantized with the mesh's dequantization.
+void encodeVertices(const VertexLayout & layout, const Vertex * vertices, size_t count, const VertexDequantization & dequantization,
+                    void * const * streams);
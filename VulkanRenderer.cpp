@@ -12,19 +12,156 @@ VulkanRenderer::~VulkanRenderer()
 {
 }
 
-int VulkanRenderer::init(GLFWwindow * newWindow)
+void VulkanRenderer::setObjectDataMode(ObjectDataMode mode)
+{
+    objectDataMode = mode;
+}
+
+ObjectDataMode VulkanRenderer::getObjectDataMode()
+{
+    return objectDataMode;
+}
+
+void VulkanRenderer::setRecordThreadCount(uint32_t threadCount)
+{
+    recordThreadCount = threadCount;
+}
+
+void VulkanRenderer::setIndirectDrawing(bool enabled)
+{
+    indirectDrawingRequested = enabled;
+}
+
+bool VulkanRenderer::isIndirectDrawing()
+{
+    return indirectDrawing;
+}
+
+void VulkanRenderer::setFrustumCulling(bool enabled)
+{
+    frustumCulling = enabled;
+}
+
+bool VulkanRenderer::isFrustumCulling()
+{
+    return frustumCulling;
+}
+
+void VulkanRenderer::setVertexFormat(VertexFormat format)
+{
+    vertexLayout.format = format;
+}
+
+VertexFormat VulkanRenderer::getVertexFormat()
+{
+    return vertexLayout.format;
+}
+
+void VulkanRenderer::setSplitVertexStreams(bool enabled)
+{
+    vertexLayout.splitStreams = enabled;
+}
+
+bool VulkanRenderer::isSplitVertexStreams()
+{
+    return vertexLayout.splitStreams;
+}
+
+void VulkanRenderer::setMeshOptimization(bool enabled)
+{
+    meshOptimization = enabled;
+}
+
+bool VulkanRenderer::isMeshOptimization()
+{
+    return meshOptimization;
+}
+
+void VulkanRenderer::setGpuCulling(bool enabled)
+{
+    gpuCullingRequested = enabled;
+}
+
+bool VulkanRenderer::isGpuCulling()
+{
+    return gpuCulling;
+}
+
+void VulkanRenderer::setPipelineCacheFile(const std::string & filePath)
+{
+    pipelineCacheFile = filePath;
+}
+
+void VulkanRenderer::setFramesInFlight(int framesInFlight)
+{
+    framesInFlight = std::max(1, framesInFlight);
+
+    // Before init : only the setting
+    if (frames.empty())
+    {
+        maxFramesInFlight = framesInFlight;
+        return;
+    }
+    if (framesInFlight == maxFramesInFlight) return;
+
+    // Only the frame contexts depend on it (per image resources stay), the GPU must be done with them
+    waitForFrames();
+    destroyFrameContexts();
+    maxFramesInFlight = framesInFlight;
+    createFrameContexts();
+
+    currentFrame = 0;
+}
+
+int VulkanRenderer::getFramesInFlight()
+{
+    return maxFramesInFlight;
+}
+
+int VulkanRenderer::init(GLFWwindow * newWindow, int framesInFlight)
 {
     __window = newWindow;
+    headless = false;
+    maxFramesInFlight = framesInFlight;
+
+    return initRenderer();
+}
+
+int VulkanRenderer::initHeadless(uint32_t width, uint32_t height, int framesInFlight, bool readback)
+{
+    __window = nullptr;
+    headless = true;
+    readbackEnabled = readback;
+    maxFramesInFlight = framesInFlight;
+
+    // No surface to ask the size from, the offscreen images use the given one
+    swapChainExtent.width = width;
+    swapChainExtent.height = height;
+
+    return initRenderer();
+}
+
+int VulkanRenderer::initRenderer()
+{
+    auto initStart = std::chrono::steady_clock::now();
+    startupTimings = StartupTimings();
 
     try {
         createInstance();
 
         setupDebugMessenger();
 
-        createSurface();
+        if (!headless)
+            createSurface();
         getPhysicalDevice();
         createLogicalDevice();
-        createSwapChain();
+        createSubmitTimelines();
+        createPipelineCache();
+        createMemoryAllocator();
+        if (headless)
+            createOffscreenImages();
+        else
+            createSwapChain();
         createDepthBufferImage();
         createRenderPass();
         createDescriptorSetLayout();
@@ -32,67 +169,271 @@ int VulkanRenderer::init(GLFWwindow * newWindow)
         createGraphicsPipeline();
         createFramebuffers();
         createCommandPool();
+        createStagingUploader();
+        createMeshPool();
 
         uboViewProjection.projection = glm::perspective(glm::radians(45.0f), (float)swapChainExtent.width / (float)swapChainExtent.height, 0.1f, 100.0f);
 		uboViewProjection.view = glm::lookAt(glm::vec3(0.0f, 0.0f, 2.0f), glm::vec3(0.0f, 0.0f, 0.0f), glm::vec3(0.0f, 1.0f, 0.0f));
 
 		uboViewProjection.projection[1][1] *= -1;
 
-        // Create a mesh
-        // Vertex Data
-        std::vector<Vertex> meshVertices = {
-            { { -0.4, 0.4, 0.0 },{ 1.0f, 0.0f, 0.0f } },	// 0
-            { { -0.4, -0.4, 0.0 },{ 1.0f, 0.0f, 0.0f } },	    // 1
-            { { 0.4, -0.4, 0.0 },{ 0.0f, 1.0f, 0.0f } },    // 2
-            { { 0.4, 0.4, 0.0 },{ 0.0f, 1.0f, 0.0f } },   // 3
-        };
-
-        std::vector<Vertex> meshVertices2 = {
-            { { -0.25, 0.6, 0.0 },{ 0.0f, 0.0f, 1.0f } },	// 0
-            { { -0.25, -0.6, 0.0 },{ 0.0f, 0.0f, 1.0f } },	    // 1
-            { { 0.25, -0.6, 0.0 },{ 0.0f, 0.0f, 1.0f } },    // 2
-            { { 0.25, 0.6, 0.0 },{ 0.0f, 0.0f, 1.0f } },   // 3
-        };
-
-        // Index Data
-        std::vector<uint32_t> meshIndices = {
-            0, 1, 2,
-            2, 3, 0
-        };
-
-        Mesh firstMesh = Mesh(mainDevice.physicalDevice, mainDevice.logicalDevice,
-            graphicsQueue, graphicsCommandPool,
-            &meshVertices, &meshIndices);
-        Mesh secondMesh = Mesh(mainDevice.physicalDevice, mainDevice.logicalDevice,
-            graphicsQueue, graphicsCommandPool,
-            &meshVertices2, &meshIndices);
-
-        meshList.push_back(firstMesh);
-        meshList.push_back(secondMesh);
-
-        glm::mat4 meshModelMatrix = meshList[0].getModel().model;
-        meshModelMatrix = glm::rotate(meshModelMatrix, glm::radians(45.0f), glm::vec3(0.0f, 0.0f, 1.0f));
-        meshList[0].setModel(meshModelMatrix);
-
+        jobSystem.init(recordThreadCount);
         createCommandBuffers();
-        //allocateDynamicBufferTransferSpace();
-        createUniformBuffers();
+        createSecondaryCommandBuffers();
+        allocateDynamicBufferTransferSpace();
+        createFrameArena();
+        createIndirectDrawBuffer();
+        createGpuCuller();
         createDescriptorPool();
         createDescriptorSets();
         createSynchronisation();
 
-    } catch (const std::runtime_error & e) {
+        startupTimings.initMs = elapsedMs(initStart);
+        startupTimings.pipelineCacheWarm = pipelineCache.isWarm();
+        startupTimings.pipelineCacheBytes = pipelineCache.getLoadedBytes();
+
+    } catch (const std::exception & e) {
         printf("ERROR : %s\n", e.what());
+        releaseFailedInit();
         return EXIT_FAILURE;
     }
     return EXIT_SUCCESS;
 }
 
+void VulkanRenderer::releaseFailedInit()
+{
+    // Init stopped at any step : only what always exists once created is released, nothing is left for destroy()
+
+    // Worker threads are joined (the renderer can't go away with them running), compile workers use the device
+    pipelineLibrary.destroy();
+    jobSystem.destroy();
+
+    // Objects created from the device before the failure : their memory blocks, then the device they were created from
+    if (mainDevice.logicalDevice != VK_NULL_HANDLE)
+    {
+        vkDeviceWaitIdle(mainDevice.logicalDevice);
+        memoryAllocator.destroy();
+        vkDestroyDevice(mainDevice.logicalDevice, nullptr);
+        mainDevice.logicalDevice = VK_NULL_HANDLE;
+    }
+
+    if (surface != VK_NULL_HANDLE)
+        vkDestroySurfaceKHR(__instance, surface, nullptr);
+    surface = VK_NULL_HANDLE;
+    if (callback != VK_NULL_HANDLE)
+        DestroyDebugReportCallbackEXT(__instance, callback, nullptr);
+    callback = VK_NULL_HANDLE;
+    if (__instance != VK_NULL_HANDLE)
+        vkDestroyInstance(__instance, nullptr);
+    __instance = VK_NULL_HANDLE;
+}
+
+int VulkanRenderer::addMesh(std::vector<Vertex> * vertices, std::vector<uint32_t> * indices)
+{
+    Model model = {};
+    model.model = glm::mat4(1.0f);
+
+    return addInstancedMesh(vertices, indices, { model });
+}
+
+int VulkanRenderer::addInstancedMesh(std::vector<Vertex> * vertices, std::vector<uint32_t> * indices, const std::vector<Model> & instances)
+{
+    if (instances.empty())
+    {
+        throw std::runtime_error("Failed to add a mesh without instances !");
+    }
+
+    // Upload is only recorded here, it's submitted with every other pending upload on the next flush/draw
+    // Instances get consecutive object slots, their world data is computed by the next draw()
+    uint32_t firstObject = static_cast<uint32_t>(sceneStore.size());
+    // Optimised copies : the caller's data stays as given
+    std::vector<Vertex> optimizedVertices;
+    std::vector<uint32_t> optimizedIndices;
+    if (meshOptimization)
+    {
+        optimizedVertices = *vertices;
+        optimizedIndices = *indices;
+        meshOptimizerStats.add(meshOptimizer.optimize(&optimizedVertices, &optimizedIndices));
+        vertices = &optimizedVertices;
+        indices = &optimizedIndices;
+    }
+    Mesh mesh = Mesh(&meshPool, vertices, indices, firstObject, static_cast<uint32_t>(instances.size()));
+    sceneStore.addObjects(static_cast<uint32_t>(meshList.size()), glm::vec4(mesh.getBoundsCenter(), mesh.getBoundsRadius()),
+                          mesh.getDequantization(), instances);
+    meshList.push_back(mesh);
+    markSceneDirty();
+
+    objectVisible.resize(sceneStore.size(), 1);
+    frustumCuller.resize(sceneStore.size());
+
+    // Indirect draw of the mesh, uploaded with the next draw()
+    uint32_t meshId = static_cast<uint32_t>(meshList.size()) - 1;
+    VkDrawIndexedIndirectCommand drawCommand = getDrawCommand(meshId);
+    visibleDrawCommands.push_back(drawCommand);
+
+    // Draws are grouped per pool chunk. The mesh usually goes to the last chunk, whose range ends drawCommands : appended.
+    // Otherwise (16 bit mesh after a 32 bit one) the ranges after its chunk move, the next draw() lays them out again
+    MeshRange range = mesh.getRange();
+    if (range.chunk >= chunkDraws.size())
+    {
+        chunkDraws.resize(range.chunk + 1);
+        chunkDraws[range.chunk].firstDraw = static_cast<uint32_t>(drawCommands.size());
+    }
+    ChunkDraws & draws = chunkDraws[range.chunk];
+    draws.meshes.push_back(meshId);
+    draws.drawCount++;
+    if (range.chunk + 1 != chunkDraws.size())
+        drawLayoutDirty = true;
+    uint32_t drawSlot = static_cast<uint32_t>(drawCommands.size());
+    if (!drawLayoutDirty)
+        drawCommands.push_back(drawCommand);
+
+    if (gpuCulling)
+    {
+        // The cull shader moves the sphere with the object data matrix, which includes the dequantization :
+        // sphere in stored vertex space (radius divided by the smallest axis scale, so it still covers the mesh)
+        VertexDequantization dequantization = mesh.getDequantization();
+        glm::vec3 storedCenter = (mesh.getBoundsCenter() - dequantization.offset) / dequantization.scale;
+        float storedRadius = mesh.getBoundsRadius() / std::min(dequantization.scale.x, std::min(dequantization.scale.y, dequantization.scale.z));
+        gpuCuller.addMesh(storedCenter, storedRadius, firstObject, mesh.getInstanceCount(),
+                          range.chunk, draws.firstDraw, drawSlot);
+    }
+
+    return static_cast<int>(meshList.size()) - 1;
+}
+
+size_t VulkanRenderer::getMeshCount()
+{
+    return meshList.size();
+}
+
+void VulkanRenderer::waitForUploads()
+{
+    stagingUploader.flush();
+    stagingUploader.waitIdle();
+}
+
 void VulkanRenderer::updateModel(int modelId, glm::mat4 newModel)
 {
-    if (modelId >= meshList.size()) return;
+    updateModels(&modelId, &newModel, 1);
+}
+
+void VulkanRenderer::updateModels(const int * modelIds, const glm::mat4 * newModels, size_t count)
+{
+    // Only stored here : world matrices and bounds of every changed object are computed together by the next draw()
+    for (size_t i = 0; i < count; ++i)
+    {
+        if (modelIds[i] < 0 || modelIds[i] >= meshList.size()) continue;
+
+        sceneStore.setTransform(meshList[modelIds[i]].getFirstObject(), newModels[i]);
+    }
+
+    // Push constants are recorded in the command buffers, buffer modes read the model at draw time
+    if (objectDataMode == ObjectDataMode::PUSH_CONSTANT)
+        markSceneDirty();
+}
+
+void VulkanRenderer::setParent(int meshId, int parentMeshId)
+{
+    if (meshId < 0 || meshId >= meshList.size() || parentMeshId >= static_cast<int>(meshList.size())) return;
+
+    uint32_t parent = parentMeshId < 0 ? NO_PARENT : meshList[parentMeshId].getFirstObject();
+    uint32_t firstObject = meshList[meshId].getFirstObject();
+    for (uint32_t object = firstObject; object < firstObject + meshList[meshId].getInstanceCount(); ++object)
+    {
+        sceneStore.setParent(object, parent);
+    }
+
+    if (objectDataMode == ObjectDataMode::PUSH_CONSTANT)
+        markSceneDirty();
+}
+
+void VulkanRenderer::updateInstances(int meshId, const std::vector<Model> & instances)
+{
+    if (meshId >= meshList.size()) return;
+
+    // The instance count is fixed when the mesh is added, extra instances are ignored
+    size_t count = std::min<size_t>(instances.size(), meshList[meshId].getInstanceCount());
+    uint32_t firstObject = meshList[meshId].getFirstObject();
+    for (size_t i = 0; i < count; ++i)
+    {
+        sceneStore.setObject(firstObject + static_cast<uint32_t>(i), instances[i]);
+    }
+
+    if (objectDataMode == ObjectDataMode::PUSH_CONSTANT)
+        markSceneDirty();
+}
+
+void VulkanRenderer::updateView(glm::mat4 newView)
+{
+    // View projection is written to the arena every frame, nothing to re-record
+    uboViewProjection.view = newView;
+}
+
+void VulkanRenderer::markSceneDirty()
+{
+    // Every command buffer gets re-recorded the next time its image is drawn
+    ++sceneVersion;
+}
+
+void VulkanRenderer::cullObjects(uint32_t currentImage, FrameTimings * timings)
+{
+    if (!frustumCulling)
+    {
+        timings->visibleObjects = static_cast<uint32_t>(sceneStore.size());
+        return;
+    }
+
+    // Culled by the frame's command buffer : only the count of the image's last frame is known (one swapchain loop late)
+    if (gpuCulling)
+    {
+        timings->visibleObjects = std::min(gpuCuller.getVisibleCount(currentImage), static_cast<uint32_t>(sceneStore.size()));
+        timings->culledObjects = static_cast<uint32_t>(sceneStore.size()) - timings->visibleObjects;
+        return;
+    }
+
+    frustumCuller.setFrustum(uboViewProjection.projection * uboViewProjection.view);
+    size_t visibleCount = frustumCuller.cull(objectVisible.data());
+    timings->visibleObjects = static_cast<uint32_t>(visibleCount);
+    timings->culledObjects = static_cast<uint32_t>(sceneStore.size() - visibleCount);
 
-    meshList[modelId].setModel(newModel);
+    // Direct draws are recorded for the visible objects : re-record when they change.
+    // Indirect draws read this frame's draw commands from the arena, their command buffers don't change.
+    if (!indirectDrawing && objectVisible != previousObjectVisible)
+    {
+        previousObjectVisible = objectVisible;
+        markSceneDirty();
+    }
+}
+
+MemoryAllocatorStats VulkanRenderer::getMemoryStats()
+{
+    return memoryAllocator.getStats();
+}
+
+StagingUploaderStats VulkanRenderer::getUploadStats()
+{
+    return stagingUploader.getStats();
+}
+
+FrameTimings VulkanRenderer::getLastFrameTimings()
+{
+    return lastFrameTimings;
+}
+
+StartupTimings VulkanRenderer::getStartupTimings()
+{
+    return startupTimings;
+}
+
+PipelineLibraryStats VulkanRenderer::getPipelineStats()
+{
+    return pipelineLibrary.getStats();
+}
+
+MeshOptimizerStats VulkanRenderer::getMeshOptimizerStats()
+{
+    return meshOptimizerStats;
 }
 
 void VulkanRenderer::destroy()
@@ -102,41 +443,57 @@ void VulkanRenderer::destroy()
     // Wait until no actions being run on device before destroying.
     vkDeviceWaitIdle(mainDevice.logicalDevice);
 
-    //_aligned_free(modelTransferSpace);
+    // Resources retired at runtime and not released yet
+    deletionQueue.destroy();
+
+    freeDynamicBufferTransferSpace();
 
     vkDestroyImageView(mainDevice.logicalDevice, depthBufferImageView, nullptr);
     vkDestroyImage(mainDevice.logicalDevice, depthBufferImage, nullptr);
-    vkFreeMemory(mainDevice.logicalDevice, depthBufferImageMemory, nullptr);
+    memoryAllocator.free(depthBufferImageMemory);
 
     vkDestroyDescriptorPool(mainDevice.logicalDevice, descriptorPool, nullptr);
     vkDestroyDescriptorSetLayout(mainDevice.logicalDevice, descriptorSetLayout, nullptr);
-    for (size_t i = 0; i < vpUniformBuffer.size(); ++i)
-    {
-        vkDestroyBuffer(mainDevice.logicalDevice, vpUniformBuffer[i], nullptr);
-        vkFreeMemory(mainDevice.logicalDevice, vpUniformBufferMemory[i], nullptr);
-        //vkDestroyBuffer(mainDevice.logicalDevice, modelDynamicUniformBuffer[i], nullptr);
-        //vkFreeMemory(mainDevice.logicalDevice, modelDynamicUniformBufferMemory[i], nullptr);
-    }
-    for (size_t i = 0; i < meshList.size(); i++)
+    if (gpuCulling)
+        gpuCuller.destroy();
+    frameArena.destroy();
+    if (indirectDrawing && !compactVisibleObjects)
     {
-        meshList[i].destroyVertexBuffer();
+        vkDestroyBuffer(mainDevice.logicalDevice, indirectBuffer, nullptr);
+        memoryAllocator.free(indirectBufferMemory);
     }
+    meshPool.destroy();
 
-    for (size_t i = 0; i < MAX_FRAME_DRAWS; ++i)
+    destroyFrameContexts();
+    destroyRenderFinishedSemaphores();
+
+    // Secondary command buffers are freed with their pools
+    for (auto & imageSecondaries : secondaryCommands)
     {
-        vkDestroySemaphore(mainDevice.logicalDevice, renderFinished[i], nullptr);
-        vkDestroySemaphore(mainDevice.logicalDevice, imageAvailable[i], nullptr);
-        vkDestroyFence(mainDevice.logicalDevice, drawFences[i], nullptr);
+        for (auto & secondary : imageSecondaries)
+        {
+            vkDestroyCommandPool(mainDevice.logicalDevice, secondary.commandPool, nullptr);
+        }
     }
+    jobSystem.destroy();
 
+    // Uploader command buffers come from the transfer and graphics pools, release them first
+    stagingUploader.destroy();
+    vkDestroyCommandPool(mainDevice.logicalDevice, transferCommandPool, nullptr);
     vkDestroyCommandPool(mainDevice.logicalDevice, graphicsCommandPool, nullptr);
+    if (transferQueue != graphicsQueue)
+        transferTimeline.destroy();
+    graphicsTimeline.destroy();
 
     for (auto& framebuffer : swapChainFramebuffers)
     {
         vkDestroyFramebuffer(mainDevice.logicalDevice, framebuffer, nullptr);
     }
 
-    vkDestroyPipeline(mainDevice.logicalDevice, graphicsPipeline, nullptr);
+    // Compile threads stopped and every pipeline destroyed (the default one and all variants)
+    pipelineLibrary.destroy();
+    // Everything compiled this run is in the cache : written back for the next startup
+    pipelineCache.destroy();
     vkDestroyPipelineLayout(mainDevice.logicalDevice, pipelineLayout, nullptr);
     vkDestroyRenderPass(mainDevice.logicalDevice, renderPass, nullptr);
 
@@ -145,8 +502,29 @@ void VulkanRenderer::destroy()
         vkDestroyImageView(mainDevice.logicalDevice, image.imageView, nullptr);
     }
 
-    vkDestroySwapchainKHR(mainDevice.logicalDevice, swapchain, nullptr);
-    vkDestroySurfaceKHR(__instance, surface, nullptr);
+    if (headless)
+    {
+        // Offscreen images and readback buffers are owned by the renderer, not by a swapchain
+        for (size_t i = 0; i < swapChainImages.size(); ++i)
+        {
+            vkDestroyImage(mainDevice.logicalDevice, swapChainImages[i].image, nullptr);
+            memoryAllocator.free(offscreenImageMemory[i]);
+        }
+        for (size_t i = 0; i < readbackBuffers.size(); ++i)
+        {
+            memoryAllocator.unmap(readbackBufferMemory[i]);
+            vkDestroyBuffer(mainDevice.logicalDevice, readbackBuffers[i], nullptr);
+            memoryAllocator.free(readbackBufferMemory[i]);
+        }
+    }
+    else
+    {
+        vkDestroySwapchainKHR(mainDevice.logicalDevice, swapchain, nullptr);
+        vkDestroySurfaceKHR(__instance, surface, nullptr);
+    }
+
+    // Every resource has given its memory back, release the blocks themselves
+    memoryAllocator.destroy();
     vkDestroyDevice(mainDevice.logicalDevice, nullptr);
 
     if (enableValidationLayers)
@@ -157,27 +535,134 @@ void VulkanRenderer::destroy()
 
 void VulkanRenderer::draw()
 {
+    FrameTimings timings = {};
+    auto stepStart = std::chrono::steady_clock::now();
+
+    // World matrices of the objects changed since the last frame (and of their children), and their bounds for the CPU culling
+    sceneStore.updateWorld(frustumCulling && !gpuCulling ? &frustumCuller : nullptr, &jobSystem);
+    timings.transformMs = elapsedMs(stepStart);
+    stepStart = std::chrono::steady_clock::now();
+
+    // Window resized, or the swapchain no longer matches the surface : replace it before anything is uploaded for this frame
+    // (minimized window : nothing to draw into, the frame is skipped)
+    if (swapChainOutdated && !recreateSwapChain())
+        return;
+
+    // More objects than the object data has room for : resize it (rare, the old buffers are released once unused)
+    if (objectDataMode != ObjectDataMode::PUSH_CONSTANT && sceneStore.size() > objectCapacity)
+        growObjectCapacity();
+
+    // Draw commands of the meshes added since the last frame
+    if (drawLayoutDirty)
+        layoutDrawCommands();
+    if (indirectDrawing && !compactVisibleObjects && uploadedDrawCommands < drawCommands.size())
+    {
+        stagingUploader.uploadBuffer(&drawCommands[uploadedDrawCommands],
+            sizeof(VkDrawIndexedIndirectCommand) * (drawCommands.size() - uploadedDrawCommands),
+            indirectBuffer, sizeof(VkDrawIndexedIndirectCommand) * uploadedDrawCommands);
+        uploadedDrawCommands = drawCommands.size();
+    }
+    if (gpuCulling)
+        gpuCuller.upload();
+
+    // Submit uploads recorded since the last frame before the frame that may use them
+    if (stagingUploader.hasPendingUploads())
+        stagingUploader.flush();
+
+    timings.acquireMs = elapsedMs(stepStart);
+
+    // -- WAIT FOR THE FRAME CONTEXT --
+    // Its previous submission must be done before its semaphore is signaled again by the acquire
+    FrameContext & frame = frames[currentFrame];
+    stepStart = std::chrono::steady_clock::now();
+    graphicsTimeline.wait(frame.submitValue);
+    timings.fenceWaitMs = elapsedMs(stepStart);
+
+    // Resources replaced while older frames were still using them are released together once these frames are done
+    deletionQueue.retire(graphicsTimeline.getCompleted());
+
     // -- GET NEXT IMAGE --
     // Get index of next image to be drawn to, and signal semaphore when ready to be drawn to
-    uint32_t imageIndex;
-    vkAcquireNextImageKHR(mainDevice.logicalDevice, swapchain,
-        std::numeric_limits<uint64_t>::max(), imageAvailable[currentFrame], VK_NULL_HANDLE, &imageIndex);
+    // (headless : offscreen images are used in turn, nothing to acquire)
+    stepStart = std::chrono::steady_clock::now();
+    uint32_t imageIndex = static_cast<uint32_t>(frameCounter % swapChainImages.size());
+    if (!headless)
+    {
+        VkResult acquireResult = vkAcquireNextImageKHR(mainDevice.logicalDevice, swapchain,
+            std::numeric_limits<uint64_t>::max(), frame.imageAvailable, VK_NULL_HANDLE, &imageIndex);
 
-	// Wait for given fence to signal (open) from last draw before continuing
-	vkWaitForFences(mainDevice.logicalDevice, 1, &drawFences[currentFrame], VK_TRUE, std::numeric_limits<uint64_t>::max());
-	// Manually reset (close) fences
-	vkResetFences(mainDevice.logicalDevice, 1, &drawFences[currentFrame]);
+        // Out of date : no image was acquired (and the semaphore won't be signaled), skip the frame and recreate on the next one
+        if (acquireResult == VK_ERROR_OUT_OF_DATE_KHR)
+        {
+            swapChainOutdated = true;
+            return;
+        }
+        if (acquireResult != VK_SUCCESS && acquireResult != VK_SUBOPTIMAL_KHR)
+        {
+            throw std::runtime_error("Failed to acquire a swapchain image !");
+        }
+
+        // Suboptimal still presents : this frame is drawn, the swapchain is recreated after presenting it
+        if (acquireResult == VK_SUBOPTIMAL_KHR)
+            swapChainOutdated = true;
+    }
+    timings.acquireMs += elapsedMs(stepStart);
+
+    // The image may have been drawn last by another frame context (more images than frames in flight, or the opposite) :
+    // also wait for that frame, so the image's command buffer, arena slice and semaphore are no longer in use
+    stepStart = std::chrono::steady_clock::now();
+    graphicsTimeline.wait(imagesInFlight[imageIndex]);
+    timings.fenceWaitMs += elapsedMs(stepStart);
+
+    // GPU is done with this image, its arena slice can be rewritten
+    // (slices follow the image, like command buffers, so the offsets recorded in its command buffer stay valid)
+    // Visibility decides which object data is written and which draws are recorded
+    stepStart = std::chrono::steady_clock::now();
+    cullObjects(imageIndex, &timings);
+    timings.cullMs = elapsedMs(stepStart);
+
+    stepStart = std::chrono::steady_clock::now();
+
+    // Switch to the requested scene pipeline once it's compiled, never waiting for it.
+    // Pipelines live as long as the library : frames still recorded with the previous one stay valid
+    VkPipeline readyPipeline = pipelineLibrary.getPipeline(scenePipeline);
+    if (readyPipeline != VK_NULL_HANDLE && readyPipeline != graphicsPipeline)
+    {
+        graphicsPipeline = readyPipeline;
+        markSceneDirty();
+    }
 
-    recordCommands(imageIndex);
+    frameArena.beginFrame(imageIndex);
 
-    updateUniformBuffers(imageIndex);
+    // Uniform data is written first, the commands need its arena offsets
+    updateUniformBuffers();
+
+    // Commands only change with the scene structure : steady frames just resubmit the recorded command buffer
+    RecordedCommands & recorded = recordedCommands[imageIndex];
+    if (recorded.sceneVersion != sceneVersion || recorded.vpUniformOffset != vpUniformOffset
+        || recorded.modelDataOffset != modelDataOffset || recorded.drawCountOffset != drawCountOffset
+        || recorded.drawCommandOffset != drawCommandOffset)
+    {
+        recordCommands(imageIndex);
+
+        recorded.sceneVersion = sceneVersion;
+        recorded.vpUniformOffset = vpUniformOffset;
+        recorded.modelDataOffset = modelDataOffset;
+        recorded.drawCountOffset = drawCountOffset;
+        recorded.drawCommandOffset = drawCommandOffset;
+        timings.recorded = true;
+    }
+
+    // Everything written to the arena this frame is flushed at once (no-op on coherent memory)
+    frameArena.flush();
+    timings.recordMs = elapsedMs(stepStart);
 
     // -- SUBMIT COMMAND BUFFER TO RENDER --
     // Queue submission information
     VkSubmitInfo submitInfo = {};
     submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
     submitInfo.waitSemaphoreCount = 1;                      // Number of semaphores to wait on
-    submitInfo.pWaitSemaphores = &imageAvailable[currentFrame];           // List of semaphores to wait on
+    submitInfo.pWaitSemaphores = &frame.imageAvailable;         // List of semaphores to wait on
     VkPipelineStageFlags waitStages[] = {
         VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT
     };
@@ -185,35 +670,230 @@ void VulkanRenderer::draw()
     submitInfo.commandBufferCount = 1;                          // Number of commands to submit
     submitInfo.pCommandBuffers = &commandBuffers[imageIndex];   // Command buffer to submit
     submitInfo.signalSemaphoreCount = 1;                        // Number of semaphores to signal
-    submitInfo.pSignalSemaphores = &renderFinished[currentFrame];             // Semaphores to signal when command buffer finishes
+    submitInfo.pSignalSemaphores = &renderFinished[imageIndex]; // Semaphores to signal when command buffer finishes
 
-    // Submit command buffer to queue.
-    VkResult result = vkQueueSubmit(graphicsQueue, 1, &submitInfo, drawFences[currentFrame]);
+    // Headless : no acquire to wait for and no present waiting on us
+    if (headless)
+    {
+        submitInfo.waitSemaphoreCount = 0;
+        submitInfo.signalSemaphoreCount = 0;
+    }
 
-    if (result != VK_SUCCESS)
+    // Submit command buffer to queue, the frame and its image are done once the graphics timeline reaches its value
+    stepStart = std::chrono::steady_clock::now();
+    frame.submitValue = graphicsTimeline.submit(submitInfo);
+    imagesInFlight[imageIndex] = frame.submitValue;
+    timings.submitMs = elapsedMs(stepStart);
+
+    lastDrawnFrame = currentFrame;
+    lastDrawnImage = imageIndex;
+    lastFrameTimings = timings;
+
+    if (headless)
     {
-        throw std::runtime_error("Failed to submit Command Buffer to Queue !");
+        // Get next frame
+        currentFrame = (currentFrame + 1) % maxFramesInFlight;
+        ++frameCounter;
+        return;
     }
 
     // -- PRESENT RENDERED IMAGE TO SCREEN --
     VkPresentInfoKHR presentInfo = {};
     presentInfo.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR;
     presentInfo.waitSemaphoreCount = 1;             // Number of semaphores to wait on
-    presentInfo.pWaitSemaphores = &renderFinished[currentFrame];  // Semaphores to wait on
+    presentInfo.pWaitSemaphores = &renderFinished[imageIndex];    // Semaphores to wait on
     presentInfo.swapchainCount = 1;                 // Number of swapchains to present to
     presentInfo.pSwapchains = &swapchain;           // Swapchains to present images to
     presentInfo.pImageIndices = &imageIndex;        // Index of images in swapchains to present
 
     // Present image
-    result = vkQueuePresentKHR(presentationQueue, &presentInfo);
+    stepStart = std::chrono::steady_clock::now();
+    VkResult result = vkQueuePresentKHR(presentationQueue, &presentInfo);
+    lastFrameTimings.presentMs = elapsedMs(stepStart);
 
-    if (result != VK_SUCCESS)
+    if (result == VK_ERROR_OUT_OF_DATE_KHR || result == VK_SUBOPTIMAL_KHR)
+    {
+        swapChainOutdated = true;
+    }
+    else if (result != VK_SUCCESS)
     {
         throw std::runtime_error("Failed to present image !");
     }
 
     // Get next frame
-    currentFrame = (currentFrame + 1) % MAX_FRAME_DRAWS;
+    currentFrame = (currentFrame + 1) % maxFramesInFlight;
+    ++frameCounter;
+}
+
+void VulkanRenderer::notifyResize()
+{
+    // Some platforms never report the swapchain as out of date on resize
+    if (!headless)
+        swapChainOutdated = true;
+}
+
+bool VulkanRenderer::recreateSwapChain()
+{
+    // Minimized : the surface has no size until the window is restored
+    int width = 0, height = 0;
+    glfwGetFramebufferSize(__window, &width, &height);
+    if (width == 0 || height == 0)
+        return false;
+
+    // Only the frames in flight can still use the old images, depth buffer and framebuffers : nothing waits for them,
+    // the deletion queue releases them once the graphics timeline reaches the last submitted frame
+    uint64_t lastUse = graphicsTimeline.getLastSubmitted();
+    for (auto & framebuffer : swapChainFramebuffers)
+    {
+        deletionQueue.deleteFramebuffer(lastUse, framebuffer);
+    }
+    for (auto & image : swapChainImages)
+    {
+        deletionQueue.deleteImageView(lastUse, image.imageView);
+    }
+    deletionQueue.deleteImageView(lastUse, depthBufferImageView);
+    deletionQueue.deleteImage(lastUse, depthBufferImage, depthBufferImageMemory);
+
+    // Render pass and pipeline are kept : same format, and the viewport/scissor are dynamic
+    size_t previousImageCount = swapChainImages.size();
+    swapChainImages.clear();
+    createSwapChain();
+    createDepthBufferImage();
+    createFramebuffers();
+
+    // Same image count : command buffers, arena slices and semaphores of image i are reused by the new image i,
+    // so its images in flight value still guards them
+    if (swapChainImages.size() != previousImageCount)
+        recreateImageResources();
+
+    // Aspect ratio follows the window
+    uboViewProjection.projection = glm::perspective(glm::radians(45.0f), (float)swapChainExtent.width / (float)swapChainExtent.height, 0.1f, 100.0f);
+    uboViewProjection.projection[1][1] *= -1;
+
+    // Command buffers were recorded with the old framebuffers and extent
+    markSceneDirty();
+    swapChainOutdated = false;
+    return true;
+}
+
+void VulkanRenderer::recreateImageResources()
+{
+    // Rare : the new swapchain doesn't have as many images as the old one, everything kept per image is rebuilt.
+    // Only the frames in flight (graphics queue) can still use the old command buffers, arena slices, culling results,
+    // descriptor sets and semaphores : like the framebuffers, they're released once the graphics timeline reaches
+    // the last submitted frame, and new ones are created right away
+    uint64_t lastUse = graphicsTimeline.getLastSubmitted();
+    VkDevice device = mainDevice.logicalDevice;
+
+    VkCommandPool commandPool = graphicsCommandPool;
+    std::vector<VkCommandBuffer> oldCommandBuffers = commandBuffers;
+    std::vector<VkCommandPool> oldSecondaryPools;
+    for (auto & imageSecondaries : secondaryCommands)
+    {
+        for (auto & secondary : imageSecondaries)
+        {
+            oldSecondaryPools.push_back(secondary.commandPool);
+        }
+    }
+    secondaryCommands.clear();
+    VkDescriptorPool oldDescriptorPool = descriptorPool;
+    std::vector<VkSemaphore> oldRenderFinished = renderFinished;
+    renderFinished.clear();
+    deletionQueue.push(lastUse, [device, commandPool, oldCommandBuffers, oldSecondaryPools, oldDescriptorPool, oldRenderFinished]() {
+        vkFreeCommandBuffers(device, commandPool, static_cast<uint32_t>(oldCommandBuffers.size()), oldCommandBuffers.data());
+        for (auto secondaryPool : oldSecondaryPools)
+        {
+            vkDestroyCommandPool(device, secondaryPool, nullptr);
+        }
+        vkDestroyDescriptorPool(device, oldDescriptorPool, nullptr);
+        for (auto semaphore : oldRenderFinished)
+        {
+            vkDestroySemaphore(device, semaphore, nullptr);
+        }
+    });
+
+    if (gpuCulling)
+        gpuCuller.retire(&deletionQueue, lastUse);
+    FrameArena oldFrameArena = frameArena;
+    deletionQueue.push(lastUse, [oldFrameArena]() mutable {
+        oldFrameArena.destroy();
+    });
+
+    createCommandBuffers();
+    createSecondaryCommandBuffers();
+    createFrameArena();
+    createGpuCuller();
+    createDescriptorPool();
+    createDescriptorSets();
+    createRenderFinishedSemaphores();
+    recordedCommands.assign(swapChainImages.size(), RecordedCommands());
+
+    // Every per image resource is new : no image has a submission to wait for
+    imagesInFlight.assign(swapChainImages.size(), 0);
+}
+
+void VulkanRenderer::readbackFrame(std::vector<uint8_t> * pixels)
+{
+    if (!headless || !readbackEnabled)
+    {
+        throw std::runtime_error("Readback needs a headless renderer with readback enabled !");
+    }
+    if (lastDrawnFrame < 0)
+    {
+        throw std::runtime_error("No frame to read back !");
+    }
+
+    // Copy was recorded at the end of the frame, wait for exactly that submission
+    graphicsTimeline.wait(imagesInFlight[lastDrawnImage]);
+
+    size_t frameSize = static_cast<size_t>(swapChainExtent.width) * swapChainExtent.height * 4;
+    pixels->resize(frameSize);
+    memcpy(pixels->data(), readbackData[lastDrawnImage], frameSize);
+}
+
+bool VulkanRenderer::isHeadless()
+{
+    return headless;
+}
+
+VkExtent2D VulkanRenderer::getExtent()
+{
+    return swapChainExtent;
+}
+
+PipelineDescription VulkanRenderer::getDefaultPipelineDescription()
+{
+    PipelineDescription description;
+
+    // Vertex shader depends on where the model comes from : push constant (shader1), dynamic uniform (shader4), storage buffer (shader5)
+    description.vertexShader = "Shaders/shader1_vert.spv";
+    if (objectDataMode == ObjectDataMode::DYNAMIC_UNIFORM)
+        description.vertexShader = "Shaders/shader4_vert.spv";
+    else if (objectDataMode == ObjectDataMode::STORAGE_BUFFER)
+        description.vertexShader = gpuCulling ? "Shaders/shader6_vert.spv" : "Shaders/shader5_vert.spv";
+    description.fragmentShader = "Shaders/shader1_frag.spv";
+
+    // Vertex input matches how the mesh pool stores the vertices
+    getVertexInputDescriptions(vertexLayout, &description.vertexBindings, &description.vertexAttributes);
+
+    // Fixed function state : filled triangles, back faces culled, depth tested and written, alpha blended
+    // (PipelineDescription defaults)
+    return description;
+}
+
+PipelineHandle VulkanRenderer::requestPipeline(const PipelineDescription & description)
+{
+    return pipelineLibrary.request(description);
+}
+
+bool VulkanRenderer::isPipelineReady(PipelineHandle pipeline)
+{
+    return pipelineLibrary.isReady(pipeline);
+}
+
+void VulkanRenderer::setScenePipeline(PipelineHandle pipeline)
+{
+    scenePipeline = pipeline;
 }
 
 void VulkanRenderer::createInstance()
@@ -226,7 +906,7 @@ void VulkanRenderer::createInstance()
     appInfo.applicationVersion = VK_MAKE_VERSION(1, 0, 0);      // Custom version
     appInfo.pEngineName = "No Engine";                          // Custom engine name
     appInfo.engineVersion = VK_MAKE_VERSION(1, 0, 0);           // Custom engine version
-    appInfo.apiVersion = VK_API_VERSION_1_0;                    // /!\ Vulkan version !
+    appInfo.apiVersion = getInstanceApiVersion();               // /!\ Vulkan version !
 
     // Creation infos for a VKInstance.
     VkInstanceCreateInfo createInfo = {};
@@ -237,16 +917,26 @@ void VulkanRenderer::createInstance()
     // Create list to hold instance extensions.
     std::vector<const char *> instanceExtensions;
 
-    // Setup extension Instance will use
-    uint32_t glfwExtensionCount = 0;            // GLFW may require multiple extensions.
-    const char ** glfwExtensions;               // Extensions passed as array of cstrings.
+    // Setup extension Instance will use (headless : no surface, so no surface extensions)
+    if (!headless)
+    {
+        uint32_t glfwExtensionCount = 0;            // GLFW may require multiple extensions.
+        const char ** glfwExtensions;               // Extensions passed as array of cstrings.
 
-    // Get GLFW extensions.
-    glfwExtensions = glfwGetRequiredInstanceExtensions(&glfwExtensionCount);
+        // Get GLFW extensions.
+        glfwExtensions = glfwGetRequiredInstanceExtensions(&glfwExtensionCount);
 
-    // Add GLFW extensions to list of extensions.
-    for (size_t i = 0; i < glfwExtensionCount; ++i)
-        instanceExtensions.push_back(glfwExtensions[i]);
+        // Add GLFW extensions to list of extensions.
+        for (size_t i = 0; i < glfwExtensionCount; ++i)
+            instanceExtensions.push_back(glfwExtensions[i]);
+    }
+
+    // Render farm / CI machines often have no validation layers installed, don't fail headless runs on it
+    if (headless && enableValidationLayers && !checkValidationLayerSupport())
+    {
+        printf("Validation layers not available, running headless without them\n");
+        enableValidationLayers = false;
+    }
 
     // If validation enabled, add extension to report validation debug info
     if (enableValidationLayers)
@@ -287,17 +977,17 @@ void VulkanRenderer::createLogicalDevice()
     QueueFamilyIndices indices = getQueueFamilies(mainDevice.physicalDevice);
 
     std::vector<VkDeviceQueueCreateInfo> queueCreateInfos;
-    std::set<int> queueFamilyIndices = { indices.graphicsFamily, indices.presentationFamily };
+    std::set<int> queueFamilyIndices = { indices.graphicsFamily, indices.presentationFamily, indices.transferFamily };
 
     // Queue the logical device needs to create and info to do so
-    // (only 1 for now, will add more later !)
+    // (one queue per family, priority has to outlive the loop as vkCreateDevice reads it)
+    float priority = 1.0f;
     for (int queueFamilyIndex : queueFamilyIndices)
     {
         VkDeviceQueueCreateInfo queueCreateInfo = {};
         queueCreateInfo.sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO;
         queueCreateInfo.queueFamilyIndex = queueFamilyIndex;  // Index of the family
         queueCreateInfo.queueCount = 1;                       // to create a queue from
-        float priority = 1.0f;
         queueCreateInfo.pQueuePriorities = &priority;
 
 		queueCreateInfos.push_back(queueCreateInfo);
@@ -308,26 +998,113 @@ void VulkanRenderer::createLogicalDevice()
     deviceCreateInfo.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
     deviceCreateInfo.queueCreateInfoCount = static_cast<uint32_t>(queueCreateInfos.size());              // Number of Queue Create Info
     deviceCreateInfo.pQueueCreateInfos = queueCreateInfos.data();  // List of queue create infos so device can create required queues
-    deviceCreateInfo.enabledExtensionCount = static_cast<uint32_t>(deviceExtensions.size()); // Number of enabled logical device extensions
-    deviceCreateInfo.ppEnabledExtensionNames = deviceExtensions.data();     // List of enabled device extensions
+
+    // Headless : nothing is presented, VK_KHR_swapchain isn't needed (and may not exist on software ICDs)
+    std::vector<const char *> enabledExtensions;
+    if (!headless)
+        enabledExtensions = deviceExtensions;
 
     // Physical Device Features the Logical Device will be using.
+    VkPhysicalDeviceFeatures supportedFeatures;
+    vkGetPhysicalDeviceFeatures(mainDevice.physicalDevice, &supportedFeatures);
+
     VkPhysicalDeviceFeatures deviceFeatures = {};
     //deviceFeatures.depthClamp = VK_TRUE;
 
+    // Indirect drawing : several draws per call, with the object index as firstInstance (needs the storage buffer object data)
+    deviceFeatures.multiDrawIndirect = supportedFeatures.multiDrawIndirect;
+    deviceFeatures.drawIndirectFirstInstance = supportedFeatures.drawIndirectFirstInstance;
+    indirectDrawing = indirectDrawingRequested && objectDataMode == ObjectDataMode::STORAGE_BUFFER
+                      && supportedFeatures.drawIndirectFirstInstance;
+
+    // GPU culling dispatches its compute pass in the graphics queue, right before the draws
+    uint32_t queueFamilyCount = 0;
+    vkGetPhysicalDeviceQueueFamilyProperties(mainDevice.physicalDevice, &queueFamilyCount, nullptr);
+    std::vector<VkQueueFamilyProperties> queueFamilyList(queueFamilyCount);
+    vkGetPhysicalDeviceQueueFamilyProperties(mainDevice.physicalDevice, &queueFamilyCount, queueFamilyList.data());
+    gpuCulling = frustumCulling && gpuCullingRequested && indirectDrawing
+                 && (queueFamilyList[indices.graphicsFamily].queueFlags & VK_QUEUE_COMPUTE_BIT);
+    compactVisibleObjects = frustumCulling && !gpuCulling && objectDataMode == ObjectDataMode::STORAGE_BUFFER;
+
+    // Draw count read from a buffer (optional, core in Vulkan 1.2)
+    bool drawIndirectCount = indirectDrawing && supportedFeatures.multiDrawIndirect
+                             && checkDeviceExtensionAvailable(mainDevice.physicalDevice, VK_KHR_DRAW_INDIRECT_COUNT_EXTENSION_NAME);
+    if (drawIndirectCount)
+        enabledExtensions.push_back(VK_KHR_DRAW_INDIRECT_COUNT_EXTENSION_NAME);
+
+    deviceCreateInfo.enabledExtensionCount = static_cast<uint32_t>(enabledExtensions.size()); // Number of enabled logical device extensions
+    deviceCreateInfo.ppEnabledExtensionNames = enabledExtensions.empty() ? nullptr : enabledExtensions.data();     // List of enabled device extensions
+
     deviceCreateInfo.pEnabledFeatures = &deviceFeatures;    // Physical device features logical device will use.
 
+    // Vulkan 1.2 features : timeline semaphores, every submission then signals a counter value the CPU waits on
+    // (without them, the submit timelines fall back to fences)
+    VkPhysicalDeviceProperties deviceProperties;
+    vkGetPhysicalDeviceProperties(mainDevice.physicalDevice, &deviceProperties);
+
+    VkPhysicalDeviceVulkan12Features supportedFeatures12 = {};
+    supportedFeatures12.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
+    auto getPhysicalDeviceFeatures2 = (PFN_vkGetPhysicalDeviceFeatures2)vkGetInstanceProcAddr(__instance, "vkGetPhysicalDeviceFeatures2");
+    if (instanceApiVersion >= VK_API_VERSION_1_2 && deviceProperties.apiVersion >= VK_API_VERSION_1_2 && getPhysicalDeviceFeatures2 != nullptr)
+    {
+        VkPhysicalDeviceFeatures2 supportedFeatures2 = {};
+        supportedFeatures2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+        supportedFeatures2.pNext = &supportedFeatures12;
+        getPhysicalDeviceFeatures2(mainDevice.physicalDevice, &supportedFeatures2);
+    }
+
+    VkPhysicalDeviceVulkan12Features deviceFeatures12 = {};
+    deviceFeatures12.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
+    deviceFeatures12.timelineSemaphore = supportedFeatures12.timelineSemaphore;
+    deviceFeatures12.drawIndirectCount = drawIndirectCount ? supportedFeatures12.drawIndirectCount : VK_FALSE;  // Must match the enabled extension
+    timelineSemaphores = deviceFeatures12.timelineSemaphore == VK_TRUE;
+    if (timelineSemaphores)
+        deviceCreateInfo.pNext = &deviceFeatures12;
+
     VkResult result = vkCreateDevice(mainDevice.physicalDevice, &deviceCreateInfo, nullptr, &mainDevice.logicalDevice);
 
     if (result != VK_SUCCESS)
         throw std::runtime_error("Failed to create a logical device.");
 
+    multiDrawIndirect = deviceFeatures.multiDrawIndirect == VK_TRUE;
+    if (drawIndirectCount)
+    {
+        cmdDrawIndexedIndirectCount = (PFN_vkCmdDrawIndexedIndirectCountKHR)vkGetDeviceProcAddr(mainDevice.logicalDevice,
+                                                                                                 "vkCmdDrawIndexedIndirectCountKHR");
+    }
+
     // Queues are created at the same time as the device.
     // So we want to handle queues
     // From given logical device,of given queue family, of given queue index
     // (0 since only one queue), please reference in given VkQueue
     vkGetDeviceQueue(mainDevice.logicalDevice, indices.graphicsFamily, 0, &graphicsQueue);
     vkGetDeviceQueue(mainDevice.logicalDevice, indices.presentationFamily, 0, &presentationQueue);
+    vkGetDeviceQueue(mainDevice.logicalDevice, indices.transferFamily, 0, &transferQueue);
+}
+
+void VulkanRenderer::createSubmitTimelines()
+{
+    // Every submission goes through the timeline of its queue. Transfer and graphics can be the same queue :
+    // one timeline then, values signaled by two timelines on one queue wouldn't be in order
+    graphicsTimeline.init(mainDevice.logicalDevice, graphicsQueue, timelineSemaphores);
+    if (transferQueue != graphicsQueue)
+        transferTimeline.init(mainDevice.logicalDevice, transferQueue, timelineSemaphores);
+}
+
+void VulkanRenderer::createPipelineCache()
+{
+    // Loaded before any pipeline is created, a file from another device or driver is ignored
+    pipelineCache.init(mainDevice.logicalDevice, mainDevice.physicalDevice, pipelineCacheFile);
+}
+
+void VulkanRenderer::createMemoryAllocator()
+{
+    // Every buffer and image memory is sub-allocated from the allocator blocks
+    memoryAllocator.init(mainDevice.physicalDevice, mainDevice.logicalDevice);
+
+    // Resources replaced at runtime give their memory back through the deletion queue, on the graphics timeline
+    // (uploads complete on it too : the transfer queue is only separate with an ownership transfer, acquired on graphics)
+    deletionQueue.init(mainDevice.logicalDevice, &memoryAllocator);
 }
 
 void VulkanRenderer::createSurface()
@@ -402,16 +1179,23 @@ void VulkanRenderer::createSwapChain()
     }
 
     // If old swap chain been destroyed and this one replaces it, then link old one to quickly hand over responsibilities
-    swapChainCreateInfos.oldSwapchain = VK_NULL_HANDLE;
+    // (VK_NULL_HANDLE for the first one)
+    swapChainCreateInfos.oldSwapchain = swapchain;
 
     // Create Swapchain
-    VkResult result = vkCreateSwapchainKHR(mainDevice.logicalDevice, &swapChainCreateInfos, nullptr, &swapchain);
+    VkSwapchainKHR newSwapchain;
+    VkResult result = vkCreateSwapchainKHR(mainDevice.logicalDevice, &swapChainCreateInfos, nullptr, &newSwapchain);
 
     if (result != VK_SUCCESS)
     {
         throw std::runtime_error("Failed to create a swapchain !");
     }
 
+    // The old one is retired by the creation, it's destroyed once the frames that used its images are done
+    if (swapchain != VK_NULL_HANDLE)
+        deletionQueue.deleteSwapchain(graphicsTimeline.getLastSubmitted(), swapchain);
+    swapchain = newSwapchain;
+
     // Store for later references
     swapChainImageFormat = surfaceFormat.format;
     swapChainExtent = extent;
@@ -436,6 +1220,42 @@ void VulkanRenderer::createSwapChain()
     }
 }
 
+void VulkanRenderer::createOffscreenImages()
+{
+    // Headless replacement of the swapchain : one color image per frame in flight, rendered to then
+    // copied from (readback), stored in swapChainImages so the rest of the renderer doesn't care
+    swapChainImageFormat = VK_FORMAT_R8G8B8A8_UNORM;
+    offscreenImageMemory.resize(maxFramesInFlight);
+
+    for (int i = 0; i < maxFramesInFlight; ++i)
+    {
+        SwapChainImage offscreenImage = {};
+        offscreenImage.image = createImage(swapChainExtent.width, swapChainExtent.height, swapChainImageFormat, VK_IMAGE_TILING_OPTIMAL,
+            VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+            &offscreenImageMemory[i]);
+        offscreenImage.imageView = createImageView(offscreenImage.image, swapChainImageFormat, VK_IMAGE_ASPECT_COLOR_BIT);
+
+        swapChainImages.push_back(offscreenImage);
+    }
+
+    if (!readbackEnabled)
+        return;
+
+    // Host visible buffers the frames are copied to, mapped for the whole renderer lifetime
+    VkDeviceSize frameSize = static_cast<VkDeviceSize>(swapChainExtent.width) * swapChainExtent.height * 4;
+    readbackBuffers.resize(maxFramesInFlight);
+    readbackBufferMemory.resize(maxFramesInFlight);
+    readbackData.resize(maxFramesInFlight);
+
+    for (int i = 0; i < maxFramesInFlight; ++i)
+    {
+        createBuffer(mainDevice.logicalDevice, &memoryAllocator, frameSize, VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+            VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+            &readbackBuffers[i], &readbackBufferMemory[i]);
+        readbackData[i] = memoryAllocator.map(readbackBufferMemory[i]);
+    }
+}
+
 void VulkanRenderer::createRenderPass()
 {
     // ATTACHMENTS
@@ -452,6 +1272,8 @@ void VulkanRenderer::createRenderPass()
     // to give optimal use for certain operations
     colorAttachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;          // Image data layout before render pass starts
     colorAttachment.finalLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;      // Image data layout after render pass (to change to)
+    if (headless)
+        colorAttachment.finalLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL; // Offscreen image is copied from, not presented
 
     // Depth attachment of render pass
     VkAttachmentDescription depthAttachment = {};
@@ -509,6 +1331,13 @@ void VulkanRenderer::createRenderPass()
 
     subpassDependencies[1].dependencyFlags = 0;
 
+    // Headless : the color image is read by the readback copy instead of the presentation engine
+    if (headless)
+    {
+        subpassDependencies[1].dstStageMask = VK_PIPELINE_STAGE_TRANSFER_BIT;
+        subpassDependencies[1].dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+    }
+
     std::array<VkAttachmentDescription, 2> renderPassAttachments = { colorAttachment, depthAttachment };
 
     // Create render pass create info
@@ -534,24 +1363,39 @@ void VulkanRenderer::createDescriptorSetLayout()
     // UboViewProjection Binding Info
     VkDescriptorSetLayoutBinding vpViewProjectionLayoutBinding = {};
     vpViewProjectionLayoutBinding.binding = 0;                                           // Binding point in shader (designated by binding number in shader)
-    vpViewProjectionLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;    // Type of descriptor (uniform, dynamic uniform, image sample, etc)
+    vpViewProjectionLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;    // Type of descriptor (uniform, dynamic uniform, image sample, etc)
     vpViewProjectionLayoutBinding.descriptorCount = 1;                                   // Number of descriptors for binding
     vpViewProjectionLayoutBinding.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;               // Shader stage to bind to
     vpViewProjectionLayoutBinding.pImmutableSamplers = nullptr;                          // For textures: Can make data sampler unchangeable (immutable) by specifying in layout
 
-    // Model Binding Info
-    /*
-    VkDescriptorSetLayoutBinding modelLayoutBinding = {};
-    modelLayoutBinding.binding = 1;
-    modelLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
-    modelLayoutBinding.descriptorCount = 1;
-    modelLayoutBinding.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
-    modelLayoutBinding.pImmutableSamplers = nullptr;
-    */
-
+    std::vector<VkDescriptorSetLayoutBinding> layoutBindings = { vpViewProjectionLayoutBinding };
 
+    // Model Binding Info (push constants need no binding)
+    if (objectDataMode != ObjectDataMode::PUSH_CONSTANT)
+    {
+        VkDescriptorSetLayoutBinding modelLayoutBinding = {};
+        modelLayoutBinding.binding = 1;
+        modelLayoutBinding.descriptorType = objectDataMode == ObjectDataMode::DYNAMIC_UNIFORM
+            ? VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC : VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC;
+        modelLayoutBinding.descriptorCount = 1;
+        modelLayoutBinding.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
+        modelLayoutBinding.pImmutableSamplers = nullptr;
+
+        layoutBindings.push_back(modelLayoutBinding);
+    }
 
-    std::vector<VkDescriptorSetLayoutBinding> layoutBindings = { vpViewProjectionLayoutBinding };
+    // Visible object indices written by the cull shader (GPU culling)
+    if (gpuCulling)
+    {
+        VkDescriptorSetLayoutBinding visibleObjectsLayoutBinding = {};
+        visibleObjectsLayoutBinding.binding = 2;
+        visibleObjectsLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+        visibleObjectsLayoutBinding.descriptorCount = 1;
+        visibleObjectsLayoutBinding.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
+        visibleObjectsLayoutBinding.pImmutableSamplers = nullptr;
+
+        layoutBindings.push_back(visibleObjectsLayoutBinding);
+    }
 
     // Create descriptor set layout with given bindings
     VkDescriptorSetLayoutCreateInfo layoutCreateInfo = {};
@@ -577,155 +1421,13 @@ void VulkanRenderer::createPushConstantRange()
 
 void VulkanRenderer::createGraphicsPipeline()
 {
-    // Read in SPIR-V code of shaders
-    auto vertexShaderCode = readFile("Shaders/shader1_vert.spv");
-    auto fragmentShaderCode = readFile("Shaders/shader1_frag.spv");
-
-    // Build Shader Modules to link to Graphics Pipeline
-    VkShaderModule vertexShaderModule = createShaderModule(vertexShaderCode);
-    VkShaderModule fragmentShaderModule = createShaderModule(fragmentShaderCode);
-
-    // -- SHADER STAGE CREATION INFO --
-    // Vertex Stage creation information
-    VkPipelineShaderStageCreateInfo vertexShaderCreateInfo = {};
-    vertexShaderCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
-    vertexShaderCreateInfo.stage = VK_SHADER_STAGE_VERTEX_BIT;  // Shader stage name
-    vertexShaderCreateInfo.module = vertexShaderModule;         // Shader module to be used by stage
-    vertexShaderCreateInfo.pName = "main";                      // Entry point in the shader
-
-    // Fragment Stage creation information
-    VkPipelineShaderStageCreateInfo fragmentShaderCreateInfo = {};
-    fragmentShaderCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
-    fragmentShaderCreateInfo.stage = VK_SHADER_STAGE_FRAGMENT_BIT;  // Shader stage name
-    fragmentShaderCreateInfo.module = fragmentShaderModule;         // Shader module to be used by stage
-    fragmentShaderCreateInfo.pName = "main";                      // Entry point in the shader
-
-    // Put shader stage creation info into array
-    // Graphics Pipeline creation info requires array of shader stage creates
-    VkPipelineShaderStageCreateInfo shaderStages[] = { vertexShaderCreateInfo, fragmentShaderCreateInfo };
-
-    // How the data for a single vertex (including info such as position, color, texture coords, normals, etc) is as a whole
-    VkVertexInputBindingDescription bindingDescription = {};
-    bindingDescription.binding = 0;                             // Can bind multiple streams of data
-    bindingDescription.stride = sizeof(Vertex);                 // Size of a single vertex object
-    bindingDescription.inputRate = VK_VERTEX_INPUT_RATE_VERTEX; // How to move between data after each vertex
-                                                                // VK_VERTEX_INPUT_RATE_INDEX       : Move on to the next vertex
-                                                                // VK_VERTEX_INPUT_RATE_DISTANCE    : Move to a vertex for the next instance
-    
-    // How the data for an attribute is defined within a vertex
-    std::array<VkVertexInputAttributeDescription, 2> attributeDescriptions;
-
-    // Position attribute
-    attributeDescriptions[0].binding = 0;           // Which binding the data is at (should be the same as above)
-    attributeDescriptions[0].location = 0;          // Location in shader where data will be read from
-    attributeDescriptions[0].format = VK_FORMAT_R32G32B32A32_SFLOAT;    // Format the data will take (also helps defined size of data)
-    attributeDescriptions[0].offset = offsetof(Vertex, pos);            // Where this attribute is defined in the data for a single vertex
-
-    // Color attribute 
-    attributeDescriptions[1].binding = 0;           // Which binding the data is at (should be the same as above)
-    attributeDescriptions[1].location = 1;          // Location in shader where data will be read from
-    attributeDescriptions[1].format = VK_FORMAT_R32G32B32A32_SFLOAT;    // Format the data will take (also helps defined size of data)
-    attributeDescriptions[1].offset = offsetof(Vertex, col);            // Where this attribute is defined in the data for a single vertex
-
-    // -- Vertex input (TODO: Put in vertex descriptions when resources created) --
-    VkPipelineVertexInputStateCreateInfo vertexInputCreateInfo = {};
-    vertexInputCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
-    vertexInputCreateInfo.vertexBindingDescriptionCount = 1;
-    vertexInputCreateInfo.pVertexBindingDescriptions = &bindingDescription;              // List of Vertex Binding Descriptions (data spacing / stride info)
-    vertexInputCreateInfo.vertexAttributeDescriptionCount = static_cast<uint32_t>(attributeDescriptions.size());
-    vertexInputCreateInfo.pVertexAttributeDescriptions = attributeDescriptions.data();   // List of Vertex Attribute Descriptions (data format and where to bind/to or from)
-
-    // -- Input assembly --
-    VkPipelineInputAssemblyStateCreateInfo inputAssembly = {};
-    inputAssembly.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
-    inputAssembly.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;       // Primitive type to assemble vertices as
-    inputAssembly.primitiveRestartEnable = VK_FALSE;                    // Allow overriding of "strip" topology to start new primitives
-
-    // -- Viewport & Scissor --
-    // Create a viewport info struct
-    VkViewport viewport = {};
-    viewport.x = 0.0f;      // X start coordinates
-    viewport.y = 0.0f;      // Y start coordinates
-    viewport.width = static_cast<float>(swapChainExtent.width);     // width of viewport
-    viewport.height = static_cast<float>(swapChainExtent.height);   // height of viewport
-    viewport.minDepth = 0.0f;   // min framebuffer depth
-    viewport.maxDepth = 1.0f;   // max framebuffer depth
-
-    // Create a scissor info struct
-    VkRect2D scissor = {};
-    scissor.offset = { 0, 0 };          // Offset to use region from
-    scissor.extent = swapChainExtent;   // Extent to describe region to use, starting at offset
-
-    VkPipelineViewportStateCreateInfo viewportStateCreateInfo = {};
-    viewportStateCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
-    viewportStateCreateInfo.viewportCount = 1;
-    viewportStateCreateInfo.pViewports = &viewport;
-    viewportStateCreateInfo.scissorCount = 1;
-    viewportStateCreateInfo.pScissors = &scissor;
-
-    // -- Dynamic states --
-    // Dynamic states to enable
-    std::vector<VkDynamicState> dynamicStateEnables;
-    dynamicStateEnables.push_back(VK_DYNAMIC_STATE_VIEWPORT);   // Dynamic viewport : Can resize in command buffer with vkCmdSetViewport(commandBuffer, 0, 1, &viewport)
-    dynamicStateEnables.push_back(VK_DYNAMIC_STATE_SCISSOR);    // Dynamic Scissor  : Can resize in command buffer with vkCmdSetScissor(commandBuffer, 0, 1, &viewport)
-
-    // Dynamic States creation info
-    VkPipelineDynamicStateCreateInfo dynamicStateCreateInfo = {};
-    dynamicStateCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
-    dynamicStateCreateInfo.dynamicStateCount = static_cast<uint32_t>(dynamicStateEnables.size());
-    dynamicStateCreateInfo.pDynamicStates = dynamicStateEnables.data();
-
-    // -- Rasterizer --
-    VkPipelineRasterizationStateCreateInfo rasterizerCreateInfo = {};
-    rasterizerCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
-    rasterizerCreateInfo.depthClampEnable = VK_FALSE; // = VK_TRUE;         // Change if fragments beyoond near/far planes are clipped (default) or clamped to plane
-    rasterizerCreateInfo.rasterizerDiscardEnable = VK_FALSE;                // Whether to discard data and skip rasterizer. Never creates fragments, only suitable for pipeline without framebuffer output.
-    rasterizerCreateInfo.polygonMode = VK_POLYGON_MODE_FILL;                // How to handle filling points between vertices
-    rasterizerCreateInfo.lineWidth = 1.0f;                                  // How thick lines should be when drawn
-    rasterizerCreateInfo.cullMode = VK_CULL_MODE_BACK_BIT;                  // Which face of a tri to cull
-    rasterizerCreateInfo.frontFace = VK_FRONT_FACE_COUNTER_CLOCKWISE;       // Winding to determine which size is front
-    rasterizerCreateInfo.depthBiasEnable = VK_FALSE;                        // Whether to add depth bias to fragments (good for stopping "shadow acne" in shadow mapping)
-
-    // -- Multi sampling --
-    VkPipelineMultisampleStateCreateInfo multiSamplingCreateInfo = {};
-    multiSamplingCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
-    multiSamplingCreateInfo.sampleShadingEnable = VK_FALSE;                  // Enable multisample shading or not.
-    multiSamplingCreateInfo.rasterizationSamples = VK_SAMPLE_COUNT_1_BIT;   // Number of samples to use per fragment.
-
-    // -- Blending --
-    // Blending decides how to blend a new color being written to a fragment, with the old value
-
-    // Blend attachment state (how blending is handled)
-    VkPipelineColorBlendAttachmentState colorState = {};
-    colorState.colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT         // Colors to apply landing to
-                              | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
-    colorState.blendEnable = VK_TRUE;               // Enable blending
-
-    // Blending uses equation : (srcColorBlendFactor * new color) colorBlendOp (dstColorBlendFactor * old color)
-    colorState.srcColorBlendFactor = VK_BLEND_FACTOR_SRC_ALPHA;
-    colorState.dstColorBlendFactor = VK_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA;
-    colorState.colorBlendOp = VK_BLEND_OP_ADD;
-
-    // Summarised: (VK_BLEND_FACTOR_SRC_ALPHA * new color) + (VK_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA * old color)
-    //             (new color alpha * new color) + ((1 - new color alpha) * old color)
-
-    colorState.srcAlphaBlendFactor = VK_BLEND_FACTOR_ONE;
-    colorState.dstAlphaBlendFactor = VK_BLEND_FACTOR_ZERO;
-    colorState.alphaBlendOp = VK_BLEND_OP_ADD;
-    // Summarised: (1 * new alpha) + (0 * old alpha) = new alpha
-
-    VkPipelineColorBlendStateCreateInfo colorBlendingStateCreateInfo = {};
-    colorBlendingStateCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
-    colorBlendingStateCreateInfo.logicOpEnable = VK_FALSE;              // Alternative to calculations is to use logical operations
-    colorBlendingStateCreateInfo.attachmentCount = 1;
-    colorBlendingStateCreateInfo.pAttachments = &colorState;
-
     // -- Pipeline layout --
+    // Shared by every pipeline of the library : they all read the same descriptor sets and push constants
     VkPipelineLayoutCreateInfo pipelineLayoutCreateInfo = {};
     pipelineLayoutCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
     pipelineLayoutCreateInfo.setLayoutCount = 1;
     pipelineLayoutCreateInfo.pSetLayouts = &descriptorSetLayout;
-    pipelineLayoutCreateInfo.pushConstantRangeCount = 1;
+    pipelineLayoutCreateInfo.pushConstantRangeCount = objectDataMode == ObjectDataMode::PUSH_CONSTANT ? 1 : 0;
     pipelineLayoutCreateInfo.pPushConstantRanges = &pushConstantRange;
 
     // Create Pipeline Layout
@@ -736,47 +1438,16 @@ void VulkanRenderer::createGraphicsPipeline()
         throw std::runtime_error("Failed to create a pipeline layout !");
     }
 
-    // -- Depth Stencil Testing
-    VkPipelineDepthStencilStateCreateInfo depthStencilCreateInfo = {};
-    depthStencilCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO;
-    depthStencilCreateInfo.depthTestEnable = VK_TRUE;           // Enable checking depth to determine fragment write
-    depthStencilCreateInfo.depthWriteEnable = VK_TRUE;          // Enable writing to depth buffer (to replace old values)
-    depthStencilCreateInfo.depthCompareOp = VK_COMPARE_OP_LESS; // Comparison operation that allows an overwrite (is in front)
-    depthStencilCreateInfo.depthBoundsTestEnable = VK_FALSE;    // Depth Bounds Test: Does the depth value exist between two bounds
-    depthStencilCreateInfo.stencilTestEnable = VK_FALSE;        // Enable Stenci Test
-
-    // -- Graphics Pipeline Creation --
-    VkGraphicsPipelineCreateInfo pipelineCreateInfo = {};
-    pipelineCreateInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
-    pipelineCreateInfo.stageCount = 2;                                      // Number of shader stages
-    pipelineCreateInfo.pStages = shaderStages;                              // List of shader stages
-    pipelineCreateInfo.pVertexInputState = &vertexInputCreateInfo;          // All the fixed function pipeline states
-    pipelineCreateInfo.pInputAssemblyState = &inputAssembly;
-    pipelineCreateInfo.pViewportState = &viewportStateCreateInfo;
-    pipelineCreateInfo.pDynamicState = nullptr;// &dynamicStateCreateInfo;
-    pipelineCreateInfo.pRasterizationState = &rasterizerCreateInfo;
-    pipelineCreateInfo.pMultisampleState = &multiSamplingCreateInfo;
-    pipelineCreateInfo.pColorBlendState = &colorBlendingStateCreateInfo;
-    pipelineCreateInfo.pDepthStencilState = &depthStencilCreateInfo;
-    pipelineCreateInfo.layout = pipelineLayout;                             // Pipeline layout pipeline should use
-    pipelineCreateInfo.renderPass = renderPass;                             // Render Pass description the pipeline is compatible with
-    pipelineCreateInfo.subpass = 0;                                         // Subpass of render pass to use with pipeline
-
-    // Pipeline Derivatives : Can Create multiple pipelines that derive from one 
-    pipelineCreateInfo.basePipelineHandle = VK_NULL_HANDLE; // Existing pipeline to derive from...
-    pipelineCreateInfo.basePipelineIndex = -1;              // or index of pipeline being created to derive from (in case creating multiple at once)
-
-    // Create graphics pipeline
-    result = vkCreateGraphicsPipelines(mainDevice.logicalDevice, VK_NULL_HANDLE, 1, &pipelineCreateInfo, nullptr, &graphicsPipeline);
+    pipelineLibrary.init(mainDevice.logicalDevice, pipelineCache.getCache(), pipelineLayout, renderPass);
 
-    if (result != VK_SUCCESS)
-    {
-        throw std::runtime_error("Failed to create a Graphics Pipeline !");
-    }
+    // The default pipeline is the only one startup waits for : nothing can be drawn without it
+    auto pipelineStart = std::chrono::steady_clock::now();
+    defaultPipeline = pipelineLibrary.request(getDefaultPipelineDescription());
+    pipelineLibrary.wait(defaultPipeline);
+    startupTimings.pipelineMs += elapsedMs(pipelineStart);
 
-    // Destroy shader modules, no longer needed after Pipeline created
-    vkDestroyShaderModule(mainDevice.logicalDevice, fragmentShaderModule, nullptr);
-    vkDestroyShaderModule(mainDevice.logicalDevice, vertexShaderModule, nullptr);
+    graphicsPipeline = pipelineLibrary.getPipeline(defaultPipeline);
+    scenePipeline = defaultPipeline;
 }
 
 void VulkanRenderer::createDepthBufferImage()
@@ -839,10 +1510,72 @@ void VulkanRenderer::createCommandPool()
     // Create a Graphics Queue Family Command Pool
     VkResult result = vkCreateCommandPool(mainDevice.logicalDevice, &poolInfo, nullptr, &graphicsCommandPool);
 
-    if (result != VK_SUCCESS)
-    {
-        throw std::runtime_error("Failed to create a graphics command pool !");
-    }
+    if (result != VK_SUCCESS)
+    {
+        throw std::runtime_error("Failed to create a graphics command pool !");
+    }
+
+    // Upload command buffers are recorded for the transfer family (same as graphics if there's no dedicated one)
+    poolInfo.queueFamilyIndex = queueFamilyIndices.transferFamily;
+
+    result = vkCreateCommandPool(mainDevice.logicalDevice, &poolInfo, nullptr, &transferCommandPool);
+
+    if (result != VK_SUCCESS)
+    {
+        throw std::runtime_error("Failed to create a transfer command pool !");
+    }
+}
+
+void VulkanRenderer::createStagingUploader()
+{
+    QueueFamilyIndices queueFamilyIndices = getQueueFamilies(mainDevice.physicalDevice);
+
+    // Copies run on the transfer queue, buffers are handed over to the graphics queue when the families differ
+    UploadQueue transfer = {};
+    transfer.timeline = transferQueue != graphicsQueue ? &transferTimeline : &graphicsTimeline;
+    transfer.family = static_cast<uint32_t>(queueFamilyIndices.transferFamily);
+    transfer.commandPool = transferCommandPool;
+
+    UploadQueue graphics = {};
+    graphics.timeline = &graphicsTimeline;
+    graphics.family = static_cast<uint32_t>(queueFamilyIndices.graphicsFamily);
+    graphics.commandPool = graphicsCommandPool;
+
+    stagingUploader.init(mainDevice.logicalDevice, &memoryAllocator, transfer, graphics);
+}
+
+void VulkanRenderer::createMeshPool()
+{
+    // Every mesh is appended to the pool's shared vertex/index buffers
+    meshPool.init(mainDevice.logicalDevice, &memoryAllocator, &stagingUploader, vertexLayout);
+}
+
+void VulkanRenderer::createIndirectDrawBuffer()
+{
+    // With culling, draw commands are rebuilt every frame in the arena instead
+    if (!indirectDrawing || compactVisibleObjects) return;
+
+    // One draw command per object, written by transfers only (and read by the indirect draws, or by the cull shader)
+    VkBufferUsageFlags usage = VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT;
+    if (gpuCulling)
+        usage |= VK_BUFFER_USAGE_STORAGE_BUFFER_BIT;
+    createBuffer(mainDevice.logicalDevice, &memoryAllocator, sizeof(VkDrawIndexedIndirectCommand) * objectCapacity,
+                 usage, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &indirectBuffer, &indirectBufferMemory);
+
+    // Everything has to be uploaded (again)
+    uploadedDrawCommands = 0;
+}
+
+void VulkanRenderer::createGpuCuller()
+{
+    if (!gpuCulling) return;
+
+    // Draws are compacted when their count is read by the GPU
+    auto pipelineStart = std::chrono::steady_clock::now();
+    gpuCuller.init(mainDevice.logicalDevice, &memoryAllocator, &stagingUploader, static_cast<uint32_t>(swapChainImages.size()),
+                   minStorageBufferOffset, cmdDrawIndexedIndirectCount != nullptr, pipelineCache.getCache());
+    startupTimings.pipelineMs += elapsedMs(pipelineStart);
+    gpuCuller.createBuffers(objectCapacity, frameArena.getBuffer(), sizeof(UboViewProjection), objectCapacity * sizeof(Model), indirectBuffer);
 }
 
 void VulkanRenderer::createCommandBuffers()
@@ -862,62 +1595,153 @@ void VulkanRenderer::createCommandBuffers()
 
     if (result != VK_SUCCESS)
     {
-        std::runtime_error("Failed to allocate Command Buffers !");
+        throw std::runtime_error("Failed to allocate Command Buffers !");
+    }
+}
+
+void VulkanRenderer::createSecondaryCommandBuffers()
+{
+    QueueFamilyIndices queueFamilyIndices = getQueueFamilies(mainDevice.physicalDevice);
+
+    // One pool + secondary buffer per record slice for every image : a pool can only be used by one thread at a time,
+    // and an image's secondaries may still be pending while another image is recorded.
+    // Pools are reset as a whole before each recording, no need for RESET_COMMAND_BUFFER_BIT
+    VkCommandPoolCreateInfo poolInfo = {};
+    poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+    poolInfo.flags = 0;
+    poolInfo.queueFamilyIndex = queueFamilyIndices.graphicsFamily;
+
+    secondaryCommands.resize(swapChainImages.size());
+    for (auto & imageSecondaries : secondaryCommands)
+    {
+        imageSecondaries.resize(jobSystem.getThreadCount());
+        for (auto & secondary : imageSecondaries)
+        {
+            if (vkCreateCommandPool(mainDevice.logicalDevice, &poolInfo, nullptr, &secondary.commandPool) != VK_SUCCESS)
+            {
+                throw std::runtime_error("Failed to create a record command pool !");
+            }
+
+            VkCommandBufferAllocateInfo cbAllocInfo = {};
+            cbAllocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+            cbAllocInfo.commandPool = secondary.commandPool;
+            cbAllocInfo.level = VK_COMMAND_BUFFER_LEVEL_SECONDARY;    // Executed from the primary with vkCmdExecuteCommands
+            cbAllocInfo.commandBufferCount = 1;
+
+            if (vkAllocateCommandBuffers(mainDevice.logicalDevice, &cbAllocInfo, &secondary.commandBuffer) != VK_SUCCESS)
+            {
+                throw std::runtime_error("Failed to allocate Secondary Command Buffers !");
+            }
+        }
     }
 }
 
 void VulkanRenderer::createSynchronisation()
 {
-    imageAvailable.resize(MAX_FRAME_DRAWS);
-    renderFinished.resize(MAX_FRAME_DRAWS);
-	drawFences.resize(MAX_FRAME_DRAWS);
+    createFrameContexts();
+    createRenderFinishedSemaphores();
+
+    // No image is used by a frame yet, and no command buffer is recorded
+    imagesInFlight.assign(swapChainImages.size(), 0);
+    recordedCommands.assign(swapChainImages.size(), RecordedCommands());
+}
+
+void VulkanRenderer::createFrameContexts()
+{
+    frames.resize(maxFramesInFlight);
 
     // Semaphore creation information
     VkSemaphoreCreateInfo semaphoreCreateInfo = {};
     semaphoreCreateInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
 
-	// Fence creation information
-	VkFenceCreateInfo fenceCreateInfo = {};
-	fenceCreateInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
-	fenceCreateInfo.flags = VK_FENCE_CREATE_SIGNALED_BIT;
-
-    for (size_t i = 0; i < MAX_FRAME_DRAWS; ++i)
+    for (auto & frame : frames)
     {
-        if (vkCreateSemaphore(mainDevice.logicalDevice, &semaphoreCreateInfo, nullptr, &imageAvailable[i]) != VK_SUCCESS
-         || vkCreateSemaphore(mainDevice.logicalDevice, &semaphoreCreateInfo, nullptr, &renderFinished[i]) != VK_SUCCESS
-         || vkCreateFence(mainDevice.logicalDevice, &fenceCreateInfo, nullptr, &drawFences[i]) != VK_SUCCESS)
+        frame.submitValue = 0;     // Nothing to wait for on the first use
+        if (vkCreateSemaphore(mainDevice.logicalDevice, &semaphoreCreateInfo, nullptr, &frame.imageAvailable) != VK_SUCCESS)
         {
             throw std::runtime_error("Failed to create a Semaphore !");
         }
     }
 }
 
-void VulkanRenderer::createUniformBuffers()
+void VulkanRenderer::destroyFrameContexts()
 {
-    // View Projection Buffer size
-    VkDeviceSize vpBufferSize = sizeof(UboViewProjection);
-    
-    // Model Buffer Size
-    //VkDeviceSize modelBufferSize = modelUniformAlignment * MAX_OBJECTS;
+    for (auto & frame : frames)
+    {
+        vkDestroySemaphore(mainDevice.logicalDevice, frame.imageAvailable, nullptr);
+    }
+    frames.clear();
+}
 
-    // One uniform buffer for each image (and by extension, command buffer)
-    vpUniformBuffer.resize(swapChainImages.size());
-    vpUniformBufferMemory.resize(swapChainImages.size());
+void VulkanRenderer::createRenderFinishedSemaphores()
+{
+    renderFinished.resize(swapChainImages.size());
 
-    //modelDynamicUniformBuffer.resize(swapChainImages.size());
-    //modelDynamicUniformBufferMemory.resize(swapChainImages.size());
+    VkSemaphoreCreateInfo semaphoreCreateInfo = {};
+    semaphoreCreateInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
 
-    // Create Uniform buffers
-    for (size_t i = 0; i < swapChainImages.size(); ++i)
+    for (auto & semaphore : renderFinished)
+    {
+        if (vkCreateSemaphore(mainDevice.logicalDevice, &semaphoreCreateInfo, nullptr, &semaphore) != VK_SUCCESS)
+        {
+            throw std::runtime_error("Failed to create a Semaphore !");
+        }
+    }
+}
+
+void VulkanRenderer::destroyRenderFinishedSemaphores()
+{
+    for (auto semaphore : renderFinished)
     {
-        createBuffer(mainDevice.physicalDevice, mainDevice.logicalDevice, vpBufferSize,
-            VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-            &vpUniformBuffer[i], &vpUniformBufferMemory[i]);
+        vkDestroySemaphore(mainDevice.logicalDevice, semaphore, nullptr);
+    }
+    renderFinished.clear();
+}
 
-        //createBuffer(mainDevice.physicalDevice, mainDevice.logicalDevice, modelBufferSize,
-        //    VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-        //    &modelDynamicUniformBuffer[i], &modelDynamicUniformBufferMemory[i]);
+void VulkanRenderer::waitForFrames()
+{
+    // Frames are submitted in order on the graphics timeline : the last one done means all of them are
+    uint64_t lastFrameValue = 0;
+    for (auto & frame : frames)
+    {
+        lastFrameValue = std::max(lastFrameValue, frame.submitValue);
     }
+    graphicsTimeline.wait(lastFrameValue);
+}
+
+uint32_t VulkanRenderer::getInstanceApiVersion()
+{
+    // Vulkan 1.2 when the loader has it (timeline semaphores), 1.0 loaders don't even have vkEnumerateInstanceVersion
+    instanceApiVersion = VK_API_VERSION_1_0;
+    auto enumerateInstanceVersion = (PFN_vkEnumerateInstanceVersion)vkGetInstanceProcAddr(nullptr, "vkEnumerateInstanceVersion");
+    if (enumerateInstanceVersion != nullptr && enumerateInstanceVersion(&instanceApiVersion) != VK_SUCCESS)
+        instanceApiVersion = VK_API_VERSION_1_0;
+
+    instanceApiVersion = std::min<uint32_t>(instanceApiVersion, VK_API_VERSION_1_2);
+    return instanceApiVersion;
+}
+
+void VulkanRenderer::createFrameArena()
+{
+    // Uniform data is rewritten every frame : it lives in the per-frame arena, mapped once for the whole renderer lifetime
+    // (replaces one uniform buffer per swapchain image mapped/unmapped every frame)
+    // Each slice also holds the data of every object (one aligned slot per object), plus room for aligning it
+    VkDeviceSize objectDataSize = 0;
+    if (objectDataMode != ObjectDataMode::PUSH_CONSTANT)
+        objectDataSize = objectCapacity * modelUniformAlignment + std::max(minUniformBufferOffset, minStorageBufferOffset);
+
+    // And the draw commands of the visible objects (at most one per object) when they're culled
+    if (indirectDrawing && compactVisibleObjects)
+        objectDataSize += objectCapacity * sizeof(VkDrawIndexedIndirectCommand);
+
+    // And the per-chunk draw counts read by indirect count draws (there are never more chunks than objects), plus their alignment
+    if (indirectDrawing && !gpuCulling && cmdDrawIndexedIndirectCount != nullptr)
+        objectDataSize += objectCapacity * sizeof(uint32_t) + sizeof(uint32_t);
+
+    // One slice per swapchain image : recorded command buffers keep pointing at the same slice
+    frameArena.init(mainDevice.logicalDevice, &memoryAllocator,
+                    VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT,
+                    static_cast<int>(swapChainImages.size()), DEFAULT_FRAME_ARENA_SIZE + objectDataSize);
 }
 
 void VulkanRenderer::createDescriptorPool()
@@ -925,23 +1749,37 @@ void VulkanRenderer::createDescriptorPool()
     // Type of descriptors + how many DESCRIPTORS, not Descriptor Sets (combined makes the pool size)
     // View Projection Pool
     VkDescriptorPoolSize poolSize = {};
-    poolSize.type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-    poolSize.descriptorCount = static_cast<uint32_t>(vpUniformBuffer.size());
-
-    // Model Pool (Dynamic)
-    /*
-    VkDescriptorPoolSize modelPoolSize = {};
-    modelPoolSize.type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
-    modelPoolSize.descriptorCount = static_cast<uint32_t>(modelDynamicUniformBuffer.size());
-    */
+    poolSize.type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
+    poolSize.descriptorCount = static_cast<uint32_t>(swapChainImages.size());
 
     // List of pool sizes
     std::vector<VkDescriptorPoolSize> poolSizes = { poolSize };
 
+    // Model Pool (Dynamic)
+    if (objectDataMode != ObjectDataMode::PUSH_CONSTANT)
+    {
+        VkDescriptorPoolSize modelPoolSize = {};
+        modelPoolSize.type = objectDataMode == ObjectDataMode::DYNAMIC_UNIFORM
+            ? VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC : VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC;
+        modelPoolSize.descriptorCount = static_cast<uint32_t>(swapChainImages.size());
+
+        poolSizes.push_back(modelPoolSize);
+    }
+
+    // Visible Objects Pool
+    if (gpuCulling)
+    {
+        VkDescriptorPoolSize visibleObjectsPoolSize = {};
+        visibleObjectsPoolSize.type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+        visibleObjectsPoolSize.descriptorCount = static_cast<uint32_t>(swapChainImages.size());
+
+        poolSizes.push_back(visibleObjectsPoolSize);
+    }
+
     // Data to create Descriptor Pool
     VkDescriptorPoolCreateInfo poolCreateInfo = {};
     poolCreateInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
-    poolCreateInfo.maxSets = static_cast<uint32_t>(vpUniformBuffer.size());     // Maximum number of descriptor sets that can be created from pool
+    poolCreateInfo.maxSets = static_cast<uint32_t>(swapChainImages.size());     // Maximum number of descriptor sets that can be created from pool
     poolCreateInfo.poolSizeCount = static_cast<uint32_t>(poolSizes.size());     // Amount of Pools sizes being passed
     poolCreateInfo.pPoolSizes = poolSizes.data();                               // Sizes to create pool with
 
@@ -955,9 +1793,9 @@ void VulkanRenderer::createDescriptorPool()
 void VulkanRenderer::createDescriptorSets()
 {
     // Resize Descriptor Set list so one for every buffer
-    descriptorSets.resize(vpUniformBuffer.size());
+    descriptorSets.resize(swapChainImages.size());
 
-    std::vector<VkDescriptorSetLayout> setLayouts(vpUniformBuffer.size(), descriptorSetLayout);
+    std::vector<VkDescriptorSetLayout> setLayouts(swapChainImages.size(), descriptorSetLayout);
 
     // Descriptor Set Allocation Info
     VkDescriptorSetAllocateInfo setAllocInfo = {};
@@ -973,14 +1811,19 @@ void VulkanRenderer::createDescriptorSets()
         throw std::runtime_error("Failed to Allocate Descriptor Sets !");
     }
 
+    writeDescriptorSets();
+}
+
+void VulkanRenderer::writeDescriptorSets()
+{
     // Update all of descriptor set buffer bindings
     for (size_t i = 0; i < swapChainImages.size(); ++i)
     {
         // VIEW PROJECTION DESCRIPTOR
         // Buffer info and data offset info
         VkDescriptorBufferInfo vpViewProjectionBufferInfo = {};
-        vpViewProjectionBufferInfo.buffer = vpUniformBuffer[i];    // Buffer to get data from
-        vpViewProjectionBufferInfo.offset = 0;                   // Position of start of data
+        vpViewProjectionBufferInfo.buffer = frameArena.getBuffer();    // Buffer to get data from
+        vpViewProjectionBufferInfo.offset = 0;                   // Position of start of data (dynamic offset added at bind time)
         vpViewProjectionBufferInfo.range = sizeof(UboViewProjection);          // Size of data
 
         // Data about connection between binding and buffer
@@ -989,30 +1832,54 @@ void VulkanRenderer::createDescriptorSets()
         vpViewProjectionSetWrite.dstSet = descriptorSets[i];                             // Description Set to update
         vpViewProjectionSetWrite.dstBinding = 0;                                         // Binding to update (matches with binding on layout/shader)
         vpViewProjectionSetWrite.dstArrayElement = 0;                                    // Index in array to update
-        vpViewProjectionSetWrite.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;     // Type of descriptor
+        vpViewProjectionSetWrite.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC; // Type of descriptor
         vpViewProjectionSetWrite.descriptorCount = 1;                                    // Amount to update
         vpViewProjectionSetWrite.pBufferInfo = &vpViewProjectionBufferInfo;              // Information about buffer data to bind
 
+        // List of Descriptor Set Writes
+        std::vector<VkWriteDescriptorSet> setWrites = { vpViewProjectionSetWrite };
+
         // MODEL DESCRIPTOR
         // Model Buffer Binding Info
-        /*
+        // Dynamic uniform : one object visible per draw. Storage buffer : the whole object array.
         VkDescriptorBufferInfo modelBufferInfo = {};
-        modelBufferInfo.buffer = modelDynamicUniformBuffer[i];
+        modelBufferInfo.buffer = frameArena.getBuffer();
         modelBufferInfo.offset = 0;
-        modelBufferInfo.range = modelUniformAlignment;
-
-        VkWriteDescriptorSet modelSetWrite = {};
-        modelSetWrite.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-        modelSetWrite.dstSet = descriptorSets[i];
-        modelSetWrite.dstBinding = 1;
-        modelSetWrite.dstArrayElement = 0;
-        modelSetWrite.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
-        modelSetWrite.descriptorCount = 1;
-        modelSetWrite.pBufferInfo = &modelBufferInfo;
-        */
+        modelBufferInfo.range = objectDataMode == ObjectDataMode::DYNAMIC_UNIFORM
+            ? sizeof(Model) : objectCapacity * sizeof(Model);
 
-        // List of Descriptor Set Writes
-        std::vector<VkWriteDescriptorSet> setWrites = { vpViewProjectionSetWrite };
+        if (objectDataMode != ObjectDataMode::PUSH_CONSTANT)
+        {
+            VkWriteDescriptorSet modelSetWrite = {};
+            modelSetWrite.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+            modelSetWrite.dstSet = descriptorSets[i];
+            modelSetWrite.dstBinding = 1;
+            modelSetWrite.dstArrayElement = 0;
+            modelSetWrite.descriptorType = objectDataMode == ObjectDataMode::DYNAMIC_UNIFORM
+                ? VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC : VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC;
+            modelSetWrite.descriptorCount = 1;
+            modelSetWrite.pBufferInfo = &modelBufferInfo;
+
+            setWrites.push_back(modelSetWrite);
+        }
+
+        // VISIBLE OBJECTS DESCRIPTOR
+        VkDescriptorBufferInfo visibleObjectsBufferInfo = {};
+        if (gpuCulling)
+        {
+            visibleObjectsBufferInfo = gpuCuller.getVisibleObjectsInfo(static_cast<uint32_t>(i));
+
+            VkWriteDescriptorSet visibleObjectsSetWrite = {};
+            visibleObjectsSetWrite.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+            visibleObjectsSetWrite.dstSet = descriptorSets[i];
+            visibleObjectsSetWrite.dstBinding = 2;
+            visibleObjectsSetWrite.dstArrayElement = 0;
+            visibleObjectsSetWrite.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+            visibleObjectsSetWrite.descriptorCount = 1;
+            visibleObjectsSetWrite.pBufferInfo = &visibleObjectsBufferInfo;
+
+            setWrites.push_back(visibleObjectsSetWrite);
+        }
 
         // Update descriptor sets with new buffer/binding info
         vkUpdateDescriptorSets(mainDevice.logicalDevice, static_cast<uint32_t>(setWrites.size()), setWrites.data(),
@@ -1020,26 +1887,186 @@ void VulkanRenderer::createDescriptorSets()
     }
 }
 
-void VulkanRenderer::updateUniformBuffers(uint32_t imageIndex)
+void VulkanRenderer::updateUniformBuffers()
 {
-    // Copy VP Data
-    void * data;
-    vkMapMemory(mainDevice.logicalDevice, vpUniformBufferMemory[imageIndex], 0, sizeof(UboViewProjection), 0, &data);
-    memcpy(data, &uboViewProjection, sizeof(UboViewProjection));
-    vkUnmapMemory(mainDevice.logicalDevice, vpUniformBufferMemory[imageIndex]);
+    // Copy VP Data to this frame's arena slice, through the persistent mapping
+    FrameAllocation vpAllocation = frameArena.allocate(sizeof(UboViewProjection), minUniformBufferOffset);
+    memcpy(vpAllocation.data, &uboViewProjection, sizeof(UboViewProjection));
+    vpUniformOffset = static_cast<uint32_t>(vpAllocation.offset);
+
+    if (objectDataMode == ObjectDataMode::PUSH_CONSTANT || sceneStore.empty()) return;
 
     // Copy Model Data
-    /*
-    for (size_t i = 0; i < meshList.size(); ++i)
+    // (the allocation has room for every object even when some are culled, so its offset doesn't move between frames)
+    VkDeviceSize modelDataAlignment = objectDataMode == ObjectDataMode::DYNAMIC_UNIFORM ? minUniformBufferOffset : minStorageBufferOffset;
+    FrameAllocation modelAllocation = frameArena.allocate(modelUniformAlignment * sceneStore.size(), modelDataAlignment);
+    modelDataOffset = static_cast<uint32_t>(modelAllocation.offset);
+
+    const Model * objectData = sceneStore.getObjectData();
+    if (compactVisibleObjects)
+    {
+        // Culled objects are left out : the visible instances of a mesh are packed together,
+        // and its draw command starts at the first of them
+        Model * objects = static_cast<Model *>(modelAllocation.data);
+        uint32_t objectCount = 0;
+        for (size_t j = 0; j < meshList.size(); ++j)
+        {
+            uint32_t firstObject = meshList[j].getFirstObject();
+            uint32_t firstVisible = objectCount;
+            for (uint32_t object = firstObject; object < firstObject + meshList[j].getInstanceCount(); ++object)
+            {
+                if (objectVisible[object])
+                    objects[objectCount++] = objectData[object];
+            }
+            visibleDrawCommands[j].instanceCount = objectCount - firstVisible;
+            visibleDrawCommands[j].firstInstance = firstVisible;
+        }
+    }
+    else
+    {
+        // Storage buffer objects are tightly packed like the scene store's object data : one copy of the whole array.
+        // Dynamic uniform slots are spread to the alignment : they're gathered in host memory first,
+        // so the (possibly write-combined) mapped memory only gets one sequential copy
+        const void * modelData = objectData;
+        if (objectDataMode == ObjectDataMode::DYNAMIC_UNIFORM)
+        {
+            for (size_t i = 0; i < sceneStore.size(); ++i)
+            {
+                Model * thisModel = (Model *)((uint64_t)modelTransferSpace + (i * modelUniformAlignment));
+                *thisModel = objectData[i];
+            }
+            modelData = modelTransferSpace;
+        }
+        memcpy(modelAllocation.data, modelData, modelUniformAlignment * sceneStore.size());
+    }
+
+    // GPU culling writes its own draw commands and counts
+    if (!indirectDrawing || gpuCulling) return;
+
+    // Draw count of every chunk, read by the GPU (per frame : counts of in flight frames aren't overwritten)
+    uint32_t * drawCounts = nullptr;
+    if (cmdDrawIndexedIndirectCount != nullptr)
     {
-        Model * thisModel = (Model *)((uint64_t)modelTransferSpace + (i * modelUniformAlignment));
-        *thisModel = meshList[i].getModel();
+        FrameAllocation countAllocation = frameArena.allocate(sizeof(uint32_t) * chunkDraws.size(), sizeof(uint32_t));
+        drawCounts = static_cast<uint32_t *>(countAllocation.data);
+        drawCountOffset = static_cast<uint32_t>(countAllocation.offset);
     }
 
-    vkMapMemory(mainDevice.logicalDevice, modelDynamicUniformBufferMemory[imageIndex], 0, modelUniformAlignment * meshList.size(), 0, &data);
-    memcpy(data, modelTransferSpace, modelUniformAlignment * meshList.size());
-    vkUnmapMemory(mainDevice.logicalDevice, modelDynamicUniformBufferMemory[imageIndex]);
-    */
+    if (!compactVisibleObjects)
+    {
+        // Every draw command is in indirectBuffer
+        for (size_t i = 0; drawCounts != nullptr && i < chunkDraws.size(); ++i)
+        {
+            drawCounts[i] = chunkDraws[i].drawCount;
+        }
+        return;
+    }
+
+    // This frame's draw commands, at the same place as in drawCommands
+    FrameAllocation commandAllocation = frameArena.allocate(sizeof(VkDrawIndexedIndirectCommand) * visibleDrawCommands.size(), sizeof(uint32_t));
+    VkDrawIndexedIndirectCommand * commands = static_cast<VkDrawIndexedIndirectCommand *>(commandAllocation.data);
+    drawCommandOffset = static_cast<uint32_t>(commandAllocation.offset);
+
+    for (size_t i = 0; i < chunkDraws.size(); ++i)
+    {
+        // Draw count is recorded : meshes without a visible instance stay as empty draws (instanceCount = 0).
+        // Draw count is read by the GPU : only the meshes with visible instances are written, at the start of the chunk's range
+        const ChunkDraws & draws = chunkDraws[i];
+        uint32_t drawCount = 0;
+        for (uint32_t meshId : draws.meshes)
+        {
+            if (drawCounts == nullptr || visibleDrawCommands[meshId].instanceCount > 0)
+                commands[draws.firstDraw + drawCount++] = visibleDrawCommands[meshId];
+        }
+        if (drawCounts != nullptr)
+            drawCounts[i] = drawCount;
+    }
+}
+
+void VulkanRenderer::growObjectCapacity()
+{
+    // Frames in flight still read the arena, the draw commands and the culling buffers through descriptors pointing at them :
+    // nothing waits for them, the old buffers and descriptor pools are released once the graphics timeline reaches
+    // the last submitted frame, and the new buffers get new descriptor sets (sets in use can't be rewritten)
+    uint64_t lastUse = graphicsTimeline.getLastSubmitted();
+
+    while (objectCapacity < sceneStore.size())
+        objectCapacity *= 2;
+
+    // Host copy of the object data, only read by the CPU
+    freeDynamicBufferTransferSpace();
+    allocateDynamicBufferTransferSpace();
+
+    FrameArena oldFrameArena = frameArena;
+    deletionQueue.push(lastUse, [oldFrameArena]() mutable {
+        oldFrameArena.destroy();
+    });
+    if (indirectDrawing && !compactVisibleObjects)
+    {
+        deletionQueue.deleteBuffer(lastUse, indirectBuffer, indirectBufferMemory);
+    }
+    VkDevice device = mainDevice.logicalDevice;
+    VkDescriptorPool oldDescriptorPool = descriptorPool;
+    deletionQueue.push(lastUse, [device, oldDescriptorPool]() {
+        vkDestroyDescriptorPool(device, oldDescriptorPool, nullptr);
+    });
+
+    createFrameArena();
+    createIndirectDrawBuffer();
+    if (gpuCulling)
+    {
+        gpuCuller.retireBuffers(&deletionQueue, lastUse);
+        gpuCuller.createBuffers(objectCapacity, frameArena.getBuffer(), sizeof(UboViewProjection), objectCapacity * sizeof(Model), indirectBuffer);
+    }
+    createDescriptorPool();
+    createDescriptorSets();
+    markSceneDirty();
+}
+
+VkDrawIndexedIndirectCommand VulkanRenderer::getDrawCommand(size_t meshId)
+{
+    // Every instance of the mesh (firstInstance = first object slot, the vertex shader reads the object data at gl_InstanceIndex)
+    MeshRange range = meshList[meshId].getRange();
+    VkDrawIndexedIndirectCommand drawCommand = {};
+    drawCommand.indexCount = range.indexCount;
+    drawCommand.instanceCount = meshList[meshId].getInstanceCount();
+    drawCommand.firstIndex = range.firstIndex;
+    drawCommand.vertexOffset = range.vertexOffset;
+    drawCommand.firstInstance = meshList[meshId].getFirstObject();
+    return drawCommand;
+}
+
+void VulkanRenderer::layoutDrawCommands()
+{
+    // Chunk ranges one after the other in chunk order, each with its meshes in the order they were added.
+    // Rare (a small mesh added after a big one) and once per frame at most, however many meshes were added
+    // Frames in flight were recorded (or culled) with the old ranges and still read the draw commands and mesh infos :
+    // once anything was uploaded, the new layout goes to new buffers, the old ones are released when the graphics timeline
+    // reaches the last submitted frame (only appended commands are written into buffers in use)
+    if (indirectDrawing && !compactVisibleObjects && uploadedDrawCommands > 0)
+    {
+        uint64_t lastUse = graphicsTimeline.getLastSubmitted();
+        deletionQueue.deleteBuffer(lastUse, indirectBuffer, indirectBufferMemory);
+        createIndirectDrawBuffer();
+        if (gpuCulling)
+            gpuCuller.replaceMeshBuffer(&deletionQueue, lastUse, indirectBuffer);
+        markSceneDirty();
+    }
+
+    drawCommands.clear();
+    for (uint32_t chunk = 0; chunk < chunkDraws.size(); ++chunk)
+    {
+        ChunkDraws & draws = chunkDraws[chunk];
+        draws.firstDraw = static_cast<uint32_t>(drawCommands.size());
+        for (uint32_t meshId : draws.meshes)
+        {
+            if (gpuCulling)
+                gpuCuller.setMeshDraw(meshId, chunk, draws.firstDraw, static_cast<uint32_t>(drawCommands.size()));
+            drawCommands.push_back(getDrawCommand(meshId));
+        }
+    }
+
+    drawLayoutDirty = false;
 }
 
 void VulkanRenderer::setupDebugMessenger()
@@ -1066,7 +2093,7 @@ void VulkanRenderer::recordCommands(uint32_t currentImage)
     // Information about how to begin each command buffer
     VkCommandBufferBeginInfo bufferBeginInfo = {};
     bufferBeginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
-    bufferBeginInfo.flags = VK_COMMAND_BUFFER_USAGE_SIMULTANEOUS_USE_BIT;   // Buffer can be resubmitted when it has already been submitted
+    bufferBeginInfo.flags = 0;  // Recorded once, submitted many times, never while still pending (image values are waited in draw())
 
     VkRenderPassBeginInfo renderPassBeginInfo = {};
     renderPassBeginInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
@@ -1090,45 +2117,103 @@ void VulkanRenderer::recordCommands(uint32_t currentImage)
         throw std::runtime_error("Failed to start recording a Command Buffer !");
     }
 
+    // Big scenes are split in slices recorded in parallel into secondary command buffers, executed by the primary
+    // (indirect drawing records a few commands per pool chunk whatever the scene size, nothing to split)
+    uint32_t sliceCount = static_cast<uint32_t>(std::min<size_t>(jobSystem.getThreadCount(),
+        (meshList.size() + MIN_DRAWS_PER_RECORD_JOB - 1) / MIN_DRAWS_PER_RECORD_JOB));
+    if (indirectDrawing)
+        sliceCount = 1;
+
+    // GPU culling fills the draw commands and visible objects of this image, outside of the render pass
+    if (gpuCulling)
+    {
+        gpuCuller.recordCull(commandBuffers[currentImage], currentImage, vpUniformOffset, modelDataOffset,
+                             static_cast<uint32_t>(chunkDraws.size()));
+    }
+
     // Begin Render Pass
-    vkCmdBeginRenderPass(commandBuffers[currentImage], &renderPassBeginInfo, VK_SUBPASS_CONTENTS_INLINE);
+    if (sliceCount <= 1)
     {
-        // Bind Pipeline to be used in the render pass
-        vkCmdBindPipeline(commandBuffers[currentImage], VK_PIPELINE_BIND_POINT_GRAPHICS, graphicsPipeline);
+        vkCmdBeginRenderPass(commandBuffers[currentImage], &renderPassBeginInfo, VK_SUBPASS_CONTENTS_INLINE);
+        if (indirectDrawing)
+            recordIndirectDraws(commandBuffers[currentImage], currentImage);
+        else
+            recordDraws(commandBuffers[currentImage], currentImage, 0, meshList.size());
+    }
+    else
+    {
+        vkCmdBeginRenderPass(commandBuffers[currentImage], &renderPassBeginInfo, VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS);
 
-        for (size_t j = 0; j < meshList.size(); j++)
-        {
-            VkBuffer vertexBuffers[] = { meshList[j].getVertexBuffer() };					// Buffers to bind
-            VkDeviceSize offsets[] = { 0 };												// Offsets into buffers being bound
-            vkCmdBindVertexBuffers(commandBuffers[currentImage], 0, 1, vertexBuffers, offsets);	// Command to bind vertex buffer before drawing with them
-
-            // Bind mesh index buffer, with 0 offset and using the uint32 type
-            vkCmdBindIndexBuffer(commandBuffers[currentImage], meshList[j].getIndexBuffer(), 0, VK_INDEX_TYPE_UINT32);
-
-            // Dynamic Offset Amount
-            //uint32_t dynamicOffset = static_cast<uint32_t>(modelUniformAlignment) * j;
-
-            // "Push" Constants to given shader stage directly (no buffer)
-            vkCmdPushConstants(
-                commandBuffers[currentImage],
-                pipelineLayout,
-                VK_SHADER_STAGE_VERTEX_BIT,     // Stage to push constants to
-                0,                              // Offset of push constants to update
-                sizeof(Model),                  // Size of data being pushed
-                &meshList[j].getModel()         // Actual data being pushed (can be array)
-                );
-
-            // Bind descriptor sets
-            vkCmdBindDescriptorSets(commandBuffers[currentImage], VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout,
-                0, 1, &descriptorSets[currentImage], 0, nullptr);
+        // Secondary command buffers continue the render pass of the primary
+        VkCommandBufferInheritanceInfo inheritanceInfo = {};
+        inheritanceInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO;
+        inheritanceInfo.renderPass = renderPass;
+        inheritanceInfo.subpass = 0;
+        inheritanceInfo.framebuffer = swapChainFramebuffers[currentImage];
 
-            // Execute pipeline
-            vkCmdDrawIndexed(commandBuffers[currentImage], meshList[j].getIndexCount(), 1, 0, 0, 0);
+        size_t drawsPerSlice = (meshList.size() + sliceCount - 1) / sliceCount;
+
+        // Each slice has its own pool (per image), only the job recording that slice touches it
+        jobSystem.dispatch(sliceCount, [&](uint32_t slice) {
+            SecondaryCommands & secondary = secondaryCommands[currentImage][slice];
+            vkResetCommandPool(mainDevice.logicalDevice, secondary.commandPool, 0);
+
+            VkCommandBufferBeginInfo secondaryBeginInfo = {};
+            secondaryBeginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+            secondaryBeginInfo.flags = VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT;
+            secondaryBeginInfo.pInheritanceInfo = &inheritanceInfo;
+
+            if (vkBeginCommandBuffer(secondary.commandBuffer, &secondaryBeginInfo) != VK_SUCCESS)
+            {
+                throw std::runtime_error("Failed to start recording a Secondary Command Buffer !");
+            }
+
+            size_t firstMesh = std::min(meshList.size(), slice * drawsPerSlice);
+            size_t lastMesh = std::min(meshList.size(), firstMesh + drawsPerSlice);
+            recordDraws(secondary.commandBuffer, currentImage, firstMesh, lastMesh);
+
+            if (vkEndCommandBuffer(secondary.commandBuffer) != VK_SUCCESS)
+            {
+                throw std::runtime_error("Failed to stop recording a Secondary Command Buffer !");
+            }
+        });
+
+        std::vector<VkCommandBuffer> executedBuffers(sliceCount);
+        for (uint32_t slice = 0; slice < sliceCount; ++slice)
+        {
+            executedBuffers[slice] = secondaryCommands[currentImage][slice].commandBuffer;
         }
+        vkCmdExecuteCommands(commandBuffers[currentImage], sliceCount, executedBuffers.data());
     }
     // End Render Pass
     vkCmdEndRenderPass(commandBuffers[currentImage]);
 
+    // Headless readback : copy the frame to its host visible buffer (image is in TRANSFER_SRC after the render pass)
+    if (headless && readbackEnabled)
+    {
+        VkBufferImageCopy imageCopyRegion = {};
+        imageCopyRegion.bufferOffset = 0;
+        imageCopyRegion.bufferRowLength = 0;                                        // 0 = tightly packed rows
+        imageCopyRegion.bufferImageHeight = 0;
+        imageCopyRegion.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+        imageCopyRegion.imageSubresource.mipLevel = 0;
+        imageCopyRegion.imageSubresource.baseArrayLayer = 0;
+        imageCopyRegion.imageSubresource.layerCount = 1;
+        imageCopyRegion.imageOffset = { 0, 0, 0 };
+        imageCopyRegion.imageExtent = { swapChainExtent.width, swapChainExtent.height, 1 };
+
+        vkCmdCopyImageToBuffer(commandBuffers[currentImage], swapChainImages[currentImage].image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+            readbackBuffers[currentImage], 1, &imageCopyRegion);
+
+        // Make the copy visible to the host once the frame's timeline value is reached
+        VkMemoryBarrier hostBarrier = {};
+        hostBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+        hostBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+        hostBarrier.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+        vkCmdPipelineBarrier(commandBuffers[currentImage], VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_HOST_BIT, 0,
+            1, &hostBarrier, 0, nullptr, 0, nullptr);
+    }
+
     // Stop recording to command buffer !
     result = vkEndCommandBuffer(commandBuffers[currentImage]);
     if (result != VK_SUCCESS)
@@ -1137,6 +2222,169 @@ void VulkanRenderer::recordCommands(uint32_t currentImage)
     }
 }
 
+void VulkanRenderer::recordDraws(VkCommandBuffer commandBuffer, uint32_t currentImage, size_t firstMesh, size_t lastMesh)
+{
+    // Also called from record jobs at the same time : only reads renderer state
+
+    // Bind Pipeline to be used in the render pass
+    vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, graphicsPipeline);
+    recordViewport(commandBuffer);
+
+    // Every object reads its model from the same storage buffer : bind descriptor sets once for the whole pass
+    if (objectDataMode == ObjectDataMode::STORAGE_BUFFER)
+    {
+        std::array<uint32_t, 2> dynamicOffsets = { vpUniformOffset, modelDataOffset };
+        vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout,
+            0, 1, &descriptorSets[currentImage], static_cast<uint32_t>(dynamicOffsets.size()), dynamicOffsets.data());
+    }
+    else if (objectDataMode == ObjectDataMode::PUSH_CONSTANT)
+    {
+        vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout,
+            0, 1, &descriptorSets[currentImage], 1, &vpUniformOffset);
+    }
+
+    uint32_t boundChunk = UINT32_MAX;
+    for (size_t j = firstMesh; j < lastMesh; j++)
+    {
+        // Meshes share the buffers of their pool chunk : only bind when the chunk changes
+        MeshRange range = meshList[j].getRange();
+        if (range.chunk != boundChunk)
+        {
+            // One vertex buffer per stream (split streams : positions at binding 0, other attributes at binding 1)
+            const VkBuffer * vertexBuffers = meshList[j].getVertexBuffers();					// Buffers to bind
+            VkDeviceSize offsets[MAX_VERTEX_STREAMS] = {};										// Offsets into buffers being bound
+            vkCmdBindVertexBuffers(commandBuffer, 0, vertexLayout.getStreamCount(), vertexBuffers, offsets);	// Command to bind vertex buffer before drawing with them
+
+            // Bind chunk index buffer, with 0 offset and the chunk's index type (uint16 or uint32)
+            vkCmdBindIndexBuffer(commandBuffer, meshList[j].getIndexBuffer(), 0, meshList[j].getIndexType());
+            boundChunk = range.chunk;
+        }
+
+        uint32_t firstObject = meshList[j].getFirstObject();
+        uint32_t instanceCount = meshList[j].getInstanceCount();
+
+        if (objectDataMode == ObjectDataMode::STORAGE_BUFFER)
+        {
+            // Culling : only the visible instances, packed in the object data from firstInstance
+            uint32_t firstInstance = firstObject;
+            if (compactVisibleObjects)
+            {
+                instanceCount = visibleDrawCommands[j].instanceCount;
+                firstInstance = visibleDrawCommands[j].firstInstance;
+                if (instanceCount == 0)
+                    continue;
+            }
+
+            // Execute pipeline
+            // One draw for every instance : firstInstance = first object, the shader reads its model with gl_InstanceIndex
+            vkCmdDrawIndexed(commandBuffer, range.indexCount, instanceCount, range.firstIndex, range.vertexOffset, firstInstance);
+            continue;
+        }
+
+        // Push constants and dynamic uniforms hold one object : one draw per visible instance
+        for (uint32_t object = firstObject; object < firstObject + instanceCount; ++object)
+        {
+            if (frustumCulling && !objectVisible[object])
+                continue;
+
+            if (objectDataMode == ObjectDataMode::PUSH_CONSTANT)
+            {
+                // "Push" Constants to given shader stage directly (no buffer)
+                vkCmdPushConstants(
+                    commandBuffer,
+                    pipelineLayout,
+                    VK_SHADER_STAGE_VERTEX_BIT,     // Stage to push constants to
+                    0,                              // Offset of push constants to update
+                    sizeof(Model),                  // Size of data being pushed
+                    &sceneStore.getObject(object)   // Actual data being pushed (can be array)
+                    );
+            }
+            else
+            {
+                // Dynamic Offset Amount
+                uint32_t dynamicOffset = modelDataOffset + static_cast<uint32_t>(modelUniformAlignment * object);
+
+                // Bind descriptor sets
+                std::array<uint32_t, 2> dynamicOffsets = { vpUniformOffset, dynamicOffset };
+                vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout,
+                    0, 1, &descriptorSets[currentImage], static_cast<uint32_t>(dynamicOffsets.size()), dynamicOffsets.data());
+            }
+
+            // Execute pipeline
+            vkCmdDrawIndexed(commandBuffer, range.indexCount, 1, range.firstIndex, range.vertexOffset, 0);
+        }
+    }
+}
+
+void VulkanRenderer::recordViewport(VkCommandBuffer commandBuffer)
+{
+    // Dynamic state isn't inherited by secondary command buffers : every command buffer drawing sets it
+    VkViewport viewport = {};
+    viewport.x = 0.0f;      // X start coordinates
+    viewport.y = 0.0f;      // Y start coordinates
+    viewport.width = static_cast<float>(swapChainExtent.width);     // width of viewport
+    viewport.height = static_cast<float>(swapChainExtent.height);   // height of viewport
+    viewport.minDepth = 0.0f;   // min framebuffer depth
+    viewport.maxDepth = 1.0f;   // max framebuffer depth
+    vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
+
+    VkRect2D scissor = {};
+    scissor.offset = { 0, 0 };          // Offset to use region from
+    scissor.extent = swapChainExtent;   // Extent to describe region to use, starting at offset
+    vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
+}
+
+void VulkanRenderer::recordIndirectDraws(VkCommandBuffer commandBuffer, uint32_t currentImage)
+{
+    vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, graphicsPipeline);
+    recordViewport(commandBuffer);
+
+    // Indirect drawing always uses the storage buffer object data
+    std::array<uint32_t, 2> dynamicOffsets = { vpUniformOffset, modelDataOffset };
+    vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout,
+        0, 1, &descriptorSets[currentImage], static_cast<uint32_t>(dynamicOffsets.size()), dynamicOffsets.data());
+
+    // One bind + one draw call per pool chunk, the draw parameters come from the indirect buffer
+    // (culling : from this frame's visible draw commands in the arena, or written by the cull shader)
+    const uint32_t stride = sizeof(VkDrawIndexedIndirectCommand);
+    VkBuffer drawBuffer = compactVisibleObjects ? frameArena.getBuffer() : indirectBuffer;
+    VkDeviceSize drawBufferOffset = compactVisibleObjects ? drawCommandOffset : 0;
+    VkBuffer countBuffer = frameArena.getBuffer();
+    VkDeviceSize countBufferOffset = drawCountOffset;
+    if (gpuCulling)
+    {
+        drawBuffer = countBuffer = gpuCuller.getBuffer(currentImage);
+        drawBufferOffset = gpuCuller.getDrawCommandOffset();
+        countBufferOffset = gpuCuller.getDrawCountOffset();
+    }
+    for (uint32_t chunk = 0; chunk < chunkDraws.size(); ++chunk)
+    {
+        VkDeviceSize offsets[MAX_VERTEX_STREAMS] = {};
+        vkCmdBindVertexBuffers(commandBuffer, 0, vertexLayout.getStreamCount(), meshPool.getVertexBuffers(chunk), offsets);
+        vkCmdBindIndexBuffer(commandBuffer, meshPool.getIndexBuffer(chunk), 0, meshPool.getIndexType(chunk));
+
+        VkDeviceSize commandOffset = drawBufferOffset + static_cast<VkDeviceSize>(chunkDraws[chunk].firstDraw) * stride;
+        if (cmdDrawIndexedIndirectCount != nullptr)
+        {
+            // Count read from this frame's arena slice, up to every draw of the chunk
+            cmdDrawIndexedIndirectCount(commandBuffer, drawBuffer, commandOffset, countBuffer,
+                countBufferOffset + sizeof(uint32_t) * chunk, chunkDraws[chunk].drawCount, stride);
+        }
+        else if (multiDrawIndirect)
+        {
+            vkCmdDrawIndexedIndirect(commandBuffer, drawBuffer, commandOffset, chunkDraws[chunk].drawCount, stride);
+        }
+        else
+        {
+            // Without multiDrawIndirect, a draw call can only read one command
+            for (uint32_t draw = 0; draw < chunkDraws[chunk].drawCount; ++draw)
+            {
+                vkCmdDrawIndexedIndirect(commandBuffer, drawBuffer, commandOffset + draw * stride, 1, stride);
+            }
+        }
+    }
+}
+
 void VulkanRenderer::getPhysicalDevice()
 {
     // Enumerates Physical devices the vkInstance can access.
@@ -1164,19 +2412,32 @@ void VulkanRenderer::getPhysicalDevice()
     VkPhysicalDeviceProperties deviceProperties;
     vkGetPhysicalDeviceProperties(mainDevice.physicalDevice, &deviceProperties);
     
-    //minUniformBufferOffset = deviceProperties.limits.minUniformBufferOffsetAlignment;
+    minUniformBufferOffset = deviceProperties.limits.minUniformBufferOffsetAlignment;
+    minStorageBufferOffset = deviceProperties.limits.minStorageBufferOffsetAlignment;
 }
 
 void VulkanRenderer::allocateDynamicBufferTransferSpace()
 {
-    /*
+    if (objectDataMode == ObjectDataMode::PUSH_CONSTANT) return;
+
     // Calculates the alignment of the model data
-    modelUniformAlignment = (sizeof(Model) + minUniformBufferOffset - 1)
-                            & ~(minUniformBufferOffset - 1);
+    // Dynamic uniform offsets must be multiples of minUniformBufferOffsetAlignment, storage buffer arrays are tightly packed (std430)
+    if (objectDataMode == ObjectDataMode::DYNAMIC_UNIFORM)
+        modelUniformAlignment = (sizeof(Model) + minUniformBufferOffset - 1)
+                                & ~(minUniformBufferOffset - 1);
+    else
+        modelUniformAlignment = sizeof(Model);
 
-    // Create space in memory to hold dynamic buffer that is alligned  to our required alignment and holds MAX_OBJECTS
-    modelTransferSpace = (Model *)_aligned_malloc(modelUniformAlignment * MAX_OBJECTS, modelUniformAlignment);
-    */
+    // Create space in memory to hold dynamic buffer that is aligned to our required alignment and holds objectCapacity objects
+    // (storage buffer objects are copied straight from the scene store)
+    if (objectDataMode == ObjectDataMode::DYNAMIC_UNIFORM)
+        modelTransferSpace = (Model *)alignedAlloc(modelUniformAlignment * objectCapacity, modelUniformAlignment);
+}
+
+void VulkanRenderer::freeDynamicBufferTransferSpace()
+{
+    alignedFree(modelTransferSpace);
+    modelTransferSpace = nullptr;
 }
 
 VkImageView VulkanRenderer::createImageView(VkImage image, VkFormat format, VkImageAspectFlags aspectFlags)
@@ -1211,28 +2472,7 @@ VkImageView VulkanRenderer::createImageView(VkImage image, VkFormat format, VkIm
     return imageView;
 }
 
-VkShaderModule VulkanRenderer::createShaderModule(const std::vector<char> & code)
-{
-    // Shader Module Create Info
-    VkShaderModuleCreateInfo shaderModuleCreateInfo = {};
-    shaderModuleCreateInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
-    shaderModuleCreateInfo.codeSize = code.size();
-    shaderModuleCreateInfo.pCode = reinterpret_cast<const uint32_t *>(code.data());
-
-    VkShaderModule shaderModule;
-
-    VkResult result = vkCreateShaderModule(mainDevice.logicalDevice, &shaderModuleCreateInfo,
-                                           nullptr, &shaderModule);
-
-    if (result != VK_SUCCESS)
-    {
-        throw std::runtime_error("Failed to create a shader module !");
-    }
-
-    return shaderModule;
-}
-
-VkImage VulkanRenderer::createImage(uint32_t width, uint32_t height, VkFormat format, VkImageTiling tiling, VkImageUsageFlags useFlags, VkMemoryPropertyFlags propFlags, VkDeviceMemory* imageMemory)
+VkImage VulkanRenderer::createImage(uint32_t width, uint32_t height, VkFormat format, VkImageTiling tiling, VkImageUsageFlags useFlags, VkMemoryPropertyFlags propFlags, MemoryAllocation* imageMemory)
 {
     // Create Image
     // - Image Creation Info
@@ -1263,20 +2503,12 @@ VkImage VulkanRenderer::createImage(uint32_t width, uint32_t height, VkFormat fo
     VkMemoryRequirements memoryRequirements;
     vkGetImageMemoryRequirements(mainDevice.logicalDevice, image, &memoryRequirements);
 
-    // Allocate memory using image requirements and user defined properties
-    VkMemoryAllocateInfo memoryAllocInfo = {};
-    memoryAllocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-    memoryAllocInfo.allocationSize = memoryRequirements.size;
-    memoryAllocInfo.memoryTypeIndex = findMemoryTypeIndex(mainDevice.physicalDevice, memoryRequirements.memoryTypeBits, propFlags);
-
-    result = vkAllocateMemory(mainDevice.logicalDevice, &memoryAllocInfo, nullptr, imageMemory);
-    if (result != VK_SUCCESS)
-    {
-        throw std::runtime_error("Failed to allocate memory for Image !");
-    }
+    // Sub-allocate memory using image requirements and user defined properties
+    // (optimal tiled images live in their own blocks, away from linear resources)
+    *imageMemory = memoryAllocator.allocate(memoryRequirements, propFlags, tiling == VK_IMAGE_TILING_LINEAR);
 
     // Connect memory to image
-    vkBindImageMemory(mainDevice.logicalDevice, image, *imageMemory, 0);
+    vkBindImageMemory(mainDevice.logicalDevice, image, imageMemory->memory, imageMemory->offset);
 
     return image;
 }
@@ -1308,6 +2540,22 @@ bool VulkanRenderer::checkInstanceExtensionSupport(std::vector<const char *> * c
     return true;
 }
 
+bool VulkanRenderer::checkDeviceExtensionAvailable(VkPhysicalDevice device, const char * extensionName)
+{
+    uint32_t extensionCount = 0;
+    vkEnumerateDeviceExtensionProperties(device, nullptr, &extensionCount, nullptr);
+
+    std::vector<VkExtensionProperties> extensions(extensionCount);
+    vkEnumerateDeviceExtensionProperties(device, nullptr, &extensionCount, extensions.data());
+
+    for (const auto & extension : extensions)
+    {
+        if (strcmp(extensionName, extension.extensionName) == 0)
+            return true;
+    }
+    return false;
+}
+
 bool VulkanRenderer::checkDeviceExtensionSupport(VkPhysicalDevice device)
 {
     // Get device extensions count.
@@ -1356,6 +2604,10 @@ bool VulkanRenderer::checkDeviceSuitable(VkPhysicalDevice device)
     if (!indices.isValid())
         return false;
 
+    // Headless : no swapchain, any device with a graphics queue will do (including software ICDs like lavapipe)
+    if (headless)
+        return true;
+
     bool extensionsSupported = checkDeviceExtensionSupport(device);
 
     if (!extensionsSupported)
@@ -1411,27 +2663,43 @@ QueueFamilyIndices VulkanRenderer::getQueueFamilies(VkPhysicalDevice device)
         // First check if queue family has at least 1 queue in that family (could have no queues)
         // Queue can be multiple types defined through bitfield. Need to bitwise AND with
         // VK_QUEUE_GRAPHICS_BIT to check if it has required type
-        if (queueFamily.queueCount > 0 && queueFamily.queueFlags & VK_QUEUE_GRAPHICS_BIT)
+        if (indices.graphicsFamily < 0 && queueFamily.queueCount > 0 && queueFamily.queueFlags & VK_QUEUE_GRAPHICS_BIT)
         {
             indices.graphicsFamily = i;     // If queue family is valid, then get index
         }
 
         // Check if queue family supports presentation.
+        // (headless : nothing is presented, the graphics family stands in for it)
         VkBool32 presentationSupport = false;
-        vkGetPhysicalDeviceSurfaceSupportKHR(device, i, surface, &presentationSupport);
+        if (headless)
+            presentationSupport = (queueFamily.queueFlags & VK_QUEUE_GRAPHICS_BIT) != 0;
+        else
+            vkGetPhysicalDeviceSurfaceSupportKHR(device, i, surface, &presentationSupport);
 
         // Check if queue is presentation type (can be both graphics and presentation)
-        if (queueFamily.queueCount > 0 && presentationSupport)
+        if (indices.presentationFamily < 0 && queueFamily.queueCount > 0 && presentationSupport)
         {
             indices.presentationFamily = i;
         }
 
+        // Transfer only family (DMA engine), copies on it run next to the graphics work
+        if (queueFamily.queueCount > 0 && (queueFamily.queueFlags & VK_QUEUE_TRANSFER_BIT)
+         && !(queueFamily.queueFlags & (VK_QUEUE_GRAPHICS_BIT | VK_QUEUE_COMPUTE_BIT)))
+        {
+            indices.transferFamily = i;
+        }
+
         // Check if queue family indices are in a valid state, stop searching if so
-        if (indices.isValid())
+        if (indices.isValid() && indices.transferFamily >= 0)
             break;
 
         ++i;
     }
+
+    // No dedicated transfer family, graphics queues can do transfers too
+    if (indices.transferFamily < 0)
+        indices.transferFamily = indices.graphicsFamily;
+
     return indices;
 }
 
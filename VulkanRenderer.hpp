@@ -2,6 +2,16 @@
 
 // Project includes
 #include "Mesh.hpp"
+#include "FrameArena.hpp"
+#include "JobSystem.hpp"
+#include "FrustumCuller.hpp"
+#include "GpuCuller.hpp"
+#include "SceneStore.hpp"
+#include "SubmitTimeline.hpp"
+#include "DeletionQueue.hpp"
+#include "PipelineCache.hpp"
+#include "PipelineLibrary.hpp"
+#include "MeshOptimizer.hpp"
 #include "VulkanValidation.hpp"
 
 #include <glm/gtc/matrix_transform.hpp>
@@ -13,6 +23,49 @@
 #include <cstring>
 #include <limits>
 #include <array>
+#include <algorithm>
+#include <chrono>
+
+// CPU time spent in each step of the last draw() call, and what it culled
+struct FrameTimings {
+    double transformMs = 0.0;   // World matrices (and bounds) of the objects moved since the last frame
+    double acquireMs = 0.0;     // vkAcquireNextImageKHR (+ pending uploads flush)
+    double fenceWaitMs = 0.0;   // Blocked on the frame context and image timeline values, high when GPU bound
+    double cullMs = 0.0;        // Frustum culling of every object (0 when disabled)
+    double recordMs = 0.0;      // Uniform buffer update and command buffer recording (if needed)
+    double submitMs = 0.0;      // vkQueueSubmit
+    double presentMs = 0.0;     // vkQueuePresentKHR (0 when headless)
+    bool recorded = false;      // Command buffer had to be re-recorded (scene changed since its last recording)
+    uint32_t visibleObjects = 0;    // Objects (mesh instances) drawn
+    uint32_t culledObjects = 0;     // Objects outside the view frustum, skipped
+};
+
+// CPU time spent by the last init()/initHeadless()
+struct StartupTimings {
+    double initMs = 0.0;            // Whole renderer initialisation
+    double pipelineMs = 0.0;        // Pipeline creation (graphics + cull compute), what the pipeline cache speeds up
+    bool pipelineCacheWarm = false; // A valid pipeline cache file was loaded
+    size_t pipelineCacheBytes = 0;  // Size of the loaded cache data
+};
+
+// Below this many draws per thread, recording is done inline on the calling thread
+const size_t MIN_DRAWS_PER_RECORD_JOB = 256;
+
+// State a swapchain image's command buffer was last recorded with
+struct RecordedCommands {
+    uint64_t sceneVersion = 0;      // 0 = never recorded
+    uint32_t vpUniformOffset = 0;
+    uint32_t modelDataOffset = 0;
+    uint32_t drawCountOffset = 0;
+    uint32_t drawCommandOffset = 0;
+};
+
+// How per-object data (model matrices) reaches the vertex shader
+enum class ObjectDataMode {
+    PUSH_CONSTANT,      // vkCmdPushConstants before every draw
+    DYNAMIC_UNIFORM,    // One aligned slot per object in a dynamic uniform buffer, rebound with a new offset every draw
+    STORAGE_BUFFER      // Tightly packed array in a storage buffer bound once, indexed by the draw's instance index
+};
 
 class VulkanRenderer
 {
@@ -20,18 +73,102 @@ public:
     VulkanRenderer();
     ~VulkanRenderer();
 
-    int init(GLFWwindow * newWindow);
-
+    // Must be called before init()/initHeadless(), the pipeline and descriptors depend on it
+    void setObjectDataMode(ObjectDataMode mode);
+    ObjectDataMode getObjectDataMode();
+    // Threads recording the draws of big scenes (calling thread included), 0 = one per hardware thread. Before init too.
+    void setRecordThreadCount(uint32_t threadCount);
+    // Draw the whole mesh list with indirect draws (one per pool chunk). Before init too.
+    // Only used with STORAGE_BUFFER object data, on devices supporting drawIndirectFirstInstance.
+    void setIndirectDrawing(bool enabled);
+    bool isIndirectDrawing();
+    // Skip the objects outside the view frustum (bounding sphere test). Before init too.
+    void setFrustumCulling(bool enabled);
+    bool isFrustumCulling();
+    // Frustum culling done by a compute pass instead of the CPU. Before init too.
+    // Only with indirect drawing, draws are compacted on devices supporting VK_KHR_draw_indirect_count.
+    void setGpuCulling(bool enabled);
+    bool isGpuCulling();
+
+    // How mesh vertices are stored : COMPACT quantizes them (half the vertex memory and fetch bandwidth). Before init.
+    void setVertexFormat(VertexFormat format);
+    VertexFormat getVertexFormat();
+    // Positions in their own vertex buffer, other attributes in a second one (position-only passes fetch less). Before init.
+    void setSplitVertexStreams(bool enabled);
+    bool isSplitVertexStreams();
+    // Meshes are optimised before upload (merged vertices, cache and overdraw friendly triangle order, see MeshOptimizer).
+    // The given vertices and indices are left as they are. Applies to meshes added after the call.
+    void setMeshOptimization(bool enabled);
+    bool isMeshOptimization();
+
+    // File the pipeline cache is loaded from at init and written back to on destroy, empty = no file. Before init.
+    void setPipelineCacheFile(const std::string & filePath);
+
+    // Frames the CPU can prepare while the GPU is still drawing the previous ones (latency vs throughput).
+    // Can also be changed after init, in-flight frames are waited first.
+    void setFramesInFlight(int framesInFlight);
+    int getFramesInFlight();
+
+    // On failure (EXIT_FAILURE), what was created is already released : destroy() must not be called
+    int init(GLFWwindow * newWindow, int framesInFlight = MAX_FRAME_DRAWS);
+    // Renders into offscreen images instead of a swapchain : no window, surface or VK_KHR_swapchain needed.
+    // readback : also copies every frame to host memory so readbackFrame() can be used.
+    int initHeadless(uint32_t width, uint32_t height, int framesInFlight = MAX_FRAME_DRAWS, bool readback = false);
+
+    // Returns the id of the new mesh, its data reaches the GPU with the next draw() or waitForUploads()
+    int addMesh(std::vector<Vertex> * vertices, std::vector<uint32_t> * indices);
+    // Geometry is stored once and drawn instances.size() times (model + color per instance),
+    // with a single draw call when the object data is a storage buffer
+    int addInstancedMesh(std::vector<Vertex> * vertices, std::vector<uint32_t> * indices, const std::vector<Model> & instances);
+    size_t getMeshCount();
+    void waitForUploads();
+
+    // Model of the mesh (of its first instance for instanced meshes)
     void updateModel(int modelId, glm::mat4 newModel);
+    // Models of several meshes at once (newModels[i] for the mesh modelIds[i])
+    void updateModels(const int * modelIds, const glm::mat4 * newModels, size_t count);
+    // Models of the mesh's instances become relative to the world matrix of the parent mesh (of its first instance),
+    // -1 detaches them. Throws if the mesh would become its own ancestor.
+    void setParent(int meshId, int parentMeshId);
+    // Replaces the instances of a mesh, their count can't change
+    void updateInstances(int meshId, const std::vector<Model> & instances);
+    // Camera
+    void updateView(glm::mat4 newView);
+
+    MemoryAllocatorStats getMemoryStats();
+    StagingUploaderStats getUploadStats();
+    FrameTimings getLastFrameTimings();
+    StartupTimings getStartupTimings();
+    PipelineLibraryStats getPipelineStats();
+    MeshOptimizerStats getMeshOptimizerStats();
 
     void draw();
+    // The window's framebuffer changed size : the swapchain is recreated before the next frame
+    void notifyResize();
     void destroy();
 
+    // Headless only : waits for the last drawn frame and copies it to pixels (RGBA8, tightly packed rows)
+    void readbackFrame(std::vector<uint8_t> * pixels);
+
+    bool isHeadless();
+    VkExtent2D getExtent();
+
+    // Pipeline variants (after init). The description of the pipeline drawn at startup, to start new ones from
+    PipelineDescription getDefaultPipelineDescription();
+    // Compiled in the background, returns at once
+    PipelineHandle requestPipeline(const PipelineDescription & description);
+    bool isPipelineReady(PipelineHandle pipeline);
+    // Pipeline the scene is drawn with. Until it's ready the current one is kept, the switch happens in draw() without waiting
+    void setScenePipeline(PipelineHandle pipeline);
+
 private:
     GLFWwindow * __window;
 
     // Scene objects
     std::vector<Mesh> meshList;
+    SceneStore sceneStore;              // Transforms, object data and bounds of every mesh instance, in object slot order
+    std::vector<uint8_t> objectVisible;         // Culling result of this frame, in object slot order
+    std::vector<uint8_t> previousObjectVisible; // Culling result direct draws were last checked against
 
     // Scene settings
     struct UboViewProjection {
@@ -40,13 +177,63 @@ private:
     } uboViewProjection;
 
     int currentFrame = 0;
+    uint64_t frameCounter = 0;      // Frames submitted, picks the offscreen image when headless
+    uint64_t sceneVersion = 1;      // Bumped on every change that needs the command buffers to be re-recorded
+    int lastDrawnFrame = -1;
+    uint32_t lastDrawnImage = 0;
+    FrameTimings lastFrameTimings;
+    int maxFramesInFlight = MAX_FRAME_DRAWS;
+
+    // Object data settings
+    ObjectDataMode objectDataMode = ObjectDataMode::STORAGE_BUFFER;
+    size_t objectCapacity = DEFAULT_OBJECT_CAPACITY;
+
+    // Vertex settings
+    VertexLayout vertexLayout;
+    bool meshOptimization = false;
+    MeshOptimizer meshOptimizer;
+    MeshOptimizerStats meshOptimizerStats;
+
+    // Recording settings
+    uint32_t recordThreadCount = 0;
+    JobSystem jobSystem;
+
+    // Indirect drawing settings
+    bool indirectDrawingRequested = true;
+    bool indirectDrawing = false;       // Requested and supported
+    bool multiDrawIndirect = false;
+
+    // Culling settings
+    bool frustumCulling = true;
+    bool compactVisibleObjects = false;     // Storage buffer object data only holds the visible objects (culling + storage buffer)
+    FrustumCuller frustumCuller;            // World bounding sphere of every object, in object slot order
+    bool gpuCullingRequested = false;
+    bool gpuCulling = false;                // Requested, culling and indirect drawing enabled, compute supported
+    GpuCuller gpuCuller;
+
+    // Headless settings
+    bool headless = false;
+    bool readbackEnabled = false;
+
+    // Synchronization settings
+    uint32_t instanceApiVersion = VK_API_VERSION_1_0;
+    bool timelineSemaphores = false;    // Vulkan 1.2 timeline semaphores supported, submit timelines use fences otherwise
+
+    int initRenderer();
+    void releaseFailedInit();
 
     // Vulkan Functions
     // - Create Functions
     void createInstance();
     void createLogicalDevice();
+    void createSubmitTimelines();
+    void createPipelineCache();
+    void createMemoryAllocator();
     void createSurface();
     void createSwapChain();
+    bool recreateSwapChain();
+    void recreateImageResources();
+    void createOffscreenImages();
     void createRenderPass();
     void createDescriptorSetLayout();
     void createPushConstantRange();
@@ -54,41 +241,64 @@ private:
     void createDepthBufferImage();
     void createFramebuffers();
     void createCommandPool();
+    void createStagingUploader();
+    void createMeshPool();
+    void createIndirectDrawBuffer();
+    void createGpuCuller();
     void createCommandBuffers();
+    void createSecondaryCommandBuffers();
     void createSynchronisation();
+    void createFrameContexts();
+    void destroyFrameContexts();
+    void createRenderFinishedSemaphores();
+    void destroyRenderFinishedSemaphores();
+    void waitForFrames();
 
-    void createUniformBuffers();
+    void createFrameArena();
     void createDescriptorPool();
     void createDescriptorSets();
+    void writeDescriptorSets();
+
+    void growObjectCapacity();
+    VkDrawIndexedIndirectCommand getDrawCommand(size_t meshId);
+    void layoutDrawCommands();
 
-    void updateUniformBuffers(uint32_t imageIndex);
+    void updateUniformBuffers();
+    void markSceneDirty();
+
+    void cullObjects(uint32_t currentImage, FrameTimings * timings);
 
     // - Validation Functions
     void setupDebugMessenger();
 
     // - Record Functions
     void recordCommands(uint32_t currentImage);
+    void recordDraws(VkCommandBuffer commandBuffer, uint32_t currentImage, size_t firstMesh, size_t lastMesh);
+    void recordIndirectDraws(VkCommandBuffer commandBuffer, uint32_t currentImage);
+    void recordViewport(VkCommandBuffer commandBuffer);
 
     // - Get Functions
     void getPhysicalDevice();
 
     // - Allocate Functions
     void allocateDynamicBufferTransferSpace();
+    void freeDynamicBufferTransferSpace();
 
     // - Support Functions
     // -- Create Functions
     VkImageView createImageView(VkImage image, VkFormat format, VkImageAspectFlags aspectFlags);
-    VkShaderModule createShaderModule(const std::vector<char> & code);
     VkImage createImage(uint32_t width, uint32_t height, VkFormat format, VkImageTiling tiling, VkImageUsageFlags useFlags,
-        VkMemoryPropertyFlags propFlags, VkDeviceMemory * imageMemory);
+        VkMemoryPropertyFlags propFlags, MemoryAllocation * imageMemory);
 
     // -- Checker Functions
     bool checkInstanceExtensionSupport(std::vector<const char *> * checkExtensions);
     bool checkDeviceExtensionSupport(VkPhysicalDevice device);
+    bool checkDeviceExtensionAvailable(VkPhysicalDevice device, const char * extensionName);
     bool checkDeviceSuitable(VkPhysicalDevice device);
     bool checkValidationLayerSupport();
 
     // -- Getter Functions
+    uint32_t getInstanceApiVersion();
     QueueFamilyIndices getQueueFamilies(VkPhysicalDevice device);
     SwapChainDetails getSwapChainDetails(VkPhysicalDevice device);
 
@@ -100,23 +310,41 @@ private:
 
     // Vulkan Components
     // - Main
-    VkInstance __instance;
-    VkDebugReportCallbackEXT callback;
+    VkInstance __instance = VK_NULL_HANDLE;
+    VkDebugReportCallbackEXT callback = VK_NULL_HANDLE;
     struct {
-        VkPhysicalDevice physicalDevice;
-        VkDevice logicalDevice;
+        VkPhysicalDevice physicalDevice = VK_NULL_HANDLE;
+        VkDevice logicalDevice = VK_NULL_HANDLE;
     } mainDevice;
+    MemoryAllocator memoryAllocator;
+    StagingUploader stagingUploader;
     VkQueue graphicsQueue;
     VkQueue presentationQueue;
-    VkSurfaceKHR surface;
-    VkSwapchainKHR swapchain;
+    VkQueue transferQueue;
+    VkSurfaceKHR surface = VK_NULL_HANDLE;
+    VkSwapchainKHR swapchain = VK_NULL_HANDLE;
+    bool swapChainOutdated = false;     // Recreated before the next frame (resize, out of date or suboptimal)
 
     std::vector<SwapChainImage> swapChainImages;
     std::vector<VkFramebuffer> swapChainFramebuffers;
     std::vector<VkCommandBuffer> commandBuffers;
+    std::vector<RecordedCommands> recordedCommands;
+
+    // Secondary command buffers the draws are recorded into by record jobs, [image][slice]
+    struct SecondaryCommands {
+        VkCommandPool commandPool = VK_NULL_HANDLE;
+        VkCommandBuffer commandBuffer = VK_NULL_HANDLE;
+    };
+    std::vector<std::vector<SecondaryCommands>> secondaryCommands;
+
+    // - Headless
+    std::vector<MemoryAllocation> offscreenImageMemory;
+    std::vector<VkBuffer> readbackBuffers;
+    std::vector<MemoryAllocation> readbackBufferMemory;
+    std::vector<void *> readbackData;
 
     VkImage depthBufferImage;
-    VkDeviceMemory depthBufferImageMemory;
+    MemoryAllocation depthBufferImageMemory;
     VkImageView depthBufferImageView;
     VkFormat depthFormat;
 
@@ -127,36 +355,76 @@ private:
     VkDescriptorPool descriptorPool;
     std::vector<VkDescriptorSet> descriptorSets;
 
-    std::vector<VkBuffer> vpUniformBuffer;
-    std::vector<VkDeviceMemory> vpUniformBufferMemory;
-
-    std::vector<VkBuffer> modelDynamicUniformBuffer;
-    std::vector<VkDeviceMemory> modelDynamicUniformBufferMemory;
-
-    //VkDeviceSize minUniformBufferOffset;
-    //size_t modelUniformAlignment;
-    //Model * modelTransferSpace;
+    FrameArena frameArena;
+    uint32_t vpUniformOffset;       // Dynamic offset of this frame's view projection data in the arena
+    uint32_t modelDataOffset = 0;   // Dynamic offset of this frame's object data in the arena
+
+    VkDeviceSize minUniformBufferOffset;
+    VkDeviceSize minStorageBufferOffset;
+    size_t modelUniformAlignment;   // Distance between two objects' data (sizeof(Model) rounded up for dynamic uniforms)
+    Model * modelTransferSpace = nullptr;   // Host side gathering of every object's data, copied to the arena at once
+
+    // - Indirect Drawing
+    MeshPool meshPool;
+    VkBuffer indirectBuffer;
+    MemoryAllocation indirectBufferMemory;
+    std::vector<VkDrawIndexedIndirectCommand> drawCommands;     // One per mesh, grouped per pool chunk (in chunk order)
+    size_t uploadedDrawCommands = 0;                            // Commands already in indirectBuffer
+
+    // Draws of a pool chunk : contiguous range of drawCommands, its meshes in the order they were added
+    struct ChunkDraws {
+        uint32_t firstDraw = 0;
+        uint32_t drawCount = 0;
+        std::vector<uint32_t> meshes;
+    };
+    std::vector<ChunkDraws> chunkDraws;
+    bool drawLayoutDirty = false;   // A mesh went to a chunk whose range isn't the last one : ranges are laid out again
+    uint32_t drawCountOffset = 0;   // Dynamic offset of this frame's per chunk draw counts in the arena
+
+    // Draw commands of the visible instances of every mesh (culling), rebuilt every frame with the object data
+    // and written to the arena for indirect draws
+    std::vector<VkDrawIndexedIndirectCommand> visibleDrawCommands;
+    uint32_t drawCommandOffset = 0; // Offset of this frame's draw commands in the arena
+    PFN_vkCmdDrawIndexedIndirectCountKHR cmdDrawIndexedIndirectCount = nullptr;    // VK_KHR_draw_indirect_count, if available
 
     // - Pipeline
-    VkPipeline graphicsPipeline;
+    PipelineCache pipelineCache;
+    std::string pipelineCacheFile = DEFAULT_PIPELINE_CACHE_FILE;
+    StartupTimings startupTimings;
+    PipelineLibrary pipelineLibrary;
+    PipelineHandle defaultPipeline = INVALID_PIPELINE;
+    PipelineHandle scenePipeline = INVALID_PIPELINE;    // Requested by setScenePipeline(), drawn once ready
+    VkPipeline graphicsPipeline;                        // Pipeline the command buffers are recorded with
     VkPipelineLayout pipelineLayout;
     VkRenderPass renderPass;
 
     // - Pools
     VkCommandPool graphicsCommandPool;
+    VkCommandPool transferCommandPool;
 
     // - Utility
     VkFormat swapChainImageFormat;
     VkExtent2D swapChainExtent;
 
     // - Synchronization
-    std::vector<VkSemaphore> imageAvailable;
-    std::vector<VkSemaphore> renderFinished;
-    std::vector<VkFence> drawFences;
+    // Every submission of a queue gets a value on its timeline (transfer = graphics timeline when it's the same queue).
+    // Binary semaphores are only left where timelines can't be used : acquire, present and between queues
+    SubmitTimeline graphicsTimeline;
+    SubmitTimeline transferTimeline;
+    DeletionQueue deletionQueue;        // Resources replaced at runtime, released once the graphics timeline passes their last use
+    // Per frame in flight, reused once the graphics timeline reaches the frame's value
+    struct FrameContext {
+        VkSemaphore imageAvailable;     // Signaled by the acquire, waited by the submit
+        uint64_t submitValue = 0;       // Graphics timeline value of the frame's last submission
+    };
+    std::vector<FrameContext> frames;
+    // Per swapchain image : command buffers and arena slices (above) are recorded once and reused, so they follow the image
+    std::vector<VkSemaphore> renderFinished;    // Waited by the present of the image, only signaled again once it's re-acquired
+    std::vector<uint64_t> imagesInFlight;       // Graphics timeline value of the frame that last drew each swapchain image
 
     // - Validation Attributes
     //#ifdef VULKAN_DEBUG
-        const bool enableValidationLayers = true;
+        bool enableValidationLayers = true;
     //#else
     //    const bool enableValidationLayers = false;
     //#endif
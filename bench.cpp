@@ -0,0 +1,864 @@
+#define GLM_FORCE_RADIANS
+#define GLM_FORCE_DEPTH_ZERO_TO_ONE
+#include <glm/glm.hpp>
+#include <glm/mat4x4.hpp>
+
+#include "VulkanRenderer.hpp"
+
+// C++ includes
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <memory>
+#include <algorithm>
+#include <cmath>
+#include <random>
+#include <functional>
+#include <cstdio>
+
+// Frame-time benchmark.
+// Runs the renderer (headless by default) through every combination of the requested mesh counts,
+// vertex counts, frames in flight, update patterns, object data paths, record threads, draw paths, instancing, culling, vertex formats, vertex streams
+// and mesh optimisation, and reports CPU frame times, submit/present times, visible/culled objects, startup and pipeline creation times,
+// upload throughput, mesh optimiser stats and memory usage as JSON or CSV.
+// Every scenario starts a new renderer : with a pipeline cache file, only the first one can be a cold start.
+//
+// --optimizer-only runs the mesh optimiser alone on the CPU (no renderer, no Vulkan), on an unwelded grid of each --vertices count
+// with its triangles shuffled, --frames times per count.
+//
+// ./vulkanBench --meshes 1,100,10000 --vertices 4,256 --frames-in-flight 1,2,3 --update static,all,sparse,hierarchy
+//               --object-data push,dynamic,storage --threads 1,2,4 --draw direct,indirect
+//               --instancing off,on --culling off,cpu,gpu --vertex-format full,compact --vertex-streams interleaved,split --optimize off,on --view-offset 2 --pipeline-cache off --frames 300 --warmup 30 --format json --output bench.json --label <commit>
+
+struct BenchSettings {
+    std::vector<int> meshCounts = { 1, 100, 1000, 10000, 100000 };
+    std::vector<int> vertexCounts = { 4 };
+    std::vector<int> framesInFlight = { MAX_FRAME_DRAWS };
+    std::vector<std::string> updatePatterns = { "static", "all" };
+    std::vector<std::string> objectDataModes = { "storage" };
+    std::vector<int> recordThreads = { 0 };     // 0 = one per hardware thread
+    std::vector<std::string> drawPaths = { "indirect" };
+    std::vector<std::string> instancingModes = { "off" };     // on = one mesh drawn meshCount times
+    std::vector<std::string> cullingModes = { "cpu" };   // Frustum culling on the CPU or in a compute pass
+    std::vector<std::string> vertexFormats = { "full" };  // compact = quantized vertices
+    std::vector<std::string> vertexStreams = { "interleaved" };   // split = positions and other attributes in separate buffers
+    std::vector<std::string> optimizeModes = { "off" };     // on = meshes go through the mesh optimiser before upload
+    bool optimizerOnly = false;     // Only the mesh optimiser, on the CPU
+    float viewOffset = 0.0f;    // Camera moved sideways by this much, the grid fills the view at 0 (3 = fully out of view)
+    std::string pipelineCache = DEFAULT_PIPELINE_CACHE_FILE;   // "off" = pipelines always compiled
+    int frames = 300;
+    int warmup = 30;
+    uint32_t width = 800;
+    uint32_t height = 600;
+    bool window = false;
+    std::string format = "json";
+    std::string output;
+    std::string label;
+};
+
+struct Scenario {
+    int meshCount;
+    int vertexCount;
+    int framesInFlight;
+    std::string updatePattern;
+    std::string objectData;
+    int recordThreads;
+    std::string drawPath;
+    std::string instancing;
+    std::string culling;
+    std::string vertexFormat;
+    std::string vertexStreams;
+    std::string optimize;
+};
+
+// One scenario dimension : every combination of the values of all the dimensions is run
+struct Dimension {
+    const char * name;                  // As printed in the progress line
+    std::vector<std::string> labels;    // Printed form of each value
+    std::function<void(Scenario *, size_t)> select;     // Sets the scenario's field to value i
+};
+
+Dimension intDimension(const char * name, const std::vector<int> & values, int Scenario::* field)
+{
+    Dimension dimension = { name, {}, [values, field](Scenario * scenario, size_t i) { scenario->*field = values[i]; } };
+    for (int value : values)
+        dimension.labels.push_back(std::to_string(value));
+    return dimension;
+}
+
+Dimension stringDimension(const char * name, const std::vector<std::string> & values, std::string Scenario::* field)
+{
+    return { name, values, [values, field](Scenario * scenario, size_t i) { scenario->*field = values[i]; } };
+}
+
+// Scenario dimensions, the first one changes the slowest.
+// A new dimension is one more entry here, a Scenario field, and its columns in the writers
+// Combinations the harness can't measure under their label are skipped :
+// instanced objects are one mesh without parents, so there is no hierarchy to move
+bool isMeasurable(const Scenario & scenario)
+{
+    return !(scenario.instancing == "on" && scenario.updatePattern == "hierarchy");
+}
+
+std::vector<Dimension> getDimensions(const BenchSettings & settings)
+{
+    return {
+        intDimension("meshes", settings.meshCounts, &Scenario::meshCount),
+        intDimension("vertices", settings.vertexCounts, &Scenario::vertexCount),
+        intDimension("framesInFlight", settings.framesInFlight, &Scenario::framesInFlight),
+        stringDimension("update", settings.updatePatterns, &Scenario::updatePattern),
+        stringDimension("objectData", settings.objectDataModes, &Scenario::objectData),
+        intDimension("threads", settings.recordThreads, &Scenario::recordThreads),
+        stringDimension("draw", settings.drawPaths, &Scenario::drawPath),
+        stringDimension("instancing", settings.instancingModes, &Scenario::instancing),
+        stringDimension("culling", settings.cullingModes, &Scenario::culling),
+        stringDimension("vertexFormat", settings.vertexFormats, &Scenario::vertexFormat),
+        stringDimension("vertexStreams", settings.vertexStreams, &Scenario::vertexStreams),
+        stringDimension("optimize", settings.optimizeModes, &Scenario::optimize),
+    };
+}
+
+struct Percentiles {
+    double mean = 0.0;
+    double p50 = 0.0;
+    double p90 = 0.0;
+    double p99 = 0.0;
+    double max = 0.0;
+};
+
+// --optimizer-only : one mesh optimised frames times
+struct OptimizerResult {
+    int vertexCount = 0;
+    Percentiles optimizeMs;
+    MeshOptimizerStats stats;   // Of one run (every run gets the same mesh)
+};
+
+struct BenchResult {
+    Scenario scenario;
+    bool success = false;
+
+    Percentiles frameMs;        // Whole CPU frame (scene update + draw)
+    Percentiles transformMs;
+    Percentiles fenceWaitMs;
+    Percentiles recordMs;
+    Percentiles submitMs;
+    Percentiles presentMs;
+    int recordedFrames = 0;     // Measured frames that had to re-record their command buffer
+    Percentiles cullMs;
+    uint32_t visibleObjects = 0;    // In the last measured frame
+    uint32_t culledObjects = 0;
+
+    MeshOptimizerStats optimizerStats;
+    StartupTimings startup;     // Renderer init, pipeline creation and whether the pipeline cache was warm
+    double loadMs = 0.0;        // Mesh creation + upload until the GPU has the data
+    double uploadMBps = 0.0;
+    StagingUploaderStats uploadStats;
+    MemoryAllocatorStats memoryStats;
+};
+
+GLFWwindow * window = nullptr;
+
+std::vector<std::string> split(const std::string & list)
+{
+    std::vector<std::string> values;
+    std::stringstream stream(list);
+    std::string value;
+    while (std::getline(stream, value, ','))
+    {
+        if (!value.empty())
+            values.push_back(value);
+    }
+    return values;
+}
+
+std::vector<int> splitInts(const std::string & list)
+{
+    std::vector<int> values;
+    for (const auto & value : split(list))
+        values.push_back(std::stoi(value));
+    return values;
+}
+
+bool parseArguments(int argc, char ** argv, BenchSettings * settings)
+{
+    for (int i = 1; i < argc; ++i)
+    {
+        std::string argument = argv[i];
+        if (argument == "--window")
+        {
+            settings->window = true;
+            continue;
+        }
+        if (argument == "--optimizer-only")
+        {
+            settings->optimizerOnly = true;
+            continue;
+        }
+
+        if (i + 1 >= argc)
+        {
+            std::cerr << "Missing value for " << argument << std::endl;
+            return false;
+        }
+        std::string value = argv[++i];
+
+        if (argument == "--meshes")                 settings->meshCounts = splitInts(value);
+        else if (argument == "--vertices")          settings->vertexCounts = splitInts(value);
+        else if (argument == "--frames-in-flight")  settings->framesInFlight = splitInts(value);
+        else if (argument == "--update")            settings->updatePatterns = split(value);
+        else if (argument == "--object-data")       settings->objectDataModes = split(value);
+        else if (argument == "--threads")           settings->recordThreads = splitInts(value);
+        else if (argument == "--draw")              settings->drawPaths = split(value);
+        else if (argument == "--instancing")        settings->instancingModes = split(value);
+        else if (argument == "--culling")           settings->cullingModes = split(value);
+        else if (argument == "--vertex-format")     settings->vertexFormats = split(value);
+        else if (argument == "--vertex-streams")    settings->vertexStreams = split(value);
+        else if (argument == "--optimize")          settings->optimizeModes = split(value);
+        else if (argument == "--view-offset")       settings->viewOffset = std::stof(value);
+        else if (argument == "--pipeline-cache")    settings->pipelineCache = value;
+        else if (argument == "--frames")            settings->frames = std::stoi(value);
+        else if (argument == "--warmup")            settings->warmup = std::stoi(value);
+        else if (argument == "--width")             settings->width = static_cast<uint32_t>(std::stoi(value));
+        else if (argument == "--height")            settings->height = static_cast<uint32_t>(std::stoi(value));
+        else if (argument == "--format")            settings->format = value;
+        else if (argument == "--output")            settings->output = value;
+        else if (argument == "--label")             settings->label = value;
+        else
+        {
+            std::cerr << "Unknown argument " << argument << std::endl;
+            return false;
+        }
+    }
+
+    for (const auto & pattern : settings->updatePatterns)
+    {
+        if (pattern != "static" && pattern != "all" && pattern != "sparse" && pattern != "hierarchy")
+        {
+            std::cerr << "Unknown update pattern " << pattern << " (static, all, sparse, hierarchy)" << std::endl;
+            return false;
+        }
+    }
+
+    for (const auto & mode : settings->objectDataModes)
+    {
+        if (mode != "push" && mode != "dynamic" && mode != "storage")
+        {
+            std::cerr << "Unknown object data mode " << mode << " (push, dynamic, storage)" << std::endl;
+            return false;
+        }
+    }
+
+    for (const auto & path : settings->drawPaths)
+    {
+        if (path != "direct" && path != "indirect")
+        {
+            std::cerr << "Unknown draw path " << path << " (direct, indirect)" << std::endl;
+            return false;
+        }
+    }
+
+    for (const auto & mode : settings->instancingModes)
+    {
+        if (mode != "off" && mode != "on")
+        {
+            std::cerr << "Unknown instancing mode " << mode << " (off, on)" << std::endl;
+            return false;
+        }
+    }
+
+    for (const auto & mode : settings->cullingModes)
+    {
+        if (mode != "off" && mode != "cpu" && mode != "gpu")
+        {
+            std::cerr << "Unknown culling mode " << mode << " (off, cpu, gpu)" << std::endl;
+            return false;
+        }
+    }
+
+    for (const auto & format : settings->vertexFormats)
+    {
+        if (format != "full" && format != "compact")
+        {
+            std::cerr << "Unknown vertex format " << format << " (full, compact)" << std::endl;
+            return false;
+        }
+    }
+
+    for (const auto & streams : settings->vertexStreams)
+    {
+        if (streams != "interleaved" && streams != "split")
+        {
+            std::cerr << "Unknown vertex streams " << streams << " (interleaved, split)" << std::endl;
+            return false;
+        }
+    }
+
+    for (const auto & mode : settings->optimizeModes)
+    {
+        if (mode != "off" && mode != "on")
+        {
+            std::cerr << "Unknown optimize mode " << mode << " (off, on)" << std::endl;
+            return false;
+        }
+    }
+
+    return settings->format == "json" || settings->format == "csv";
+}
+
+ObjectDataMode toObjectDataMode(const std::string & mode)
+{
+    if (mode == "push") return ObjectDataMode::PUSH_CONSTANT;
+    if (mode == "dynamic") return ObjectDataMode::DYNAMIC_UNIFORM;
+    return ObjectDataMode::STORAGE_BUFFER;
+}
+
+Percentiles computePercentiles(std::vector<double> samples)
+{
+    Percentiles percentiles;
+    if (samples.empty())
+        return percentiles;
+
+    std::sort(samples.begin(), samples.end());
+
+    double sum = 0.0;
+    for (double sample : samples)
+        sum += sample;
+
+    // Nearest rank
+    auto rank = [&samples](double percentile) {
+        size_t index = static_cast<size_t>(std::ceil(percentile * samples.size())) - 1;
+        return samples[std::min(index, samples.size() - 1)];
+    };
+
+    percentiles.mean = sum / samples.size();
+    percentiles.p50 = rank(0.50);
+    percentiles.p90 = rank(0.90);
+    percentiles.p99 = rank(0.99);
+    percentiles.max = samples.back();
+    return percentiles;
+}
+
+// Flat polygon (triangle fan) with vertexCount vertices, radius 1
+void createPolygon(int vertexCount, std::vector<Vertex> * vertices, std::vector<uint32_t> * indices)
+{
+    vertexCount = std::max(vertexCount, 3);
+
+    for (int i = 0; i < vertexCount; ++i)
+    {
+        float angle = 6.28318530718f * i / vertexCount;
+        float shade = static_cast<float>(i) / vertexCount;
+        vertices->push_back({ { std::cos(angle), std::sin(angle), 0.0f }, { shade, 1.0f - shade, 0.5f } });
+    }
+
+    for (int i = 1; i + 1 < vertexCount; ++i)
+    {
+        indices->push_back(0);
+        indices->push_back(i);
+        indices->push_back(i + 1);
+    }
+}
+
+// Square grid of about vertexCount vertices, as unwelded data gives it : every triangle has its own 3 vertices,
+// and triangles come in a random (fixed seed) order. The worst case for the vertex cache and vertex fetch.
+void createUnweldedGrid(int vertexCount, std::vector<Vertex> * vertices, std::vector<uint32_t> * indices)
+{
+    int side = std::max(static_cast<int>(std::sqrt(static_cast<float>(vertexCount))) - 1, 1);
+
+    std::vector<glm::vec3> corners;
+    for (int y = 0; y < side; ++y)
+    {
+        for (int x = 0; x < side; ++x)
+        {
+            // Counter-clockwise quad
+            float left = static_cast<float>(x);
+            float bottom = static_cast<float>(y);
+            glm::vec3 quad[4] = { { left, bottom, 0.0f }, { left + 1.0f, bottom, 0.0f }, { left + 1.0f, bottom + 1.0f, 0.0f }, { left, bottom + 1.0f, 0.0f } };
+            int quadCorners[6] = { 0, 1, 2, 2, 3, 0 };
+            for (int corner : quadCorners)
+                corners.push_back(quad[corner] / static_cast<float>(side));
+        }
+    }
+
+    std::vector<uint32_t> triangles(corners.size() / 3);
+    for (size_t i = 0; i < triangles.size(); ++i)
+        triangles[i] = static_cast<uint32_t>(i);
+    std::shuffle(triangles.begin(), triangles.end(), std::mt19937(42));
+
+    for (uint32_t triangle : triangles)
+    {
+        for (uint32_t corner = 0; corner < 3; ++corner)
+        {
+            const glm::vec3 & position = corners[triangle * 3 + corner];
+            indices->push_back(static_cast<uint32_t>(vertices->size()));
+            vertices->push_back({ position, { position.x, position.y, 0.5f } });
+        }
+    }
+}
+
+// Meshes are laid out on a square grid filling the view
+glm::mat4 gridModel(int meshId, int meshCount, float angle)
+{
+    int side = static_cast<int>(std::ceil(std::sqrt(static_cast<float>(meshCount))));
+    float cellSize = 3.0f / side;
+
+    float x = -1.5f + cellSize * (meshId % side + 0.5f);
+    float y = -1.5f + cellSize * (meshId / side + 0.5f);
+
+    glm::mat4 model(1.0f);
+    model = glm::translate(model, glm::vec3(x, y, -2.0f));
+    model = glm::rotate(model, glm::radians(angle), glm::vec3(0.0f, 0.0f, 1.0f));
+    model = glm::scale(model, glm::vec3(cellSize * 0.45f));
+    return model;
+}
+
+// Instanced scenarios : every object is an instance of mesh 0, instances holds their data.
+// Otherwise modelIds and models are the batch handed over by the "all" pattern (sized by the scenario)
+void updateScene(VulkanRenderer & renderer, const Scenario & scenario, int frame, std::vector<Model> * instances,
+                 std::vector<int> * modelIds, std::vector<glm::mat4> * models)
+{
+    float angle = frame * 2.0f;
+
+    if (scenario.instancing == "on")
+    {
+        if (scenario.updatePattern == "static")
+            return;
+
+        // Same objects as below, written to the instance array then handed over at once (all or sparse, see isMeasurable())
+        int updateCount = scenario.updatePattern == "all" ? scenario.meshCount : std::max(1, scenario.meshCount / 100);
+        for (int i = 0; i < updateCount; ++i)
+        {
+            int instance = scenario.updatePattern == "all" ? i : (frame * updateCount + i) % scenario.meshCount;
+            (*instances)[instance].model = gridModel(instance, scenario.meshCount, angle);
+        }
+        renderer.updateInstances(0, *instances);
+    }
+    else if (scenario.updatePattern == "hierarchy")
+    {
+        // Only the root moves, its descendants follow : every world matrix changes
+        renderer.updateModel(0, gridModel(0, scenario.meshCount, angle));
+    }
+    else if (scenario.updatePattern == "all")
+    {
+        // Every object moves every frame, handed over in one batch
+        for (int i = 0; i < scenario.meshCount; ++i)
+        {
+            (*modelIds)[i] = i;
+            (*models)[i] = gridModel(i, scenario.meshCount, angle);
+        }
+        renderer.updateModels(modelIds->data(), models->data(), models->size());
+    }
+    else if (scenario.updatePattern == "sparse")
+    {
+        // 1% of the objects move each frame, a different slice every frame
+        int updateCount = std::max(1, scenario.meshCount / 100);
+        for (int i = 0; i < updateCount; ++i)
+        {
+            int meshId = (frame * updateCount + i) % scenario.meshCount;
+            renderer.updateModel(meshId, gridModel(meshId, scenario.meshCount, angle));
+        }
+    }
+}
+
+BenchResult runScenario(const BenchSettings & settings, const Scenario & scenario)
+{
+    BenchResult benchResult;
+    benchResult.scenario = scenario;
+
+    // Fresh renderer for every scenario so results don't depend on the previous ones
+    std::unique_ptr<VulkanRenderer> renderer(new VulkanRenderer());
+    renderer->setObjectDataMode(toObjectDataMode(scenario.objectData));
+    renderer->setRecordThreadCount(static_cast<uint32_t>(scenario.recordThreads));
+    renderer->setIndirectDrawing(scenario.drawPath == "indirect");
+    renderer->setFrustumCulling(scenario.culling != "off");
+    renderer->setGpuCulling(scenario.culling == "gpu");
+    renderer->setVertexFormat(scenario.vertexFormat == "compact" ? VertexFormat::COMPACT : VertexFormat::FULL);
+    renderer->setSplitVertexStreams(scenario.vertexStreams == "split");
+    renderer->setMeshOptimization(scenario.optimize == "on");
+    renderer->setPipelineCacheFile(settings.pipelineCache == "off" ? "" : settings.pipelineCache);
+
+    int result = settings.window
+        ? renderer->init(window, scenario.framesInFlight)
+        : renderer->initHeadless(settings.width, settings.height, scenario.framesInFlight);
+    // A failed init already released what it created
+    if (result == EXIT_FAILURE)
+        return benchResult;
+    benchResult.startup = renderer->getStartupTimings();
+
+    try {
+        // Same camera as the renderer's default one, moved sideways
+        renderer->updateView(glm::lookAt(glm::vec3(settings.viewOffset, 0.0f, 2.0f), glm::vec3(settings.viewOffset, 0.0f, 0.0f),
+                                         glm::vec3(0.0f, 1.0f, 0.0f)));
+
+        // -- LOAD --
+        std::vector<Vertex> vertices;
+        std::vector<uint32_t> indices;
+        createPolygon(scenario.vertexCount, &vertices, &indices);
+
+        std::vector<Model> instances;
+        auto loadStart = std::chrono::steady_clock::now();
+        if (scenario.instancing == "on")
+        {
+            instances.resize(scenario.meshCount);
+            for (int i = 0; i < scenario.meshCount; ++i)
+            {
+                instances[i].model = gridModel(i, scenario.meshCount, 0.0f);
+            }
+            renderer->addInstancedMesh(&vertices, &indices, instances);
+        }
+        else
+        {
+            for (int i = 0; i < scenario.meshCount; ++i)
+            {
+                int meshId = renderer->addMesh(&vertices, &indices);
+                renderer->updateModel(meshId, gridModel(meshId, scenario.meshCount, 0.0f));
+            }
+
+            // Hierarchy : meshes form a tree (8 children per node) under mesh 0, each keeping its place on the grid
+            if (scenario.updatePattern == "hierarchy")
+            {
+                for (int meshId = 1; meshId < scenario.meshCount; ++meshId)
+                {
+                    int parentId = (meshId - 1) / 8;
+                    renderer->setParent(meshId, parentId);
+                    renderer->updateModel(meshId, glm::inverse(gridModel(parentId, scenario.meshCount, 0.0f)) * gridModel(meshId, scenario.meshCount, 0.0f));
+                }
+            }
+        }
+        renderer->waitForUploads();
+        benchResult.loadMs = elapsedMs(loadStart);
+
+        // Batch of the "all" pattern, filled every frame
+        std::vector<int> modelIds;
+        std::vector<glm::mat4> models;
+        if (scenario.instancing != "on" && scenario.updatePattern == "all")
+        {
+            modelIds.resize(scenario.meshCount);
+            models.resize(scenario.meshCount);
+        }
+        benchResult.optimizerStats = renderer->getMeshOptimizerStats();
+
+        benchResult.uploadStats = renderer->getUploadStats();
+        if (benchResult.loadMs > 0.0)
+        {
+            benchResult.uploadMBps = (benchResult.uploadStats.bytesUploaded / (1024.0 * 1024.0)) / (benchResult.loadMs / 1000.0);
+        }
+
+        // -- FRAMES --
+        std::vector<double> frameMs, transformMs, fenceWaitMs, cullMs, recordMs, submitMs, presentMs;
+        for (int frame = 0; frame < settings.warmup + settings.frames; ++frame)
+        {
+            if (settings.window)
+                glfwPollEvents();
+
+            auto frameStart = std::chrono::steady_clock::now();
+            updateScene(*renderer, scenario, frame, &instances, &modelIds, &models);
+            renderer->draw();
+            double frameTime = elapsedMs(frameStart);
+
+            if (frame < settings.warmup)
+                continue;
+
+            FrameTimings timings = renderer->getLastFrameTimings();
+            frameMs.push_back(frameTime);
+            transformMs.push_back(timings.transformMs);
+            fenceWaitMs.push_back(timings.fenceWaitMs);
+            cullMs.push_back(timings.cullMs);
+            recordMs.push_back(timings.recordMs);
+            submitMs.push_back(timings.submitMs);
+            presentMs.push_back(timings.presentMs);
+            if (timings.recorded)
+                ++benchResult.recordedFrames;
+            benchResult.visibleObjects = timings.visibleObjects;
+            benchResult.culledObjects = timings.culledObjects;
+        }
+
+        benchResult.frameMs = computePercentiles(frameMs);
+        benchResult.transformMs = computePercentiles(transformMs);
+        benchResult.fenceWaitMs = computePercentiles(fenceWaitMs);
+        benchResult.cullMs = computePercentiles(cullMs);
+        benchResult.recordMs = computePercentiles(recordMs);
+        benchResult.submitMs = computePercentiles(submitMs);
+        benchResult.presentMs = computePercentiles(presentMs);
+        benchResult.memoryStats = renderer->getMemoryStats();
+        benchResult.success = true;
+    } catch (const std::exception & e) {
+        std::cerr << "ERROR : " << e.what() << std::endl;
+    }
+
+    renderer->destroy();
+    return benchResult;
+}
+
+OptimizerResult runOptimizer(const BenchSettings & settings, int vertexCount)
+{
+    OptimizerResult optimizerResult;
+    optimizerResult.vertexCount = vertexCount;
+
+    std::vector<Vertex> sourceVertices;
+    std::vector<uint32_t> sourceIndices;
+    createUnweldedGrid(vertexCount, &sourceVertices, &sourceIndices);
+
+    // Same optimiser every run (its scratch memory is reused, as in the renderer), fresh copies of the mesh
+    MeshOptimizer optimizer;
+    std::vector<Vertex> vertices;
+    std::vector<uint32_t> indices;
+    std::vector<double> optimizeMs;
+    for (int run = 0; run < settings.warmup + settings.frames; ++run)
+    {
+        vertices = sourceVertices;
+        indices = sourceIndices;
+        MeshOptimizerStats stats = optimizer.optimize(&vertices, &indices);
+
+        if (run < settings.warmup)
+            continue;
+        optimizeMs.push_back(stats.optimizeMs);
+        optimizerResult.stats = stats;
+    }
+
+    optimizerResult.optimizeMs = computePercentiles(optimizeMs);
+    return optimizerResult;
+}
+
+// The label is free text : quotes, backslashes and control characters are escaped so the file stays valid JSON
+std::string escapeJson(const std::string & text)
+{
+    std::string escaped;
+    for (char c : text)
+    {
+        if (c == '"' || c == '\\')
+        {
+            escaped += '\\';
+            escaped += c;
+        }
+        else if (static_cast<unsigned char>(c) < 0x20)
+        {
+            char code[8];
+            snprintf(code, sizeof(code), "\\u%04x", c);
+            escaped += code;
+        }
+        else
+        {
+            escaped += c;
+        }
+    }
+    return escaped;
+}
+
+void writePercentilesJson(std::ostream & out, const char * name, const Percentiles & percentiles)
+{
+    out << "\"" << name << "\": { \"mean\": " << percentiles.mean << ", \"p50\": " << percentiles.p50
+        << ", \"p90\": " << percentiles.p90 << ", \"p99\": " << percentiles.p99 << ", \"max\": " << percentiles.max << " }";
+}
+
+void writeJson(std::ostream & out, const BenchSettings & settings, const std::vector<BenchResult> & results)
+{
+    out << "{\n";
+    out << "  \"label\": \"" << escapeJson(settings.label) << "\",\n";
+    out << "  \"mode\": \"" << (settings.window ? "window" : "headless") << "\",\n";
+    out << "  \"frames\": " << settings.frames << ",\n";
+    out << "  \"warmup\": " << settings.warmup << ",\n";
+    out << "  \"viewOffset\": " << settings.viewOffset << ",\n";
+    out << "  \"results\": [\n";
+    for (size_t i = 0; i < results.size(); ++i)
+    {
+        const BenchResult & r = results[i];
+        out << "    {\n";
+        out << "      \"meshes\": " << r.scenario.meshCount << ", \"vertices\": " << r.scenario.vertexCount
+            << ", \"framesInFlight\": " << r.scenario.framesInFlight << ", \"update\": \"" << r.scenario.updatePattern << "\""
+            << ", \"objectData\": \"" << r.scenario.objectData << "\", \"threads\": " << r.scenario.recordThreads
+            << ", \"draw\": \"" << r.scenario.drawPath << "\", \"instancing\": \"" << r.scenario.instancing << "\""
+            << ", \"culling\": \"" << r.scenario.culling << "\", \"vertexFormat\": \"" << r.scenario.vertexFormat << "\""
+            << ", \"vertexStreams\": \"" << r.scenario.vertexStreams << "\", \"optimize\": \"" << r.scenario.optimize << "\",\n";
+        out << "      \"success\": " << (r.success ? "true" : "false") << ",\n";
+        out << "      "; writePercentilesJson(out, "frameMs", r.frameMs); out << ",\n";
+        out << "      "; writePercentilesJson(out, "transformMs", r.transformMs); out << ",\n";
+        out << "      "; writePercentilesJson(out, "fenceWaitMs", r.fenceWaitMs); out << ",\n";
+        out << "      "; writePercentilesJson(out, "cullMs", r.cullMs); out << ",\n";
+        out << "      "; writePercentilesJson(out, "recordMs", r.recordMs); out << ",\n";
+        out << "      "; writePercentilesJson(out, "submitMs", r.submitMs); out << ",\n";
+        out << "      "; writePercentilesJson(out, "presentMs", r.presentMs); out << ",\n";
+        out << "      \"recordedFrames\": " << r.recordedFrames << ",\n";
+        out << "      \"startup\": { \"initMs\": " << r.startup.initMs << ", \"pipelineMs\": " << r.startup.pipelineMs
+            << ", \"pipelineCacheWarm\": " << (r.startup.pipelineCacheWarm ? "true" : "false")
+            << ", \"pipelineCacheBytes\": " << r.startup.pipelineCacheBytes << " },\n";
+        out << "      \"optimizer\": { \"optimizeMs\": " << r.optimizerStats.optimizeMs
+            << ", \"acmrBefore\": " << r.optimizerStats.getAcmrBefore() << ", \"acmrAfter\": " << r.optimizerStats.getAcmrAfter()
+            << ", \"atvrBefore\": " << r.optimizerStats.getAtvrBefore() << ", \"atvrAfter\": " << r.optimizerStats.getAtvrAfter() << " },\n";
+        out << "      \"visibleObjects\": " << r.visibleObjects << ", \"culledObjects\": " << r.culledObjects << ",\n";
+        out << "      \"upload\": { \"loadMs\": " << r.loadMs << ", \"bytes\": " << r.uploadStats.bytesUploaded
+            << ", \"MBps\": " << r.uploadMBps << ", \"submits\": " << r.uploadStats.submitCount
+            << ", \"stalls\": " << r.uploadStats.stallCount << " },\n";
+        out << "      \"memory\": { \"blocks\": " << r.memoryStats.blockCount << ", \"allocations\": " << r.memoryStats.allocationCount
+            << ", \"bytesAllocated\": " << r.memoryStats.bytesAllocated << ", \"bytesInUse\": " << r.memoryStats.bytesInUse
+            << ", \"fragmentation\": " << r.memoryStats.fragmentation << " }\n";
+        out << "    }" << (i + 1 < results.size() ? "," : "") << "\n";
+    }
+    out << "  ]\n";
+    out << "}\n";
+}
+
+void writeOptimizerJson(std::ostream & out, const BenchSettings & settings, const std::vector<OptimizerResult> & results)
+{
+    out << "{\n";
+    out << "  \"label\": \"" << escapeJson(settings.label) << "\",\n";
+    out << "  \"mode\": \"optimizer\",\n";
+    out << "  \"runs\": " << settings.frames << ",\n";
+    out << "  \"warmup\": " << settings.warmup << ",\n";
+    out << "  \"results\": [\n";
+    for (size_t i = 0; i < results.size(); ++i)
+    {
+        const OptimizerResult & r = results[i];
+        out << "    {\n";
+        out << "      \"vertices\": " << r.vertexCount << ", \"triangles\": " << r.stats.triangles << ",\n";
+        out << "      "; writePercentilesJson(out, "optimizeMs", r.optimizeMs); out << ",\n";
+        out << "      \"verticesBefore\": " << r.stats.verticesBefore << ", \"verticesAfter\": " << r.stats.verticesAfter << ",\n";
+        out << "      \"acmrBefore\": " << r.stats.getAcmrBefore() << ", \"acmrAfter\": " << r.stats.getAcmrAfter()
+            << ", \"atvrBefore\": " << r.stats.getAtvrBefore() << ", \"atvrAfter\": " << r.stats.getAtvrAfter() << "\n";
+        out << "    }" << (i + 1 < results.size() ? "," : "") << "\n";
+    }
+    out << "  ]\n";
+    out << "}\n";
+}
+
+void writeOptimizerCsv(std::ostream & out, const BenchSettings & settings, const std::vector<OptimizerResult> & results)
+{
+    out << "label,vertices,triangles,optimizeMean,optimizeP50,optimizeP90,optimizeP99,optimizeMax,"
+        << "verticesBefore,verticesAfter,acmrBefore,acmrAfter,atvrBefore,atvrAfter\n";
+
+    for (const auto & r : results)
+    {
+        out << settings.label << "," << r.vertexCount << "," << r.stats.triangles << ","
+            << r.optimizeMs.mean << "," << r.optimizeMs.p50 << "," << r.optimizeMs.p90 << "," << r.optimizeMs.p99 << "," << r.optimizeMs.max << ","
+            << r.stats.verticesBefore << "," << r.stats.verticesAfter << ","
+            << r.stats.getAcmrBefore() << "," << r.stats.getAcmrAfter() << "," << r.stats.getAtvrBefore() << "," << r.stats.getAtvrAfter() << "\n";
+    }
+}
+
+void writeCsv(std::ostream & out, const BenchSettings & settings, const std::vector<BenchResult> & results)
+{
+    out << "label,mode,meshes,vertices,framesInFlight,update,objectData,threads,draw,instancing,culling,vertexFormat,vertexStreams,optimize,viewOffset,success,"
+        << "frameMean,frameP50,frameP90,frameP99,frameMax,"
+        << "transformP50,transformP99,fenceWaitP50,fenceWaitP99,cullP50,cullP99,recordP50,recordP99,submitP50,submitP99,presentP50,presentP99,recordedFrames,"
+        << "visibleObjects,culledObjects,"
+        << "initMs,pipelineMs,pipelineCacheWarm,"
+        << "optimizeMs,acmrBefore,acmrAfter,atvrBefore,atvrAfter,"
+        << "loadMs,uploadBytes,uploadMBps,uploadSubmits,uploadStalls,"
+        << "memoryBlocks,memoryAllocations,memoryBytesAllocated,memoryBytesInUse,memoryFragmentation\n";
+
+    for (const auto & r : results)
+    {
+        out << settings.label << "," << (settings.window ? "window" : "headless") << ","
+            << r.scenario.meshCount << "," << r.scenario.vertexCount << "," << r.scenario.framesInFlight << ","
+            << r.scenario.updatePattern << "," << r.scenario.objectData << "," << r.scenario.recordThreads << "," << r.scenario.drawPath << "," << r.scenario.instancing << ","
+            << r.scenario.culling << "," << r.scenario.vertexFormat << "," << r.scenario.vertexStreams << "," << r.scenario.optimize << "," << settings.viewOffset << "," << (r.success ? 1 : 0) << ","
+            << r.frameMs.mean << "," << r.frameMs.p50 << "," << r.frameMs.p90 << "," << r.frameMs.p99 << "," << r.frameMs.max << ","
+            << r.transformMs.p50 << "," << r.transformMs.p99 << "," << r.fenceWaitMs.p50 << "," << r.fenceWaitMs.p99 << "," << r.cullMs.p50 << "," << r.cullMs.p99 << "," << r.recordMs.p50 << "," << r.recordMs.p99 << ","
+            << r.submitMs.p50 << "," << r.submitMs.p99 << "," << r.presentMs.p50 << "," << r.presentMs.p99 << "," << r.recordedFrames << ","
+            << r.visibleObjects << "," << r.culledObjects << ","
+            << r.startup.initMs << "," << r.startup.pipelineMs << "," << (r.startup.pipelineCacheWarm ? 1 : 0) << ","
+            << r.optimizerStats.optimizeMs << "," << r.optimizerStats.getAcmrBefore() << "," << r.optimizerStats.getAcmrAfter() << ","
+            << r.optimizerStats.getAtvrBefore() << "," << r.optimizerStats.getAtvrAfter() << ","
+            << r.loadMs << "," << r.uploadStats.bytesUploaded << "," << r.uploadMBps << ","
+            << r.uploadStats.submitCount << "," << r.uploadStats.stallCount << ","
+            << r.memoryStats.blockCount << "," << r.memoryStats.allocationCount << ","
+            << r.memoryStats.bytesAllocated << "," << r.memoryStats.bytesInUse << "," << r.memoryStats.fragmentation << "\n";
+    }
+}
+
+int main(int argc, char ** argv)
+{
+    BenchSettings settings;
+    if (!parseArguments(argc, argv, &settings))
+    {
+        std::cerr << "Usage : " << argv[0] << " [--meshes 1,100,...] [--vertices 4,...] [--frames-in-flight 1,2,...]"
+                  << " [--update static,all,sparse,hierarchy] [--object-data push,dynamic,storage] [--threads 1,2,...] [--draw direct,indirect] [--instancing off,on]"
+                  << " [--culling off,cpu,gpu] [--vertex-format full,compact] [--vertex-streams interleaved,split] [--optimize off,on] [--view-offset X] [--pipeline-cache file|off]"
+                  << " [--frames N] [--warmup N] [--width W] [--height H] [--window] [--optimizer-only]"
+                  << " [--format json|csv] [--output file] [--label text]" << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    // Results go to stdout unless an output file is given (progress is on stderr)
+    std::ofstream file;
+    if (!settings.output.empty())
+        file.open(settings.output);
+    std::ostream & out = settings.output.empty() ? std::cout : file;
+
+    if (settings.optimizerOnly)
+    {
+        std::vector<OptimizerResult> optimizerResults;
+        for (int vertexCount : settings.vertexCounts)
+        {
+            std::cerr << "optimizer vertices=" << vertexCount << std::endl;
+            optimizerResults.push_back(runOptimizer(settings, vertexCount));
+        }
+
+        if (settings.format == "csv")
+            writeOptimizerCsv(out, settings, optimizerResults);
+        else
+            writeOptimizerJson(out, settings, optimizerResults);
+        return EXIT_SUCCESS;
+    }
+
+    if (settings.window)
+    {
+        glfwInit();
+        glfwWindowHint(GLFW_CLIENT_API, GLFW_NO_API);
+        glfwWindowHint(GLFW_RESIZABLE, GLFW_FALSE);
+        window = glfwCreateWindow(settings.width, settings.height, "Vulkan Bench", nullptr, nullptr);
+    }
+
+    // Every combination of the dimensions' values, the last dimension changes the fastest
+    std::vector<Dimension> dimensions = getDimensions(settings);
+    std::vector<size_t> entries(dimensions.size(), 0);
+    bool done = std::any_of(dimensions.begin(), dimensions.end(), [](const Dimension & dimension) { return dimension.labels.empty(); });
+    std::vector<BenchResult> results;
+    while (!done)
+    {
+        Scenario scenario;
+        for (size_t d = 0; d < dimensions.size(); ++d)
+        {
+            dimensions[d].select(&scenario, entries[d]);
+            std::cerr << (d > 0 ? " " : "") << dimensions[d].name << "=" << dimensions[d].labels[entries[d]];
+        }
+
+        if (isMeasurable(scenario))
+        {
+            std::cerr << std::endl;
+            results.push_back(runScenario(settings, scenario));
+        }
+        else
+        {
+            std::cerr << " : skipped (no hierarchy with instancing)" << std::endl;
+        }
+
+        // Next combination : the last dimension moves to its next value, wrapping around moves the previous one
+        size_t d = dimensions.size();
+        while (d > 0 && ++entries[d - 1] == dimensions[d - 1].labels.size())
+        {
+            entries[d - 1] = 0;
+            --d;
+        }
+        done = d == 0;
+    }
+
+    if (settings.window)
+    {
+        glfwDestroyWindow(window);
+        glfwTerminate();
+    }
+
+    if (settings.format == "csv")
+        writeCsv(out, settings, results);
+    else
+        writeJson(out, settings, results);
+
+    for (const auto & result : results)
+    {
+        if (!result.success)
+            return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
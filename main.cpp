@@ -7,7 +7,10 @@
 #include "VulkanRenderer.hpp"
 
 #include <iostream>
+#include <fstream>
 #include <string>
+#include <cstring>
+#include <cmath>
 
 GLFWwindow * window;
 VulkanRenderer vulkanRenderer;
@@ -19,19 +22,125 @@ void initWindow(const std::string & wName = "Tuto",
     glfwInit();
 
     glfwWindowHint(GLFW_CLIENT_API, GLFW_NO_API); // Important pour VULKAN pour ne pas OPENGL
-    glfwWindowHint(GLFW_RESIZABLE, GLFW_FALSE);
+    glfwWindowHint(GLFW_RESIZABLE, GLFW_TRUE);
 
     window = glfwCreateWindow(width, height, wName.c_str(), nullptr, nullptr);
+
+    // Swapchain, depth buffer and framebuffers follow the window size
+    glfwSetFramebufferSizeCallback(window, [](GLFWwindow *, int, int) {
+        vulkanRenderer.notifyResize();
+    });
+}
+
+// Demo scene : two quads sharing the same indices, and a ring of instanced quads
+void createScene()
+{
+    // Vertex Data
+    std::vector<Vertex> meshVertices = {
+        { { -0.4, 0.4, 0.0 },{ 1.0f, 0.0f, 0.0f } },	// 0
+        { { -0.4, -0.4, 0.0 },{ 1.0f, 0.0f, 0.0f } },	    // 1
+        { { 0.4, -0.4, 0.0 },{ 0.0f, 1.0f, 0.0f } },    // 2
+        { { 0.4, 0.4, 0.0 },{ 0.0f, 1.0f, 0.0f } },   // 3
+    };
+
+    std::vector<Vertex> meshVertices2 = {
+        { { -0.25, 0.6, 0.0 },{ 0.0f, 0.0f, 1.0f } },	// 0
+        { { -0.25, -0.6, 0.0 },{ 0.0f, 0.0f, 1.0f } },	    // 1
+        { { 0.25, -0.6, 0.0 },{ 0.0f, 0.0f, 1.0f } },    // 2
+        { { 0.25, 0.6, 0.0 },{ 0.0f, 0.0f, 1.0f } },   // 3
+    };
+
+    // Index Data
+    std::vector<uint32_t> meshIndices = {
+        0, 1, 2,
+        2, 3, 0
+    };
+
+    vulkanRenderer.addMesh(&meshVertices, &meshIndices);
+    vulkanRenderer.addMesh(&meshVertices2, &meshIndices);
+
+    // Ring of small white quads behind : one mesh, 64 instances (one draw call with storage buffer object data)
+    std::vector<Vertex> smallQuadVertices = {
+        { { -0.05, 0.05, 0.0 },{ 1.0f, 1.0f, 1.0f } },
+        { { -0.05, -0.05, 0.0 },{ 1.0f, 1.0f, 1.0f } },
+        { { 0.05, -0.05, 0.0 },{ 1.0f, 1.0f, 1.0f } },
+        { { 0.05, 0.05, 0.0 },{ 1.0f, 1.0f, 1.0f } },
+    };
+
+    const int ringSize = 64;
+    std::vector<Model> ring(ringSize);
+    for (int i = 0; i < ringSize; ++i)
+    {
+        float ringAngle = 6.28318530718f * i / ringSize;
+        ring[i].model = glm::translate(glm::mat4(1.0f), glm::vec3(cosf(ringAngle) * 1.5f, sinf(ringAngle) * 1.5f, -3.0f));
+        ring[i].color = glm::vec4(0.5f + 0.5f * cosf(ringAngle), 0.5f + 0.5f * sinf(ringAngle), 1.0f - (float)i / ringSize, 1.0f);
+    }
+    vulkanRenderer.addInstancedMesh(&smallQuadVertices, &meshIndices, ring);
+}
+
+void updateScene(float angle)
+{
+    const int modelIds[] = { 0, 1 };
+    glm::mat4 models[] = { glm::mat4(1.0f), glm::mat4(1.0f) };
+
+    models[0] = glm::translate(models[0], glm::vec3(0.0f, 0.0f, -2.0f));
+    models[0] = glm::rotate(models[0], glm::radians(angle), glm::vec3(0.0f, 0.0f, 1.0f));
+
+    models[1] = glm::translate(models[1], glm::vec3(0.0f, 0.0f, -2.0f));
+    models[1] = glm::rotate(models[1], glm::radians(-angle * 10), glm::vec3(0.0f, 0.0f, 1.0f));
+
+    vulkanRenderer.updateModels(modelIds, models, 2);
 }
 
-int main()
+// Renders a fixed number of frames offscreen and writes the last one to a PPM image
+int runHeadless(int frameCount, const std::string & outputPath)
 {
+    if (vulkanRenderer.initHeadless(800, 600, MAX_FRAME_DRAWS, true) == EXIT_FAILURE)
+    {
+        return EXIT_FAILURE;
+    }
+    createScene();
+
+    // Fixed time step so every run renders the same images
+    float angle = 0.0f;
+    for (int i = 0; i < frameCount; ++i)
+    {
+        angle += 10.0f / 60.0f;
+        updateScene(angle);
+        vulkanRenderer.draw();
+    }
+
+    std::vector<uint8_t> pixels;
+    vulkanRenderer.readbackFrame(&pixels);
+
+    // RGBA8 -> binary PPM (RGB)
+    VkExtent2D extent = vulkanRenderer.getExtent();
+    std::ofstream file(outputPath, std::ios::binary);
+    file << "P6\n" << extent.width << " " << extent.height << "\n255\n";
+    for (size_t i = 0; i < pixels.size(); i += 4)
+        file.write(reinterpret_cast<const char *>(&pixels[i]), 3);
+
+    vulkanRenderer.destroy();
+
+    return EXIT_SUCCESS;
+}
+
+int main(int argc, char ** argv)
+{
+    // --headless [frames] : no window, render offscreen and save the last frame
+    if (argc > 1 && strcmp(argv[1], "--headless") == 0)
+    {
+        int frameCount = argc > 2 ? std::stoi(argv[2]) : 60;
+        return runHeadless(frameCount, "headless_frame.ppm");
+    }
+
     initWindow("First Vulkan Prototype");
 
     if (vulkanRenderer.init(window) == EXIT_FAILURE)
     {
         return EXIT_FAILURE;
     }
+    createScene();
 
     float angle = 0.0f;
     float deltaTime = 0.0f;
@@ -50,17 +159,7 @@ int main()
 
         if (angle > 360.0f) angle -= 360.0f;
 
-        glm::mat4 firstModel(1.0f);
-        glm::mat4 secondModel(1.0f);
-
-        firstModel = glm::translate(firstModel, glm::vec3(0.0f, 0.0f, -2.0f));
-        firstModel = glm::rotate(firstModel, glm::radians(angle), glm::vec3(0.0f, 0.0f, 1.0f));
-
-        secondModel = glm::translate(secondModel, glm::vec3(0.0f, 0.0f, -2.0f));
-        secondModel = glm::rotate(secondModel, glm::radians(-angle * 10), glm::vec3(0.0f, 0.0f, 1.0f));
-
-        vulkanRenderer.updateModel(0, firstModel);
-        vulkanRenderer.updateModel(1, secondModel);
+        updateScene(angle);
 
         vulkanRenderer.draw();
     }